@@ -9,6 +9,19 @@
 #define SM2_C1C2C3 16
 #define SM2_C1C3C2 64
 
+#define SM4_CBC 1
+#define SM4_CTR 2
+#define SM4_GCM 3
+
+// paillier n of up to 4096 bits, 2048 by default
+#define PAILLIER_N_MAX 512
+#define PAILLIER_P_MAX 256
+#define PAILLIER_DEFAULT_BITS 2048
+
+// ciphertext record formats
+#define PAILLIER_BE     0
+#define PAILLIER_LIMB64 1
+
 
 typedef struct EcPrivateKey {
     uint8_t d[32];
@@ -28,15 +41,91 @@ typedef struct Hash32 {
     uint8_t h[32];
 } Hash32;
 
+typedef struct Sm2Exchange {
+    int initiator;
+    EcPrivateKey sk;
+    EcPrivateKey r;
+    EcPublicKey rp;
+    EcPublicKey peer;
+    Hash32 za;
+    Hash32 zb;
+} Sm2Exchange;
+
+typedef struct Sm3Ctx {
+    uint32_t digest[8];
+    uint8_t block[64];
+    size_t num;
+    uint64_t nblocks;
+} Sm3Ctx;
+
+typedef struct Sm2Stream {
+    int mode;
+    int enc;
+    int release;
+    EcPrivateKey sk;
+    uint8_t z[64];
+    Sm3Ctx kdf;
+    Sm3Ctx mac;
+    uint32_t ct;
+    uint8_t ks[32];
+    size_t ks_num;
+    uint8_t head[97];
+    size_t head_num;
+    uint8_t tail[32];
+    size_t tail_num;
+    uint8_t *held;
+    size_t held_len;
+    size_t held_cap;
+} Sm2Stream;
+
+typedef struct Sm4Key {
+    uint32_t enc[32];
+    uint32_t dec[32];
+    uint64_t gcm[16][2];
+} Sm4Key;
+
+typedef struct Sm4Stream {
+    Sm4Key key;
+    int mode;
+    int enc;
+    uint8_t iv[16];
+    uint8_t buf[16];
+    size_t num;
+    uint8_t j0[16];
+    uint8_t x[16];
+    uint64_t aad_len;
+    uint64_t len;
+} Sm4Stream;
+
+// big endian, right aligned, the key size follows from n
 typedef struct PaillierPrivateKey {
-    uint8_t n[128];
-    uint8_t l[128];
+    uint8_t n[PAILLIER_N_MAX];
+    uint8_t l[PAILLIER_N_MAX];
+    uint8_t p[PAILLIER_P_MAX];
+    uint8_t q[PAILLIER_P_MAX];
 } PaillierPrivateKey;
 
 typedef struct PaillierPublicKey {
-    uint8_t n[128];
+    uint8_t n[PAILLIER_N_MAX];
 } PaillierPublicKey;
 
+typedef struct PaillierCrtKey {
+    int crt;
+    mpz_t n, n2;
+    mpz_t p, q, p2, q2, hp, hq, qinv;
+    mpz_t l, mu;
+} PaillierCrtKey;
+
+typedef struct PaillierPacking {
+    int value_bits;
+    int slot_bits;
+    size_t slots;
+    size_t bytes;
+} PaillierPacking;
+
+typedef struct PaillierEncCtx PaillierEncCtx;
+typedef struct PaillierFixedBase PaillierFixedBase;
+
 // secp256k1 sign algorithm
 /**
  * secp256k1 algorithm initialize.
@@ -90,7 +179,7 @@ void sm2p256v1_key_gen(EcPrivateKey *sk, EcPublicKey *pk);
  * @param msg, input data
  * @param msg_len, length of input data
  * @param mode, SM2_C1C2C3 or SM2_C1C3C2
- * @return out, encrypted data
+ * @return out, encrypted data, NULL when out of memory
  * @return out_len, the length of encrypted data
 */
 void sm2p256v1_encrypt(const EcPublicKey *pk, const uint8_t *msg, const size_t msg_len, const int mode, uint8_t **out, size_t *out_len);
@@ -99,11 +188,49 @@ void sm2p256v1_encrypt(const EcPublicKey *pk, const uint8_t *msg, const size_t m
  * @param cipher, input data (cipher)
  * @param cipher_len, length of input data
  * @param mode, SM2_C1C2C3 or SM2_C1C3C2
- * @return out, decrypted data
+ * @return out, decrypted data, NULL when decryption fails
  * @return out_len, the length of decrypted data
  * @return 1=success, 0=decrypt failed 
 */
 int sm2p256v1_decrypt(const EcPrivateKey *sk, const uint8_t *cipher, const size_t cipher_len, const int mode, uint8_t **out, size_t *out_len);
+/**
+ * *_into functions write into a caller buffer.
+ * @param out, output buffer, NULL to query the size
+ * @param out_len, in: capacity of out, out: bytes written
+ * @return 1=success, 0=failed, if out is NULL or too small *out_len is set to the size needed.
+ * when decryption fails the check of C3, out is zeroed and *out_len set to 0.
+*/
+int sm2p256v1_encrypt_into(const EcPublicKey *pk, const uint8_t *msg, const size_t msg_len, const int mode, uint8_t *out, size_t *out_len);
+int sm2p256v1_decrypt_into(const EcPrivateKey *sk, const uint8_t *cipher, const size_t cipher_len, const int mode, uint8_t *out, size_t *out_len);
+/**
+ * streaming sm2 encryption, memory use does not depend on the message size.
+ * c1 (65 bytes) is ready after init, then c2 comes out of sm2p256v1_stream_update and
+ * c3 out of sm2p256v1_stream_encrypt_final. for SM2_C1C3C2 leave 32 bytes after c1 and
+ * fill them in at the end.
+ * @return 1=success, 0=bad mode
+*/
+int sm2p256v1_stream_encrypt_init(Sm2Stream *s, const EcPublicKey *pk, const int mode, uint8_t c1[65]);
+/**
+ * streaming sm2 decryption, the whole ciphertext (c1 first) is passed through
+ * sm2p256v1_stream_update in chunks of any size.
+ * @param release, 1: plaintext is written by sm2p256v1_stream_update before c3 is
+ *                 checked, discard it if sm2p256v1_stream_decrypt_final fails.
+ *                 0: plaintext is held back and handed out by sm2p256v1_stream_decrypt_final
+ *                 only when c3 matches (memory then grows with the message).
+*/
+int sm2p256v1_stream_decrypt_init(Sm2Stream *s, const EcPrivateKey *sk, const int mode, const int release);
+/**
+ * out needs in_len bytes, *out_len is set to the bytes written.
+ * encryption allows out == in, when decrypting in and out must not overlap.
+ * @return 1=success, 0=malformed c1 or out of memory
+*/
+int sm2p256v1_stream_update(Sm2Stream *s, const uint8_t *in, const size_t in_len, uint8_t *out, size_t *out_len);
+void sm2p256v1_stream_encrypt_final(Sm2Stream *s, uint8_t c3[32]);
+/**
+ * @return out, out_len, release == 0 only: the plaintext (free with archer_free), may be NULL if empty
+ * @return 1=success, 0=truncated ciphertext or c3 mismatch
+*/
+int sm2p256v1_stream_decrypt_final(Sm2Stream *s, uint8_t **out, size_t *out_len);
 
 
 
@@ -130,11 +257,39 @@ void sm2p256v1_sign(const EcPrivateKey *sk, const uint8_t *msg, const size_t msg
 int sm2p256v1_verify(const EcPublicKey *pk, const uint8_t *msg, const size_t msg_len, const EcSignature *sig);
 
 
+// sm2 key exchange (GM/T 0003.3)
+/**
+ * computes both Z values and the ephemeral key pair, r is sent to the peer.
+ * @param initiator, 1 for user A, 0 for user B (responder)
+ * @param sk, pk, own long term key pair
+ * @param id, own user id, e.g. "1234567812345678"
+ * @param peer_pk, peer_id, the other side
+ * @return r, own ephemeral public key, its scalar is drawn from the os on every call
+ * @return 1=success, 0=bad arguments or no os randomness
+*/
+int sm2p256v1_exchange_init(Sm2Exchange *ctx, const int initiator, const EcPrivateKey *sk, const EcPublicKey *pk, const uint8_t *id, const size_t id_len, 
+                    const EcPublicKey *peer_pk, const uint8_t *peer_id, const size_t peer_id_len, EcPublicKey *r);
+/**
+ * @param peer_r, ephemeral public key received from the peer
+ * @return key, shared key of key_len bytes
+ * @return s_send, optional, confirmation hash to send (SA from the initiator, SB from the responder)
+ * @return s_check, optional, the hash the peer is expected to send back, compare it with what arrives
+ * @return 1=success, 0=peer_r is not on the curve or U is the point at infinity
+*/
+int sm2p256v1_exchange_key(Sm2Exchange *ctx, const EcPublicKey *peer_r, uint8_t *key, const size_t key_len, uint8_t s_send[32], uint8_t s_check[32]);
+
+
 
 // hash
 void keccak256(const uint8_t *content, const size_t content_len, Hash32 *hash);
 void sha256(const uint8_t *content, const size_t content_len, Hash32 *hash);
 void sm3(const uint8_t *content, const size_t content_len, Hash32 *hash);
+/**
+ * incremental sm3, sm3_update may be called any number of times.
+*/
+void sm3_init(Sm3Ctx *ctx);
+void sm3_update(Sm3Ctx *ctx, const uint8_t *in, const size_t in_len);
+void sm3_final(Sm3Ctx *ctx, Hash32 *hash);
 
 
 
@@ -144,16 +299,106 @@ void sm4_encrypt(const uint8_t user_key[16], const uint8_t *in, const size_t in_
  * @return 1=success, 0=decrypt failed 
 */
 int sm4_decrypt(const uint8_t user_key[16], const uint8_t *in, const size_t in_size, uint8_t **out, size_t *out_size);
+/**
+ * see sm2p256v1_encrypt_into, sm4_decrypt_into asks for in_size bytes.
+ * sm4_decrypt_into may decrypt in place (out == in), the padding is checked in constant time.
+*/
+int sm4_encrypt_into(const uint8_t user_key[16], const uint8_t *in, const size_t in_size, uint8_t *out, size_t *out_size);
+int sm4_decrypt_into(const uint8_t user_key[16], const uint8_t *in, const size_t in_size, uint8_t *out, size_t *out_size);
+/**
+ * sm4 ctr mode, out gets in_size bytes and may be the same buffer as in.
+ * @param iv, initial counter block, incremented as a 128-bit big endian number
+*/
+void sm4_ctr_encrypt(const uint8_t user_key[16], const uint8_t iv[16], const uint8_t *in, const size_t in_size, uint8_t *out);
+void sm4_ctr_decrypt(const uint8_t user_key[16], const uint8_t iv[16], const uint8_t *in, const size_t in_size, uint8_t *out);
+/**
+ * sm4 gcm (GB/T 36624, RFC 8998), out gets in_size bytes and may be the same buffer as in.
+ * @param iv, 12 bytes recommended, any other length is hashed into the counter
+ * @param aad, additional authenticated data, may be NULL when aad_len is 0
+ * @return tag, 16 bytes
+*/
+void sm4_gcm_encrypt(const uint8_t user_key[16], const uint8_t *iv, const size_t iv_len, const uint8_t *aad, const size_t aad_len, 
+                    const uint8_t *in, const size_t in_size, uint8_t *out, uint8_t tag[16]);
+/**
+ * @return 1=success, 0=tag mismatch, out is left untouched
+*/
+int sm4_gcm_decrypt(const uint8_t user_key[16], const uint8_t *iv, const size_t iv_len, const uint8_t *aad, const size_t aad_len, 
+                    const uint8_t *in, const size_t in_size, const uint8_t tag[16], uint8_t *out);
+/**
+ * bulk sm4 (8 blocks and more) runs on an AES-NI or AVX2+VAES kernel when the cpu has one,
+ * picked at the first call. 0 switches back to the table implementation, e.g. to compare.
+ * not thread safe, call before other threads use sm4.
+ * @return 1 if a simd kernel is in use
+*/
+int sm4_set_simd(int enable);
+/**
+ * ecb/ctr inputs of at least threshold bytes (4 MB by default) are split over threads
+ * workers, one contiguous range each with the calling thread taking the first.
+ * workers are created per call. pin_cpus binds worker i to cpu i (linux), nothing
+ * more is done about memory placement. threads <= 1 turns it off (default).
+ * not thread safe, call before other threads use sm4.
+*/
+void sm4_set_parallel(int threads, size_t threshold, int pin_cpus);
+/**
+ * expand user_key once (round keys of both directions and the gcm hash table),
+ * the sm4_key_* calls below then work like their user_key counterparts.
+*/
+void sm4_key_init(Sm4Key *key, const uint8_t user_key[16]);
+int sm4_key_encrypt_into(const Sm4Key *key, const uint8_t *in, const size_t in_size, uint8_t *out, size_t *out_size);
+int sm4_key_decrypt_into(const Sm4Key *key, const uint8_t *in, const size_t in_size, uint8_t *out, size_t *out_size);
+void sm4_key_ctr_encrypt(const Sm4Key *key, const uint8_t iv[16], const uint8_t *in, const size_t in_size, uint8_t *out);
+void sm4_key_gcm_encrypt(const Sm4Key *key, const uint8_t *iv, const size_t iv_len, const uint8_t *aad, const size_t aad_len, 
+                    const uint8_t *in, const size_t in_size, uint8_t *out, uint8_t tag[16]);
+int sm4_key_gcm_decrypt(const Sm4Key *key, const uint8_t *iv, const size_t iv_len, const uint8_t *aad, const size_t aad_len, 
+                    const uint8_t *in, const size_t in_size, const uint8_t tag[16], uint8_t *out);
+/**
+ * streaming sm4, memory use does not depend on the input size.
+ * @param mode, SM4_CBC (pkcs#7 padding), SM4_CTR or SM4_GCM
+ * @param enc, 1=encrypt, 0=decrypt
+ * @param iv, 16 bytes for cbc/ctr, any length for gcm (12 recommended)
+ * @return 1=success, 0=bad mode or iv length
+*/
+int sm4_stream_init(Sm4Stream *s, const int mode, const int enc, const uint8_t user_key[16], const uint8_t *iv, const size_t iv_len);
+/**
+ * gcm only, any number of calls before the first sm4_stream_update.
+*/
+int sm4_stream_aad(Sm4Stream *s, const uint8_t *aad, const size_t aad_len);
+/**
+ * out needs in_len + 16 bytes, *out_len is set to the bytes written.
+ * ctr/gcm write exactly in_len bytes and allow out == in, cbc buffers partial
+ * blocks and in/out must not overlap.
+*/
+int sm4_stream_update(Sm4Stream *s, const uint8_t *in, const size_t in_len, uint8_t *out, size_t *out_len);
+/**
+ * out needs 16 bytes (cbc only).
+ * @param tag, gcm: written when encrypting, checked when decrypting. gcm decryption
+ *             releases plaintext before the tag is checked, discard it if this fails.
+ * @return 1=success, 0=bad padding or tag mismatch
+*/
+int sm4_stream_final(Sm4Stream *s, uint8_t *out, size_t *out_len, uint8_t tag[16]);
+/**
+ * update + final from in_fd to out_fd through fixed buffers, until end of file.
+ * @return 1=success, 0=io error, bad padding or tag mismatch
+*/
+int sm4_stream_fd(Sm4Stream *s, const int in_fd, const int out_fd, uint8_t tag[16]);
 
 /**
- * @return sk, pk
+ * @return sk, pk, PAILLIER_DEFAULT_BITS modulus
 */
 void paillier_key_gen(PaillierPrivateKey *sk, PaillierPublicKey *pk);
+/**
+ * p and q are searched on two threads, candidates are sieved by the odd primes
+ * below 8192 before the probabilistic test.
+ * the searches are seeded from the os random source.
+ * @param bits, size of n, a multiple of 64 from 1024 to 4096 (2048, 3072, 4096)
+ * @return 1=success, 0=unsupported size or no os randomness
+*/
+int paillier_key_gen_bits(PaillierPrivateKey *sk, PaillierPublicKey *pk, const int bits);
 /**
  * @param pk, publicKey
  * @param msg, input data
  * @param msg_len, length of input data
- * @return cipher, encrypted data
+ * @return cipher, encrypted data, NULL if the os random source failed
  * @return cipher_len, the length of encrypted data
 */
 void paillier_encrypt(const PaillierPublicKey *pk, const uint8_t *msg, const size_t msg_len, uint8_t **cipher, size_t *cipher_len);
@@ -187,6 +432,191 @@ void paillier_add(const PaillierPublicKey *pk, const uint8_t *cipher0, const siz
  * @return cipher_len, the length of encrypted data c
 */
 void paillier_mul(const PaillierPublicKey *pk, const uint8_t *cipher_in, const size_t cipher_in_len, const uint8_t *msg, const size_t msg_len, uint8_t **cipher, size_t *cipher_len);
+/**
+ * c = -a
+ * @return cipher, cipher_len, see paillier_add
+*/
+void paillier_neg(const PaillierPublicKey *pk, const uint8_t *cipher_in, const size_t cipher_in_len, uint8_t **cipher, size_t *cipher_len);
+/**
+ * c = a - b
+ * @return cipher, cipher_len, see paillier_add
+*/
+void paillier_sub(const PaillierPublicKey *pk, const uint8_t *cipher0, const size_t cipher0_len, const uint8_t *cipher1, const size_t cipher1_len, uint8_t **cipher, size_t *cipher_len);
+/**
+ * see sm2p256v1_encrypt_into, ciphers need 2 * |n| bytes, messages |n| bytes (|n| = bits / 8).
+ * every function returning a ciphertext writes exactly 2 * |n| bytes, zero padded on the left.
+*/
+int paillier_encrypt_into(const PaillierPublicKey *pk, const uint8_t *msg, const size_t msg_len, uint8_t *cipher, size_t *cipher_len);
+int paillier_decrypt_into(const PaillierPrivateKey *sk, const uint8_t *cipher, const size_t cipher_len, uint8_t *msg, size_t *msg_len);
+int paillier_add_into(const PaillierPublicKey *pk, const uint8_t *cipher0, const size_t cipher0_len, const uint8_t *cipher1, const size_t cipher1_len, uint8_t *cipher, size_t *cipher_len);
+int paillier_mul_into(const PaillierPublicKey *pk, const uint8_t *cipher_in, const size_t cipher_in_len, const uint8_t *msg, const size_t msg_len, uint8_t *cipher, size_t *cipher_len);
+int paillier_neg_into(const PaillierPublicKey *pk, const uint8_t *cipher_in, const size_t cipher_in_len, uint8_t *cipher, size_t *cipher_len);
+int paillier_sub_into(const PaillierPublicKey *pk, const uint8_t *cipher0, const size_t cipher0_len, const uint8_t *cipher1, const size_t cipher1_len, uint8_t *cipher, size_t *cipher_len);
+/**
+ * signed plaintexts: value mod n, so that (-n/2, n/2] decodes back with its sign.
+ * the encoding also works as a scalar for paillier_mul, a negative k multiplies by k.
+ * msg needs |n| bytes, decode takes any decrypted message.
+ * @return 1=success, 0=msg too small or, when decoding, a value outside int64
+*/
+int paillier_encode_signed(const PaillierPublicKey *pk, const int64_t value, uint8_t *msg, size_t *msg_len);
+int paillier_decode_signed(const PaillierPublicKey *pk, const uint8_t *msg, const size_t msg_len, int64_t *value);
+/**
+ * fixed point plaintexts: round(value * scale) as a signed plaintext, e.g. scale = 1 << 20.
+ * sums keep the scale, a product of two encoded numbers (paillier_mul with an encoded scalar)
+ * has scale * scale and has to be decoded with it.
+ * @return 1=success, 0=value not finite, scale <= 0 or |value * scale| >= n / 2
+*/
+int paillier_encode_fixed(const PaillierPublicKey *pk, const double value, const double scale, uint8_t *msg, size_t *msg_len);
+int paillier_decode_fixed(const PaillierPublicKey *pk, const uint8_t *msg, const size_t msg_len, const double scale, double *value);
+/**
+ * fixed stride ciphertext records, e.g. record i of a mapped file at i * paillier_cipher_width(pk).
+ * PAILLIER_BE records are plain ciphertexts and can be passed to every paillier function
+ * in place, PAILLIER_LIMB64 records are 64 bit words in host byte order, least significant first.
+ * @return 2 * |n|
+*/
+size_t paillier_cipher_width(const PaillierPublicKey *pk);
+/**
+ * write a ciphertext as one record of paillier_cipher_width(pk) bytes at out.
+ * @return 1=success, 0=unknown format or cipher wider than a record
+*/
+int paillier_cipher_store(const PaillierPublicKey *pk, const uint8_t *cipher, const size_t cipher_len, const int format, uint8_t *out);
+/**
+ * read the record at in back into a big endian ciphertext.
+ * @return 1=success, 0=unknown format or cipher too small
+*/
+int paillier_cipher_load(const PaillierPublicKey *pk, const uint8_t *in, const int format, uint8_t *cipher, size_t *cipher_len);
+/**
+ * encrypt or decrypt count fixed width records, messages of |n| bytes and ciphertexts of
+ * 2 * |n| bytes (paillier_cipher_width) back to back. the exponentiations run 8 at a time
+ * on an AVX-512 IFMA montgomery kernel when the cpu has one, on GMP otherwise.
+ * @return 1=success, 0=output too small, *ciphers_len / *msgs_len set to count times the record size
+*/
+int paillier_encrypt_batch_into(const PaillierPublicKey *pk, const uint8_t *msgs, const size_t count, uint8_t *ciphers, size_t *ciphers_len);
+int paillier_decrypt_batch_into(const PaillierPrivateKey *sk, const uint8_t *ciphers, const size_t count, uint8_t *msgs, size_t *msgs_len);
+/**
+ * see sm4_set_simd, for the paillier batch functions.
+ * @return 1 if the IFMA kernel is in use
+*/
+int paillier_set_simd(int enable);
+/**
+ * c = a_0 + a_1 + ... + a_(count-1), ciphertexts are multiplied modulo n^2 with one
+ * reduction per 4 factors.
+ * @param ciphers, cipher_lens, count ciphertexts
+ * @return cipher, cipher_len, see paillier_add
+*/
+void paillier_sum(const PaillierPublicKey *pk, const uint8_t *const *ciphers, const size_t *cipher_lens, const size_t count, uint8_t **cipher, size_t *cipher_len);
+int paillier_sum_into(const PaillierPublicKey *pk, const uint8_t *const *ciphers, const size_t *cipher_lens, const size_t count, uint8_t *cipher, size_t *cipher_len);
+/**
+ * c = w_0 * a_0 + ... + w_(count-1) * a_(count-1) as one multi-exponentiation per
+ * 1024 ciphertexts, see paillier_multi_powm.
+ * @param weights, weight_lens, unencrypted numbers as in paillier_mul
+*/
+void paillier_weighted_sum(const PaillierPublicKey *pk, const uint8_t *const *ciphers, const size_t *cipher_lens, 
+                    const uint8_t *const *weights, const size_t *weight_lens, const size_t count, uint8_t **cipher, size_t *cipher_len);
+int paillier_weighted_sum_into(const PaillierPublicKey *pk, const uint8_t *const *ciphers, const size_t *cipher_lens, 
+                    const uint8_t *const *weights, const size_t *weight_lens, const size_t count, uint8_t *cipher, size_t *cipher_len);
+/**
+ * out = prod bases[i]^exps[i] mod mod, the squarings are shared by all bases.
+ * straus (per base tables, windows of 1 to 4 bits) or pippenger (buckets, windows of
+ * up to 12 bits) is picked from count and the largest exponent, pippenger wins for
+ * many bases. bases and exps are not modified, out may not be one of them.
+*/
+void paillier_multi_powm(mpz_t out, mpz_t *bases, mpz_t *exps, const size_t count, const mpz_t mod);
+/**
+ * fixed base: one ciphertext raised to many scalars (paillier_mul with the same cipher_in).
+ * the table holds c^(d * 16^i) for every 4 bit digit d of scalars up to max_bits bits,
+ * (max_bits / 4) * 15 values of 2 * |n| bytes, each scalar then costs one multiplication
+ * per non zero digit and no squarings. longer scalars fall back to a plain exponentiation.
+ * @return NULL when out of memory
+*/
+PaillierFixedBase *paillier_fixed_base_new(const PaillierPublicKey *pk, const uint8_t *cipher, const size_t cipher_len, const size_t max_bits);
+void paillier_fixed_base_free(PaillierFixedBase *fb);
+/**
+ * c = a * msg for the precomputed a, see paillier_mul_into. may be called from several threads.
+*/
+int paillier_fixed_base_mul_into(const PaillierFixedBase *fb, const uint8_t *msg, const size_t msg_len, uint8_t *cipher, size_t *cipher_len);
+/**
+ * packed plaintexts: slots values of value_bits bits in one message, each slot
+ * value_bits + headroom_bits wide (64 at most) with slot 0 in the lowest bits.
+ * paillier_add/paillier_sum of packed ciphertexts add slot by slot, paillier_mul by k
+ * multiplies every slot by k, as long as no slot result reaches 2^slot_bits
+ * (2^headroom_bits additions of full size values, or scalars below 2^headroom_bits),
+ * a carry out of a slot corrupts the next one.
+ * e.g. 32 bit counters with 16 bits headroom: 42 slots per ciphertext at 2048 bits.
+ * @return pack, 1=success, 0=bad sizes
+*/
+int paillier_pack_init(PaillierPacking *pack, const PaillierPublicKey *pk, const int value_bits, const int headroom_bits);
+/**
+ * encode count (<= pack->slots) values into msg for paillier_encrypt_into, msg needs pack->bytes bytes.
+ * @return 1=success, 0=too many values, a value wider than value_bits or msg too small
+*/
+int paillier_pack(const PaillierPacking *pack, const uint64_t *values, const size_t count, uint8_t *msg, size_t *msg_len);
+/**
+ * decode the first count slots of a decrypted message, whole slots including the headroom.
+*/
+int paillier_unpack(const PaillierPacking *pack, const uint8_t *msg, const size_t msg_len, uint64_t *values, const size_t count);
+/**
+ * sums of at least threshold ciphertexts (1024 by default) are split over threads workers,
+ * the partial products are combined pairwise. threads <= 1 turns it off (default).
+ * not thread safe, call before other threads use paillier.
+*/
+void paillier_set_parallel(int threads, size_t threshold);
+/**
+ * decryption key with everything derived from sk computed once: n^2 and mu, and when sk
+ * has p and q (keys from paillier_key_gen) the crt values, decryption then runs two
+ * half size exponents modulo p^2 and q^2. sk with p and q zeroed falls back to lambda/mu.
+ * paillier_decrypt also uses crt when p and q are set, with a key like this one kept per
+ * thread for the last sk it was given.
+*/
+void paillier_crt_key_init(PaillierCrtKey *key, const PaillierPrivateKey *sk);
+void paillier_crt_key_clear(PaillierCrtKey *key);
+int paillier_crt_decrypt_into(const PaillierCrtKey *key, const uint8_t *cipher, const size_t cipher_len, uint8_t *msg, size_t *msg_len);
+/**
+ * encryption context of one public key: n^2 is computed once and r^n mod n^2, the
+ * expensive part, comes from a pool of up to pool_size values, leaving one multiplication
+ * and one reduction per encryption. threads background workers (up to 64) keep the pool
+ * topped up, with threads = 0 it is only filled by paillier_enc_ctx_fill.
+ * an empty pool is not waited on, r^n is then computed inline.
+ * paillier_enc_ctx_encrypt_into may be called from several threads.
+ * r is drawn from gmp states seeded by the os random source.
+ * @return NULL when out of memory or no os randomness
+*/
+PaillierEncCtx *paillier_enc_ctx_new(const PaillierPublicKey *pk, const size_t pool_size, const int threads);
+/**
+ * stops the workers and frees the pool.
+*/
+void paillier_enc_ctx_free(PaillierEncCtx *ctx);
+/**
+ * computes up to count pool values on the calling thread, e.g. while idle.
+ * @return values added, less than count once the pool is full
+*/
+size_t paillier_enc_ctx_fill(PaillierEncCtx *ctx, const size_t count);
+size_t paillier_enc_ctx_available(PaillierEncCtx *ctx);
+/**
+ * see paillier_encrypt_into.
+*/
+int paillier_enc_ctx_encrypt_into(PaillierEncCtx *ctx, const uint8_t *msg, const size_t msg_len, uint8_t *cipher, size_t *cipher_len);
+
+
+
+// scratch memory
+/**
+ * every thread keeps the big number temporaries of the algorithms above
+ * between calls, so sign/verify/hash do not allocate once warmed up. each number
+ * keeps the largest size it held, about 5 KB per thread after 2048 bit paillier
+ * calls and 10 KB at 4096 bits. they are released when the thread exits (pthreads,
+ * which includes threads attached to a jvm), or earlier by this call.
+*/
+void archer_arena_free();
+/**
+ * allocator used for every buffer returned through uint8_t **out, malloc/free by default.
+ * set it once before any other call, NULL restores the default.
+*/
+void archer_set_allocator(void *(*alloc_fn)(size_t), void (*free_fn)(void *));
+/**
+ * release a buffer returned through uint8_t **out.
+*/
+void archer_free(void *p);
 
 
 #endif
\ No newline at end of file
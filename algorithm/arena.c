@@ -0,0 +1,164 @@
+#if defined(_WIN32)
+// rand_s
+#define _CRT_RAND_S
+#endif
+
+#include "arena.h"
+
+#include <pthread.h>
+#include <stdio.h>
+
+#if defined(__linux__)
+#include <sys/random.h>
+#endif
+
+// slots past the first ARENA_MPZ_COUNT, never moved so handed out mpz stay valid
+typedef struct mpz_block {
+    struct mpz_block *next;
+    mpz_t v[ARENA_MPZ_COUNT];
+} mpz_block;
+
+typedef struct mpz_arena {
+    size_t top;
+    size_t inited;
+    int registered;
+    mpz_block *more;
+    mpz_t v[ARENA_MPZ_COUNT];
+} mpz_arena;
+
+static ARCHER_TLS mpz_arena _arena;
+
+static void (*_arena_hooks[ARENA_HOOKS])();
+static int _arena_hook_count = 0;
+
+static pthread_once_t _arena_once = PTHREAD_ONCE_INIT;
+static pthread_key_t _arena_key;
+
+static void arena_thread_exit(void *arg) {
+    archer_arena_free();
+}
+
+static void arena_key_init() {
+    pthread_key_create(&_arena_key, arena_thread_exit);
+}
+
+static void *(*_archer_alloc)(size_t) = malloc;
+static void (*_archer_free)(void *) = free;
+
+size_t arena_mark() {
+    return _arena.top;
+}
+
+static mpz_ptr arena_slot(size_t i) {
+    if(i < ARENA_MPZ_COUNT) {
+        return _arena.v[i];
+    }
+    mpz_block *b = _arena.more;
+    for(i -= ARENA_MPZ_COUNT; i >= ARENA_MPZ_COUNT; i -= ARENA_MPZ_COUNT) {
+        b = b->next;
+    }
+    return b->v[i];
+}
+
+/**
+ * the returned mpz is valid until arena_release() with a mark taken before it.
+ * its value is undefined, limbs grown by earlier calls are kept. past ARENA_MPZ_COUNT
+ * live temporaries the arena grows by another block, taken from gmp's allocator so
+ * running out of memory is handled as for any other mpz.
+*/
+mpz_ptr arena_mpz() {
+    if(_arena.top == _arena.inited) {
+        if(!_arena.registered) {
+            // archer_arena_free runs when the thread exits
+            pthread_once(&_arena_once, arena_key_init);
+            pthread_setspecific(_arena_key, &_arena);
+            _arena.registered = 1;
+        }
+        if(_arena.inited && _arena.inited % ARENA_MPZ_COUNT == 0) {
+            void *(*alloc_fn)(size_t);
+            mp_get_memory_functions(&alloc_fn, NULL, NULL);
+            mpz_block *b = (mpz_block *) alloc_fn(sizeof(mpz_block)), **tail = &_arena.more;
+            b->next = NULL;
+            while(*tail) {
+                tail = &(*tail)->next;
+            }
+            *tail = b;
+        }
+        mpz_init2(arena_slot(_arena.inited++), ARENA_MPZ_BITS);
+    }
+    return arena_slot(_arena.top++);
+}
+
+void arena_release(size_t mark) {
+    _arena.top = mark;
+}
+
+void arena_on_free(void (*fn)()) {
+    if(_arena_hook_count < ARENA_HOOKS) {
+        _arena_hooks[_arena_hook_count++] = fn;
+    }
+}
+
+void archer_arena_free() {
+    for(int i = 0; i < _arena_hook_count; i++) {
+        _arena_hooks[i]();
+    }
+    for(size_t i = 0; i < _arena.inited; i++) {
+        mpz_clear(arena_slot(i));
+    }
+    void (*free_fn)(void *, size_t);
+    mp_get_memory_functions(NULL, NULL, &free_fn);
+    while(_arena.more) {
+        mpz_block *b = _arena.more;
+        _arena.more = b->next;
+        free_fn(b, sizeof(mpz_block));
+    }
+    _arena.inited = 0;
+    _arena.top = 0;
+}
+
+void archer_set_allocator(void *(*alloc_fn)(size_t), void (*free_fn)(void *)) {
+    _archer_alloc = alloc_fn ? alloc_fn : malloc;
+    _archer_free = free_fn ? free_fn : free;
+}
+
+void *archer_malloc(size_t size) {
+    return _archer_alloc(size);
+}
+
+void archer_free(void *p) {
+    if(p) {
+        _archer_free(p);
+    }
+}
+
+int archer_entropy(uint8_t *buf, size_t len) {
+#if defined(_WIN32)
+    for(size_t i = 0; i < len; i += 4) {
+        unsigned int v;
+        if(rand_s(&v)) {
+            return 0;
+        }
+        memcpy(buf + i, &v, len - i < 4 ? len - i : 4);
+    }
+    return 1;
+#elif defined(__linux__)
+    while(len) {
+        ssize_t got = getrandom(buf, len, 0);
+        if(got < 0) {
+            return 0;
+        }
+        buf += got;
+        len -= (size_t) got;
+    }
+    return 1;
+#else
+    FILE *f = fopen("/dev/urandom", "rb");
+    if(!f) {
+        return 0;
+    }
+    size_t got = fread(buf, 1, len, f);
+    fclose(f);
+    return got == len;
+#endif
+}
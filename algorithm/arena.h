@@ -0,0 +1,35 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include "archer.h"
+
+#if defined(_MSC_VER)
+#define ARCHER_TLS __declspec(thread)
+#else
+#define ARCHER_TLS __thread
+#endif
+
+// per-thread stack of mpz temporaries, kept (and grown) across calls
+#define ARENA_MPZ_COUNT 32
+#define ARENA_MPZ_BITS  2048
+
+size_t arena_mark();
+mpz_ptr arena_mpz();
+void arena_release(size_t mark);
+void archer_arena_free();
+// fn runs in archer_arena_free, for other per-thread caches. up to ARENA_HOOKS, register once
+#define ARENA_HOOKS 4
+void arena_on_free(void (*fn)());
+
+// allocator of every buffer returned through uint8_t **out
+void archer_set_allocator(void *(*alloc_fn)(size_t), void (*free_fn)(void *));
+void *archer_malloc(size_t size);
+void archer_free(void *p);
+
+/**
+ * len bytes from the os: getrandom on linux, rand_s on windows, /dev/urandom elsewhere.
+ * @return 0 if the source could not be read
+*/
+int archer_entropy(uint8_t *buf, size_t len);
+
+#endif
@@ -0,0 +1,1144 @@
+/**
+ * benchmarks of the functions in archer.h, see build.md for the build line. not measured:
+ * setup, configuration and teardown (secp256k1_init, sm2p256v1_init, archer_set_allocator,
+ * sm4_set_parallel, sm4_set_simd, paillier_set_parallel, paillier_set_simd,
+ * paillier_crt_key_clear, paillier_fixed_base_free), paillier_enc_ctx_available (a locked
+ * read) and paillier_enc_ctx_fill (one r^n per value, the same work as
+ * paillier_enc_ctx_encrypt_into with an empty pool).
+ *
+ * every case runs a warmup first, which also sizes the batches: operations shorter than
+ * BENCH_SAMPLE_NS are timed in batches so that the clock does not dominate. each sample is
+ * the time of one batch divided by its length, percentiles are taken over all samples of
+ * all repetitions. cycles come from the time stamp counter where there is one.
+ *
+ * with -p n every case also runs from 1, 2, 4 .. n threads at once, each thread with its
+ * own buffers, to show how throughput scales against the single thread run and where
+ * locks or the allocator get in the way.
+ *
+ * ./bench [-f filter] [-t ms] [-w ms] [-r reps] [-c cpu] [-p threads] [-j file.json] [-l]
+*/
+#define _GNU_SOURCE
+
+#include "archer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#define bench_lseek _lseek
+#else
+#include <sched.h>
+#include <unistd.h>
+#define bench_lseek lseek
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define BENCH_TSC
+#endif
+
+#define BENCH_MAX_SIZE   (1 << 20)
+#define BENCH_SLACK      1024
+#define BENCH_SAMPLE_NS  2000
+#define BENCH_MAX_SAMPLES (1 << 20)
+#define BENCH_MAX_REPS   32
+#define BENCH_MAX_THREADS 256
+// -p without -f
+#define BENCH_SCALE_FILTER "_sign,_verify,sha256,sm3,keccak256"
+#define BENCH_CHUNK      4096
+// paillier_sum and friends
+#define BENCH_ITEMS      1024
+
+static const size_t BENCH_BULK[] = {16, 256, 4096, 65536, BENCH_MAX_SIZE, 0};
+static const size_t BENCH_MSG[] = {32, 1024, 16384, 0};
+static const size_t BENCH_ONE[] = {32, 0};
+static const size_t BENCH_NONE[] = {1, 0};
+
+typedef struct BenchCtx {
+    uint8_t *in;
+    uint8_t *out;
+    uint8_t *tmp;
+    size_t tmp_len;
+    EcSignature sig;
+    int recv_id;
+    Sm3Ctx sm3;
+    Sm4Stream sm4;
+    Sm2Stream sm2;
+    Sm2Exchange kx;
+    mpz_t powm;
+    // sm4_stream_fd, temporary files written by prep
+    FILE *fin, *fout;
+} BenchCtx;
+
+typedef struct BenchCase {
+    const char *name;
+    // "bytes", "items" or "bits", size 1 with BENCH_NONE means no parameter
+    const char *unit;
+    const size_t *sizes;
+    void (*prep)(BenchCtx *ctx, size_t size);
+    void (*run)(BenchCtx *ctx, size_t size);
+    // optional, after the last size
+    void (*done)(BenchCtx *ctx, size_t size);
+} BenchCase;
+
+typedef struct BenchOpts {
+    const char *filter;
+    double time_ms;
+    double warmup_ms;
+    int reps;
+    int cpu;
+    int threads;
+    const char *json;
+} BenchOpts;
+
+typedef struct BenchResult {
+    const char *name;
+    const char *unit;
+    size_t size;
+    uint64_t ops;
+    double ns;
+    double cycles;
+    double p50, p90, p99, min, max;
+    int reps;
+    double rep_ops[BENCH_MAX_REPS];
+    size_t samples;
+} BenchResult;
+
+static uint64_t bench_ns() {
+#ifdef _WIN32
+    LARGE_INTEGER f, c;
+    QueryPerformanceFrequency(&f);
+    QueryPerformanceCounter(&c);
+    return (uint64_t) ((double) c.QuadPart * 1e9 / (double) f.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+#endif
+}
+
+static uint64_t bench_cycles() {
+#ifdef BENCH_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static int bench_pin(int cpu) {
+    if(cpu < 0) {
+        return 1;
+    }
+#ifdef _WIN32
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR) 1 << cpu) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    return 0;
+#endif
+}
+
+// ---- fixtures, built once and only read by the cases ----
+
+static EcPrivateKey sm2_sk, sm2_peer_sk, secp_sk;
+static EcPublicKey sm2_pk, sm2_peer_pk, sm2_peer_r, secp_pk;
+static const uint8_t sm4_user_key[16] = {1, 35, 69, 103, 137, 171, 205, 239, 254, 220, 186, 152, 118, 84, 50, 16};
+static const uint8_t bench_iv[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+static Sm4Key sm4_key;
+
+static int paillier_ready = 0;
+static PaillierPrivateKey pl_sk;
+static PaillierPublicKey pl_pk;
+static PaillierCrtKey pl_crt;
+static PaillierFixedBase *pl_fb;
+static PaillierEncCtx *pl_ctx;
+static PaillierPacking pl_pack;
+static size_t pl_nb;
+static uint8_t pl_msg[PAILLIER_N_MAX], pl_c0[2 * PAILLIER_N_MAX], pl_c1[2 * PAILLIER_N_MAX];
+static uint8_t *pl_ciphers, *pl_weights, *pl_msgs;
+static const uint8_t **pl_cptr, **pl_wptr;
+static size_t *pl_clens, *pl_wlens;
+static uint64_t pl_slots[64];
+static mpz_t pl_mod, pl_bases[64], pl_exps[64];
+
+static void bench_fixtures() {
+    sm4_key_init(&sm4_key, sm4_user_key);
+    sm2p256v1_key_gen(&sm2_sk, &sm2_pk);
+    sm2p256v1_key_gen(&sm2_peer_sk, &sm2_peer_pk);
+    secp256k1_key_gen(&secp_sk, &secp_pk);
+
+    // the responder's ephemeral key, the initiator side is measured
+    Sm2Exchange b;
+    sm2p256v1_exchange_init(&b, 0, &sm2_peer_sk, &sm2_peer_pk, (const uint8_t *) "2", 1, &sm2_pk, (const uint8_t *) "1", 1, &sm2_peer_r);
+}
+
+static void bench_paillier_fixtures() {
+    if(paillier_ready) {
+        return;
+    }
+    size_t l;
+    paillier_key_gen(&pl_sk, &pl_pk);
+    paillier_crt_key_init(&pl_crt, &pl_sk);
+    pl_nb = paillier_cipher_width(&pl_pk) / 2;
+    for(size_t i = 0; i < pl_nb; i++) {
+        pl_msg[i] = (uint8_t) (i * 7 + 3);
+    }
+    pl_msg[0] = 0;
+    l = sizeof(pl_c0);
+    paillier_encrypt_into(&pl_pk, pl_msg, pl_nb, pl_c0, &l);
+    l = sizeof(pl_c1);
+    paillier_encrypt_into(&pl_pk, pl_msg + 8, pl_nb - 8, pl_c1, &l);
+    pl_fb = paillier_fixed_base_new(&pl_pk, pl_c0, 2 * pl_nb, 64);
+    paillier_pack_init(&pl_pack, &pl_pk, 32, 16);
+    for(int i = 0; i < 64; i++) {
+        pl_slots[i] = (uint64_t) i * 2654435761u & 0xffffffffu;
+    }
+
+    pl_ciphers = malloc(BENCH_ITEMS * 2 * pl_nb);
+    pl_msgs = calloc(BENCH_ITEMS, pl_nb);
+    pl_weights = malloc(BENCH_ITEMS * 8);
+    pl_cptr = malloc(BENCH_ITEMS * sizeof(uint8_t *));
+    pl_wptr = malloc(BENCH_ITEMS * sizeof(uint8_t *));
+    pl_clens = malloc(BENCH_ITEMS * sizeof(size_t));
+    pl_wlens = malloc(BENCH_ITEMS * sizeof(size_t));
+    for(int i = 0; i < BENCH_ITEMS; i++) {
+        pl_msgs[(i + 1) * pl_nb - 1] = (uint8_t) i;
+        for(int j = 0; j < 8; j++) {
+            pl_weights[i * 8 + j] = (uint8_t) (i * 13 + j * 29 + 1);
+        }
+        pl_wptr[i] = pl_weights + i * 8;
+        pl_wlens[i] = 8;
+    }
+    l = BENCH_ITEMS * 2 * pl_nb;
+    paillier_encrypt_batch_into(&pl_pk, pl_msgs, BENCH_ITEMS, pl_ciphers, &l);
+    for(int i = 0; i < BENCH_ITEMS; i++) {
+        pl_cptr[i] = pl_ciphers + i * 2 * pl_nb;
+        pl_clens[i] = 2 * pl_nb;
+    }
+
+    mpz_init(pl_mod);
+    mpz_import(pl_mod, pl_nb, 1, 1, 0, 0, pl_pk.n + PAILLIER_N_MAX - pl_nb);
+    mpz_mul(pl_mod, pl_mod, pl_mod);
+    for(int i = 0; i < 64; i++) {
+        mpz_init(pl_bases[i]);
+        mpz_init(pl_exps[i]);
+        mpz_import(pl_bases[i], 2 * pl_nb, 1, 1, 0, 0, pl_cptr[i]);
+        mpz_import(pl_exps[i], 8, 1, 1, 0, 0, pl_wptr[i]);
+    }
+    paillier_ready = 1;
+}
+
+static void bench_fill(BenchCtx *ctx, size_t size) {
+    for(size_t i = 0; i < size; i++) {
+        ctx->in[i] = (uint8_t) (i * 131 + 7);
+    }
+}
+
+// ---- cases ----
+
+static void run_sha256(BenchCtx *ctx, size_t size) {
+    sha256(ctx->in, size, (Hash32 *) ctx->out);
+}
+
+static void run_sm3(BenchCtx *ctx, size_t size) {
+    sm3(ctx->in, size, (Hash32 *) ctx->out);
+}
+
+static void run_keccak256(BenchCtx *ctx, size_t size) {
+    keccak256(ctx->in, size, (Hash32 *) ctx->out);
+}
+
+static void run_sm3_stream(BenchCtx *ctx, size_t size) {
+    sm3_init(&ctx->sm3);
+    for(size_t off = 0; off < size; off += BENCH_CHUNK) {
+        sm3_update(&ctx->sm3, ctx->in + off, size - off < BENCH_CHUNK ? size - off : BENCH_CHUNK);
+    }
+    sm3_final(&ctx->sm3, (Hash32 *) ctx->out);
+}
+
+static void run_sm4_encrypt_into(BenchCtx *ctx, size_t size) {
+    size_t l = size + BENCH_SLACK;
+    sm4_encrypt_into(sm4_user_key, ctx->in, size, ctx->out, &l);
+}
+
+static void run_sm4_encrypt(BenchCtx *ctx, size_t size) {
+    uint8_t *out = NULL;
+    size_t l = 0;
+    sm4_encrypt(sm4_user_key, ctx->in, size, &out, &l);
+    archer_free(out);
+}
+
+static void prep_sm4_decrypt(BenchCtx *ctx, size_t size) {
+    bench_fill(ctx, size);
+    ctx->tmp_len = size + BENCH_SLACK;
+    sm4_encrypt_into(sm4_user_key, ctx->in, size, ctx->tmp, &ctx->tmp_len);
+}
+
+static void run_sm4_decrypt_into(BenchCtx *ctx, size_t size) {
+    size_t l = size + BENCH_SLACK;
+    sm4_decrypt_into(sm4_user_key, ctx->tmp, ctx->tmp_len, ctx->out, &l);
+}
+
+static void run_sm4_decrypt(BenchCtx *ctx, size_t size) {
+    uint8_t *out = NULL;
+    size_t l = 0;
+    sm4_decrypt(sm4_user_key, ctx->tmp, ctx->tmp_len, &out, &l);
+    archer_free(out);
+}
+
+static void run_sm4_ctr_encrypt(BenchCtx *ctx, size_t size) {
+    sm4_ctr_encrypt(sm4_user_key, bench_iv, ctx->in, size, ctx->out);
+}
+
+static void run_sm4_ctr_decrypt(BenchCtx *ctx, size_t size) {
+    sm4_ctr_decrypt(sm4_user_key, bench_iv, ctx->in, size, ctx->out);
+}
+
+static void run_sm4_gcm_encrypt(BenchCtx *ctx, size_t size) {
+    sm4_gcm_encrypt(sm4_user_key, bench_iv, 12, NULL, 0, ctx->in, size, ctx->out, ctx->tmp);
+}
+
+static void prep_sm4_gcm_decrypt(BenchCtx *ctx, size_t size) {
+    bench_fill(ctx, size);
+    sm4_gcm_encrypt(sm4_user_key, bench_iv, 12, NULL, 0, ctx->in, size, ctx->tmp, ctx->tmp + size);
+}
+
+static void run_sm4_gcm_decrypt(BenchCtx *ctx, size_t size) {
+    sm4_gcm_decrypt(sm4_user_key, bench_iv, 12, NULL, 0, ctx->tmp, size, ctx->tmp + size, ctx->out);
+}
+
+static void run_sm4_key_init(BenchCtx *ctx, size_t size) {
+    sm4_key_init((Sm4Key *) ctx->out, sm4_user_key);
+}
+
+static void run_sm4_key_encrypt_into(BenchCtx *ctx, size_t size) {
+    size_t l = size + BENCH_SLACK;
+    sm4_key_encrypt_into(&sm4_key, ctx->in, size, ctx->out, &l);
+}
+
+static void run_sm4_key_decrypt_into(BenchCtx *ctx, size_t size) {
+    size_t l = size + BENCH_SLACK;
+    sm4_key_decrypt_into(&sm4_key, ctx->tmp, ctx->tmp_len, ctx->out, &l);
+}
+
+static void run_sm4_key_ctr_encrypt(BenchCtx *ctx, size_t size) {
+    sm4_key_ctr_encrypt(&sm4_key, bench_iv, ctx->in, size, ctx->out);
+}
+
+static void run_sm4_key_gcm_encrypt(BenchCtx *ctx, size_t size) {
+    sm4_key_gcm_encrypt(&sm4_key, bench_iv, 12, NULL, 0, ctx->in, size, ctx->out, ctx->tmp);
+}
+
+static void run_sm4_key_gcm_decrypt(BenchCtx *ctx, size_t size) {
+    sm4_key_gcm_decrypt(&sm4_key, bench_iv, 12, NULL, 0, ctx->tmp, size, ctx->tmp + size, ctx->out);
+}
+
+static void run_sm4_stream_gcm(BenchCtx *ctx, size_t size) {
+    size_t l;
+    sm4_stream_init(&ctx->sm4, SM4_GCM, 1, sm4_user_key, bench_iv, 12);
+    sm4_stream_aad(&ctx->sm4, bench_iv, 16);
+    for(size_t off = 0; off < size; off += BENCH_CHUNK) {
+        sm4_stream_update(&ctx->sm4, ctx->in + off, size - off < BENCH_CHUNK ? size - off : BENCH_CHUNK, ctx->out + off, &l);
+    }
+    sm4_stream_final(&ctx->sm4, ctx->out + size, &l, ctx->tmp);
+}
+
+static void bench_close_files(BenchCtx *ctx) {
+    if(ctx->fin) {
+        fclose(ctx->fin);
+        fclose(ctx->fout);
+        ctx->fin = ctx->fout = NULL;
+    }
+}
+
+// size bytes from one temporary file to another, both rewound before every call
+static void prep_sm4_stream_fd(BenchCtx *ctx, size_t size) {
+    bench_fill(ctx, size);
+    bench_close_files(ctx);
+    ctx->fin = tmpfile();
+    ctx->fout = tmpfile();
+    if(!ctx->fin || !ctx->fout) {
+        fprintf(stderr, "cannot create temporary files\n");
+        exit(1);
+    }
+    fwrite(ctx->in, 1, size, ctx->fin);
+    fflush(ctx->fin);
+}
+
+static void run_sm4_stream_fd(BenchCtx *ctx, size_t size) {
+    bench_lseek(fileno(ctx->fin), 0, SEEK_SET);
+    bench_lseek(fileno(ctx->fout), 0, SEEK_SET);
+    sm4_stream_init(&ctx->sm4, SM4_CTR, 1, sm4_user_key, bench_iv, 16);
+    sm4_stream_fd(&ctx->sm4, fileno(ctx->fin), fileno(ctx->fout), NULL);
+}
+
+static void run_secp256k1_key_gen(BenchCtx *ctx, size_t size) {
+    secp256k1_key_gen((EcPrivateKey *) ctx->out, (EcPublicKey *) ctx->tmp);
+}
+
+static void run_secp256k1_public_key(BenchCtx *ctx, size_t size) {
+    secp256k1_privateKey_to_publicKey(&secp_sk, (EcPublicKey *) ctx->out);
+}
+
+static void run_secp256k1_sign(BenchCtx *ctx, size_t size) {
+    secp256k1_sign(&secp_sk, ctx->in, size, (EcSignature *) ctx->out, &ctx->recv_id);
+}
+
+static void prep_secp256k1_sig(BenchCtx *ctx, size_t size) {
+    bench_fill(ctx, size);
+    secp256k1_sign(&secp_sk, ctx->in, size, &ctx->sig, &ctx->recv_id);
+}
+
+static void run_secp256k1_verify(BenchCtx *ctx, size_t size) {
+    secp256k1_verify(&secp_pk, ctx->in, size, &ctx->sig);
+}
+
+static void run_secp256k1_recover(BenchCtx *ctx, size_t size) {
+    secp256k1_recover_publicKey(&ctx->sig, ctx->in, size, ctx->recv_id, (EcPublicKey *) ctx->out);
+}
+
+static void run_sm2_key_gen(BenchCtx *ctx, size_t size) {
+    sm2p256v1_key_gen((EcPrivateKey *) ctx->out, (EcPublicKey *) ctx->tmp);
+}
+
+static void run_sm2_public_key(BenchCtx *ctx, size_t size) {
+    sm2p256v1_privateKey_to_publicKey(&sm2_sk, (EcPublicKey *) ctx->out);
+}
+
+static void run_sm2_sign(BenchCtx *ctx, size_t size) {
+    sm2p256v1_sign(&sm2_sk, ctx->in, size, (EcSignature *) ctx->out);
+}
+
+static void prep_sm2_sig(BenchCtx *ctx, size_t size) {
+    bench_fill(ctx, size);
+    sm2p256v1_sign(&sm2_sk, ctx->in, size, &ctx->sig);
+}
+
+static void run_sm2_verify(BenchCtx *ctx, size_t size) {
+    sm2p256v1_verify(&sm2_pk, ctx->in, size, &ctx->sig);
+}
+
+static void run_sm2_encrypt_into(BenchCtx *ctx, size_t size) {
+    size_t l = size + BENCH_SLACK;
+    sm2p256v1_encrypt_into(&sm2_pk, ctx->in, size, SM2_C1C3C2, ctx->out, &l);
+}
+
+static void run_sm2_encrypt(BenchCtx *ctx, size_t size) {
+    uint8_t *out = NULL;
+    size_t l = 0;
+    sm2p256v1_encrypt(&sm2_pk, ctx->in, size, SM2_C1C3C2, &out, &l);
+    archer_free(out);
+}
+
+static void prep_sm2_decrypt(BenchCtx *ctx, size_t size) {
+    bench_fill(ctx, size);
+    ctx->tmp_len = size + BENCH_SLACK;
+    sm2p256v1_encrypt_into(&sm2_pk, ctx->in, size, SM2_C1C3C2, ctx->tmp, &ctx->tmp_len);
+}
+
+static void run_sm2_decrypt_into(BenchCtx *ctx, size_t size) {
+    size_t l = size + BENCH_SLACK;
+    sm2p256v1_decrypt_into(&sm2_sk, ctx->tmp, ctx->tmp_len, SM2_C1C3C2, ctx->out, &l);
+}
+
+static void run_sm2_decrypt(BenchCtx *ctx, size_t size) {
+    uint8_t *out = NULL;
+    size_t l = 0;
+    sm2p256v1_decrypt(&sm2_sk, ctx->tmp, ctx->tmp_len, SM2_C1C3C2, &out, &l);
+    archer_free(out);
+}
+
+static void run_sm2_stream_encrypt(BenchCtx *ctx, size_t size) {
+    size_t l;
+    sm2p256v1_stream_encrypt_init(&ctx->sm2, &sm2_pk, SM2_C1C2C3, ctx->out);
+    for(size_t off = 0; off < size; off += BENCH_CHUNK) {
+        sm2p256v1_stream_update(&ctx->sm2, ctx->in + off, size - off < BENCH_CHUNK ? size - off : BENCH_CHUNK, ctx->out + 65 + off, &l);
+    }
+    sm2p256v1_stream_encrypt_final(&ctx->sm2, ctx->out + 65 + size);
+}
+
+// plaintext released as it comes, the ciphertext from prep_sm2_decrypt
+static void run_sm2_stream_decrypt(BenchCtx *ctx, size_t size) {
+    size_t l;
+    sm2p256v1_stream_decrypt_init(&ctx->sm2, &sm2_sk, SM2_C1C3C2, 1);
+    for(size_t off = 0; off < ctx->tmp_len; off += BENCH_CHUNK) {
+        sm2p256v1_stream_update(&ctx->sm2, ctx->tmp + off, ctx->tmp_len - off < BENCH_CHUNK ? ctx->tmp_len - off : BENCH_CHUNK, ctx->out + off, &l);
+    }
+    sm2p256v1_stream_decrypt_final(&ctx->sm2, NULL, NULL);
+}
+
+static void run_sm2_exchange(BenchCtx *ctx, size_t size) {
+    EcPublicKey r;
+    sm2p256v1_exchange_init(&ctx->kx, 1, &sm2_sk, &sm2_pk, (const uint8_t *) "1", 1, &sm2_peer_pk, (const uint8_t *) "2", 1, &r);
+    sm2p256v1_exchange_key(&ctx->kx, &sm2_peer_r, ctx->out, 16, ctx->out + 16, ctx->out + 48);
+}
+
+static void prep_paillier(BenchCtx *ctx, size_t size) {
+    bench_paillier_fixtures();
+}
+
+static void run_paillier_key_gen(BenchCtx *ctx, size_t size) {
+    paillier_key_gen_bits((PaillierPrivateKey *) ctx->out, (PaillierPublicKey *) ctx->tmp, (int) size);
+}
+
+static void run_paillier_encrypt_into(BenchCtx *ctx, size_t size) {
+    size_t l = 2 * PAILLIER_N_MAX;
+    paillier_encrypt_into(&pl_pk, pl_msg, pl_nb, ctx->out, &l);
+}
+
+static void run_paillier_encrypt(BenchCtx *ctx, size_t size) {
+    uint8_t *out = NULL;
+    size_t l = 0;
+    paillier_encrypt(&pl_pk, pl_msg, pl_nb, &out, &l);
+    archer_free(out);
+}
+
+// with one worker topping up the pool, only alive during this case
+static void prep_paillier_enc_ctx(BenchCtx *ctx, size_t size) {
+    bench_paillier_fixtures();
+    if(!pl_ctx) {
+        pl_ctx = paillier_enc_ctx_new(&pl_pk, BENCH_ITEMS, 1);
+    }
+}
+
+static void done_paillier_enc_ctx(BenchCtx *ctx, size_t size) {
+    paillier_enc_ctx_free(pl_ctx);
+    pl_ctx = NULL;
+}
+
+static void run_paillier_enc_ctx_encrypt_into(BenchCtx *ctx, size_t size) {
+    size_t l = 2 * PAILLIER_N_MAX;
+    paillier_enc_ctx_encrypt_into(pl_ctx, pl_msg, pl_nb, ctx->out, &l);
+}
+
+static void run_paillier_decrypt_into(BenchCtx *ctx, size_t size) {
+    size_t l = PAILLIER_N_MAX;
+    paillier_decrypt_into(&pl_sk, pl_c0, 2 * pl_nb, ctx->out, &l);
+}
+
+static void run_paillier_decrypt(BenchCtx *ctx, size_t size) {
+    uint8_t *out = NULL;
+    size_t l = 0;
+    paillier_decrypt(&pl_sk, pl_c0, 2 * pl_nb, &out, &l);
+    archer_free(out);
+}
+
+static void run_paillier_crt_decrypt_into(BenchCtx *ctx, size_t size) {
+    size_t l = PAILLIER_N_MAX;
+    paillier_crt_decrypt_into(&pl_crt, pl_c0, 2 * pl_nb, ctx->out, &l);
+}
+
+static void run_paillier_add_into(BenchCtx *ctx, size_t size) {
+    size_t l = 2 * PAILLIER_N_MAX;
+    paillier_add_into(&pl_pk, pl_c0, 2 * pl_nb, pl_c1, 2 * pl_nb, ctx->out, &l);
+}
+
+static void run_paillier_add(BenchCtx *ctx, size_t size) {
+    uint8_t *out = NULL;
+    size_t l = 0;
+    paillier_add(&pl_pk, pl_c0, 2 * pl_nb, pl_c1, 2 * pl_nb, &out, &l);
+    archer_free(out);
+}
+
+static void run_paillier_sub_into(BenchCtx *ctx, size_t size) {
+    size_t l = 2 * PAILLIER_N_MAX;
+    paillier_sub_into(&pl_pk, pl_c0, 2 * pl_nb, pl_c1, 2 * pl_nb, ctx->out, &l);
+}
+
+static void run_paillier_sub(BenchCtx *ctx, size_t size) {
+    uint8_t *out = NULL;
+    size_t l = 0;
+    paillier_sub(&pl_pk, pl_c0, 2 * pl_nb, pl_c1, 2 * pl_nb, &out, &l);
+    archer_free(out);
+}
+
+static void run_paillier_neg_into(BenchCtx *ctx, size_t size) {
+    size_t l = 2 * PAILLIER_N_MAX;
+    paillier_neg_into(&pl_pk, pl_c0, 2 * pl_nb, ctx->out, &l);
+}
+
+static void run_paillier_neg(BenchCtx *ctx, size_t size) {
+    uint8_t *out = NULL;
+    size_t l = 0;
+    paillier_neg(&pl_pk, pl_c0, 2 * pl_nb, &out, &l);
+    archer_free(out);
+}
+
+// scalars of size bytes
+static void run_paillier_mul_into(BenchCtx *ctx, size_t size) {
+    size_t l = 2 * PAILLIER_N_MAX;
+    paillier_mul_into(&pl_pk, pl_c0, 2 * pl_nb, pl_msg + pl_nb - size, size, ctx->out, &l);
+}
+
+static void run_paillier_mul(BenchCtx *ctx, size_t size) {
+    uint8_t *out = NULL;
+    size_t l = 0;
+    paillier_mul(&pl_pk, pl_c0, 2 * pl_nb, pl_msg + pl_nb - size, size, &out, &l);
+    archer_free(out);
+}
+
+static void run_paillier_fixed_base_mul_into(BenchCtx *ctx, size_t size) {
+    size_t l = 2 * PAILLIER_N_MAX;
+    paillier_fixed_base_mul_into(pl_fb, pl_msg + pl_nb - size, size, ctx->out, &l);
+}
+
+static void run_paillier_encrypt_batch_into(BenchCtx *ctx, size_t size) {
+    size_t l = BENCH_MAX_SIZE;
+    paillier_encrypt_batch_into(&pl_pk, pl_msgs, size, ctx->out, &l);
+}
+
+static void run_paillier_decrypt_batch_into(BenchCtx *ctx, size_t size) {
+    size_t l = BENCH_MAX_SIZE;
+    paillier_decrypt_batch_into(&pl_sk, pl_ciphers, size, ctx->out, &l);
+}
+
+static void run_paillier_sum_into(BenchCtx *ctx, size_t size) {
+    size_t l = 2 * PAILLIER_N_MAX;
+    paillier_sum_into(&pl_pk, pl_cptr, pl_clens, size, ctx->out, &l);
+}
+
+static void run_paillier_sum(BenchCtx *ctx, size_t size) {
+    uint8_t *out = NULL;
+    size_t l = 0;
+    paillier_sum(&pl_pk, pl_cptr, pl_clens, size, &out, &l);
+    archer_free(out);
+}
+
+static void run_paillier_weighted_sum_into(BenchCtx *ctx, size_t size) {
+    size_t l = 2 * PAILLIER_N_MAX;
+    paillier_weighted_sum_into(&pl_pk, pl_cptr, pl_clens, pl_wptr, pl_wlens, size, ctx->out, &l);
+}
+
+static void run_paillier_weighted_sum(BenchCtx *ctx, size_t size) {
+    uint8_t *out = NULL;
+    size_t l = 0;
+    paillier_weighted_sum(&pl_pk, pl_cptr, pl_clens, pl_wptr, pl_wlens, size, &out, &l);
+    archer_free(out);
+}
+
+static void run_paillier_multi_powm(BenchCtx *ctx, size_t size) {
+    paillier_multi_powm(ctx->powm, pl_bases, pl_exps, size, pl_mod);
+}
+
+static void run_paillier_encode_signed(BenchCtx *ctx, size_t size) {
+    size_t l = PAILLIER_N_MAX;
+    paillier_encode_signed(&pl_pk, -123456789, ctx->out, &l);
+}
+
+static void prep_paillier_signed(BenchCtx *ctx, size_t size) {
+    bench_paillier_fixtures();
+    ctx->tmp_len = PAILLIER_N_MAX;
+    paillier_encode_signed(&pl_pk, -123456789, ctx->tmp, &ctx->tmp_len);
+}
+
+static void run_paillier_decode_signed(BenchCtx *ctx, size_t size) {
+    paillier_decode_signed(&pl_pk, ctx->tmp, ctx->tmp_len, (int64_t *) ctx->out);
+}
+
+static void run_paillier_encode_fixed(BenchCtx *ctx, size_t size) {
+    size_t l = PAILLIER_N_MAX;
+    paillier_encode_fixed(&pl_pk, -3.14159, 1 << 20, ctx->out, &l);
+}
+
+static void prep_paillier_fixed(BenchCtx *ctx, size_t size) {
+    bench_paillier_fixtures();
+    ctx->tmp_len = PAILLIER_N_MAX;
+    paillier_encode_fixed(&pl_pk, -3.14159, 1 << 20, ctx->tmp, &ctx->tmp_len);
+}
+
+static void run_paillier_decode_fixed(BenchCtx *ctx, size_t size) {
+    paillier_decode_fixed(&pl_pk, ctx->tmp, ctx->tmp_len, 1 << 20, (double *) ctx->out);
+}
+
+static void run_paillier_cipher_store(BenchCtx *ctx, size_t size) {
+    paillier_cipher_store(&pl_pk, pl_c0, 2 * pl_nb, PAILLIER_LIMB64, ctx->out);
+}
+
+static void prep_paillier_record(BenchCtx *ctx, size_t size) {
+    bench_paillier_fixtures();
+    paillier_cipher_store(&pl_pk, pl_c0, 2 * pl_nb, PAILLIER_LIMB64, ctx->tmp);
+}
+
+static void run_paillier_cipher_load(BenchCtx *ctx, size_t size) {
+    size_t l = 2 * PAILLIER_N_MAX;
+    paillier_cipher_load(&pl_pk, ctx->tmp, PAILLIER_LIMB64, ctx->out, &l);
+}
+
+static void run_paillier_pack(BenchCtx *ctx, size_t size) {
+    size_t l = PAILLIER_N_MAX;
+    paillier_pack(&pl_pack, pl_slots, pl_pack.slots, ctx->out, &l);
+}
+
+static void prep_paillier_unpack(BenchCtx *ctx, size_t size) {
+    bench_paillier_fixtures();
+    ctx->tmp_len = PAILLIER_N_MAX;
+    paillier_pack(&pl_pack, pl_slots, pl_pack.slots, ctx->tmp, &ctx->tmp_len);
+}
+
+static void run_paillier_unpack(BenchCtx *ctx, size_t size) {
+    paillier_unpack(&pl_pack, ctx->tmp, ctx->tmp_len, (uint64_t *) ctx->out, pl_pack.slots);
+}
+
+static const size_t BENCH_PL_SCALAR[] = {8, 256, 0};
+static const size_t BENCH_PL_BATCH[] = {8, 64, 0};
+static const size_t BENCH_PL_SUM[] = {16, BENCH_ITEMS, 0};
+static const size_t BENCH_PL_MULTI[] = {8, 64, 0};
+static const size_t BENCH_PL_BITS[] = {1024, 2048, 0};
+
+static const BenchCase BENCH_CASES[] = {
+    {"sha256", "bytes", BENCH_BULK, bench_fill, run_sha256, NULL},
+    {"sm3", "bytes", BENCH_BULK, bench_fill, run_sm3, NULL},
+    {"sm3_stream", "bytes", BENCH_BULK, bench_fill, run_sm3_stream, NULL},
+    {"keccak256", "bytes", BENCH_BULK, bench_fill, run_keccak256, NULL},
+    {"sm4_encrypt_into", "bytes", BENCH_BULK, bench_fill, run_sm4_encrypt_into, NULL},
+    {"sm4_encrypt", "bytes", BENCH_BULK, bench_fill, run_sm4_encrypt, NULL},
+    {"sm4_decrypt_into", "bytes", BENCH_BULK, prep_sm4_decrypt, run_sm4_decrypt_into, NULL},
+    {"sm4_decrypt", "bytes", BENCH_BULK, prep_sm4_decrypt, run_sm4_decrypt, NULL},
+    {"sm4_ctr_encrypt", "bytes", BENCH_BULK, bench_fill, run_sm4_ctr_encrypt, NULL},
+    {"sm4_ctr_decrypt", "bytes", BENCH_BULK, bench_fill, run_sm4_ctr_decrypt, NULL},
+    {"sm4_gcm_encrypt", "bytes", BENCH_BULK, bench_fill, run_sm4_gcm_encrypt, NULL},
+    {"sm4_gcm_decrypt", "bytes", BENCH_BULK, prep_sm4_gcm_decrypt, run_sm4_gcm_decrypt, NULL},
+    {"sm4_key_init", "bytes", BENCH_NONE, NULL, run_sm4_key_init, NULL},
+    {"sm4_key_encrypt_into", "bytes", BENCH_BULK, bench_fill, run_sm4_key_encrypt_into, NULL},
+    {"sm4_key_decrypt_into", "bytes", BENCH_BULK, prep_sm4_decrypt, run_sm4_key_decrypt_into, NULL},
+    {"sm4_key_ctr_encrypt", "bytes", BENCH_BULK, bench_fill, run_sm4_key_ctr_encrypt, NULL},
+    {"sm4_key_gcm_encrypt", "bytes", BENCH_BULK, bench_fill, run_sm4_key_gcm_encrypt, NULL},
+    {"sm4_key_gcm_decrypt", "bytes", BENCH_BULK, prep_sm4_gcm_decrypt, run_sm4_key_gcm_decrypt, NULL},
+    {"sm4_stream_gcm", "bytes", BENCH_BULK, bench_fill, run_sm4_stream_gcm, NULL},
+    {"sm4_stream_fd", "bytes", BENCH_BULK, prep_sm4_stream_fd, run_sm4_stream_fd, NULL},
+    {"secp256k1_key_gen", "bytes", BENCH_NONE, NULL, run_secp256k1_key_gen, NULL},
+    {"secp256k1_privateKey_to_publicKey", "bytes", BENCH_NONE, NULL, run_secp256k1_public_key, NULL},
+    {"secp256k1_sign", "bytes", BENCH_ONE, bench_fill, run_secp256k1_sign, NULL},
+    {"secp256k1_verify", "bytes", BENCH_ONE, prep_secp256k1_sig, run_secp256k1_verify, NULL},
+    {"secp256k1_recover_publicKey", "bytes", BENCH_ONE, prep_secp256k1_sig, run_secp256k1_recover, NULL},
+    {"sm2p256v1_key_gen", "bytes", BENCH_NONE, NULL, run_sm2_key_gen, NULL},
+    {"sm2p256v1_privateKey_to_publicKey", "bytes", BENCH_NONE, NULL, run_sm2_public_key, NULL},
+    {"sm2p256v1_sign", "bytes", BENCH_MSG, bench_fill, run_sm2_sign, NULL},
+    {"sm2p256v1_verify", "bytes", BENCH_MSG, prep_sm2_sig, run_sm2_verify, NULL},
+    {"sm2p256v1_encrypt_into", "bytes", BENCH_MSG, bench_fill, run_sm2_encrypt_into, NULL},
+    {"sm2p256v1_encrypt", "bytes", BENCH_MSG, bench_fill, run_sm2_encrypt, NULL},
+    {"sm2p256v1_decrypt_into", "bytes", BENCH_MSG, prep_sm2_decrypt, run_sm2_decrypt_into, NULL},
+    {"sm2p256v1_decrypt", "bytes", BENCH_MSG, prep_sm2_decrypt, run_sm2_decrypt, NULL},
+    {"sm2p256v1_stream_encrypt", "bytes", BENCH_BULK, bench_fill, run_sm2_stream_encrypt, NULL},
+    {"sm2p256v1_stream_decrypt", "bytes", BENCH_BULK, prep_sm2_decrypt, run_sm2_stream_decrypt, NULL},
+    {"sm2p256v1_exchange", "bytes", BENCH_NONE, NULL, run_sm2_exchange, NULL},
+    {"paillier_key_gen_bits", "bits", BENCH_PL_BITS, NULL, run_paillier_key_gen, NULL},
+    {"paillier_encrypt_into", "bytes", BENCH_NONE, prep_paillier, run_paillier_encrypt_into, NULL},
+    {"paillier_encrypt", "bytes", BENCH_NONE, prep_paillier, run_paillier_encrypt, NULL},
+    {"paillier_enc_ctx_encrypt_into", "bytes", BENCH_NONE, prep_paillier_enc_ctx, run_paillier_enc_ctx_encrypt_into, done_paillier_enc_ctx},
+    {"paillier_decrypt_into", "bytes", BENCH_NONE, prep_paillier, run_paillier_decrypt_into, NULL},
+    {"paillier_decrypt", "bytes", BENCH_NONE, prep_paillier, run_paillier_decrypt, NULL},
+    {"paillier_crt_decrypt_into", "bytes", BENCH_NONE, prep_paillier, run_paillier_crt_decrypt_into, NULL},
+    {"paillier_add_into", "bytes", BENCH_NONE, prep_paillier, run_paillier_add_into, NULL},
+    {"paillier_add", "bytes", BENCH_NONE, prep_paillier, run_paillier_add, NULL},
+    {"paillier_sub_into", "bytes", BENCH_NONE, prep_paillier, run_paillier_sub_into, NULL},
+    {"paillier_sub", "bytes", BENCH_NONE, prep_paillier, run_paillier_sub, NULL},
+    {"paillier_neg_into", "bytes", BENCH_NONE, prep_paillier, run_paillier_neg_into, NULL},
+    {"paillier_neg", "bytes", BENCH_NONE, prep_paillier, run_paillier_neg, NULL},
+    {"paillier_mul_into", "bytes", BENCH_PL_SCALAR, prep_paillier, run_paillier_mul_into, NULL},
+    {"paillier_mul", "bytes", BENCH_PL_SCALAR, prep_paillier, run_paillier_mul, NULL},
+    {"paillier_fixed_base_mul_into", "bytes", BENCH_PL_SCALAR, prep_paillier, run_paillier_fixed_base_mul_into, NULL},
+    {"paillier_encrypt_batch_into", "items", BENCH_PL_BATCH, prep_paillier, run_paillier_encrypt_batch_into, NULL},
+    {"paillier_decrypt_batch_into", "items", BENCH_PL_BATCH, prep_paillier, run_paillier_decrypt_batch_into, NULL},
+    {"paillier_sum_into", "items", BENCH_PL_SUM, prep_paillier, run_paillier_sum_into, NULL},
+    {"paillier_sum", "items", BENCH_PL_SUM, prep_paillier, run_paillier_sum, NULL},
+    {"paillier_weighted_sum_into", "items", BENCH_PL_SUM, prep_paillier, run_paillier_weighted_sum_into, NULL},
+    {"paillier_weighted_sum", "items", BENCH_PL_SUM, prep_paillier, run_paillier_weighted_sum, NULL},
+    {"paillier_multi_powm", "items", BENCH_PL_MULTI, prep_paillier, run_paillier_multi_powm, NULL},
+    {"paillier_encode_signed", "bytes", BENCH_NONE, prep_paillier, run_paillier_encode_signed, NULL},
+    {"paillier_decode_signed", "bytes", BENCH_NONE, prep_paillier_signed, run_paillier_decode_signed, NULL},
+    {"paillier_encode_fixed", "bytes", BENCH_NONE, prep_paillier, run_paillier_encode_fixed, NULL},
+    {"paillier_decode_fixed", "bytes", BENCH_NONE, prep_paillier_fixed, run_paillier_decode_fixed, NULL},
+    {"paillier_cipher_store", "bytes", BENCH_NONE, prep_paillier, run_paillier_cipher_store, NULL},
+    {"paillier_cipher_load", "bytes", BENCH_NONE, prep_paillier_record, run_paillier_cipher_load, NULL},
+    {"paillier_pack", "bytes", BENCH_NONE, prep_paillier, run_paillier_pack, NULL},
+    {"paillier_unpack", "bytes", BENCH_NONE, prep_paillier_unpack, run_paillier_unpack, NULL},
+};
+
+#define BENCH_CASE_COUNT (sizeof(BENCH_CASES) / sizeof(BENCH_CASES[0]))
+
+// ---- measurement ----
+
+static BenchCtx *bench_ctx_new() {
+    BenchCtx *ctx = calloc(1, sizeof(BenchCtx));
+    ctx->in = calloc(1, BENCH_MAX_SIZE + BENCH_SLACK);
+    ctx->out = calloc(1, BENCH_MAX_SIZE + BENCH_SLACK);
+    ctx->tmp = calloc(1, BENCH_MAX_SIZE + BENCH_SLACK);
+    mpz_init(ctx->powm);
+    return ctx;
+}
+
+static void bench_ctx_free(BenchCtx *ctx) {
+    bench_close_files(ctx);
+    free(ctx->in);
+    free(ctx->out);
+    free(ctx->tmp);
+    mpz_clear(ctx->powm);
+    free(ctx);
+}
+
+static int bench_cmp(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+static double bench_pct(const double *sorted, size_t n, double p) {
+    size_t i = (size_t) (p * (double) (n - 1) + 0.5);
+    return sorted[i < n ? i : n - 1];
+}
+
+static void bench_run(const BenchCase *bc, size_t size, BenchCtx *ctx, const BenchOpts *o, double *samples, size_t max_samples, BenchResult *r) {
+    uint64_t t0, now, warmup = (uint64_t) (o->warmup_ms * 1e6), per_rep = (uint64_t) (o->time_ms * 1e6 / o->reps);
+    uint64_t n = 0, batch;
+    size_t count = 0;
+
+    memset(r, 0, sizeof(BenchResult));
+    r->name = bc->name;
+    r->unit = bc->unit;
+    r->size = size;
+    r->reps = o->reps;
+
+    // warmup, at least one call, and the batch length
+    t0 = bench_ns();
+    do {
+        bc->run(ctx, size);
+        n++;
+        now = bench_ns();
+    } while(now - t0 < warmup);
+    batch = (now - t0) / n >= BENCH_SAMPLE_NS ? 1 : BENCH_SAMPLE_NS * n / (now - t0 + 1) + 1;
+
+    uint64_t total_ns = 0, total_cycles = 0;
+    for(int rep = 0; rep < o->reps; rep++) {
+        uint64_t rep_start = bench_ns(), rep_ops = 0, c0 = bench_cycles(), s, e;
+        do {
+            s = bench_ns();
+            for(uint64_t b = 0; b < batch; b++) {
+                bc->run(ctx, size);
+            }
+            e = bench_ns();
+            if(count < max_samples) {
+                samples[count++] = (double) (e - s) / (double) batch;
+            }
+            rep_ops += batch;
+        } while(e - rep_start < per_rep);
+        total_cycles += bench_cycles() - c0;
+        total_ns += e - rep_start;
+        r->ops += rep_ops;
+        r->rep_ops[rep] = (double) rep_ops * 1e9 / (double) (e - rep_start);
+    }
+
+    qsort(samples, count, sizeof(double), bench_cmp);
+    r->samples = count;
+    r->ns = (double) total_ns / (double) r->ops;
+    r->cycles = (double) total_cycles / (double) r->ops;
+    r->min = samples[0];
+    r->max = samples[count - 1];
+    r->p50 = bench_pct(samples, count, 0.50);
+    r->p90 = bench_pct(samples, count, 0.90);
+    r->p99 = bench_pct(samples, count, 0.99);
+}
+
+static void bench_print(const BenchResult *r) {
+    char size[32] = "";
+    double mbs = 0;
+    if(strcmp(r->unit, "bytes") || r->size != 1) {
+        snprintf(size, sizeof(size), "%lu %s", (unsigned long) r->size, r->unit);
+    }
+    if(!strcmp(r->unit, "bytes") && r->size > 1) {
+        mbs = (double) r->size * 1e3 / r->ns;
+    }
+    printf("%-36s %14s %14.1f %14.1f %12.0f %12.1f %12.1f %12.1f", r->name, size, 1e9 / r->ns, r->ns, r->cycles, r->p50, r->p90, r->p99);
+    if(mbs > 0) {
+        printf(" %10.1f", mbs);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+static void bench_json(FILE *f, const BenchResult *r) {
+    fprintf(f, "    {\"name\": \"%s\", \"unit\": \"%s\", \"size\": %lu, \"ops\": %llu, \"ops_per_sec\": %.3f, \"ns_per_op\": %.3f, "
+            "\"cycles_per_op\": %.1f, \"min_ns\": %.3f, \"p50_ns\": %.3f, \"p90_ns\": %.3f, \"p99_ns\": %.3f, \"max_ns\": %.3f, \"rep_ops_per_sec\": [",
+            r->name, r->unit, (unsigned long) r->size, (unsigned long long) r->ops, 1e9 / r->ns, r->ns, r->cycles,
+            r->min, r->p50, r->p90, r->p99, r->max);
+    for(int i = 0; i < r->reps; i++) {
+        fprintf(f, i ? ", %.3f" : "%.3f", r->rep_ops[i]);
+    }
+    fprintf(f, "]}");
+}
+
+// ---- thread scaling ----
+
+typedef struct BenchThread {
+    pthread_t tid;
+    const BenchCase *bc;
+    size_t size;
+    BenchCtx *ctx;
+    const BenchOpts *o;
+    double *samples;
+    size_t max_samples;
+    int cpu;
+    BenchResult r;
+} BenchThread;
+
+static pthread_mutex_t bench_gate_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bench_gate_cond = PTHREAD_COND_INITIALIZER;
+static int bench_gate_open = 0, bench_gate_waiting = 0;
+
+static void *bench_thread_run(void *arg) {
+    BenchThread *t = (BenchThread *) arg;
+    bench_pin(t->cpu);
+    // all threads start warming up together
+    pthread_mutex_lock(&bench_gate_lock);
+    bench_gate_waiting++;
+    pthread_cond_broadcast(&bench_gate_cond);
+    while(!bench_gate_open) {
+        pthread_cond_wait(&bench_gate_cond, &bench_gate_lock);
+    }
+    pthread_mutex_unlock(&bench_gate_lock);
+    bench_run(t->bc, t->size, t->ctx, t->o, t->samples, t->max_samples, &t->r);
+    archer_arena_free();
+    return NULL;
+}
+
+// 1, 2, 4 .. up to and including max
+static int bench_next_threads(int n, int max) {
+    return n >= max ? 0 : (n * 2 < max ? n * 2 : max);
+}
+
+static double bench_ops(const BenchResult *r) {
+    return 1e9 / r->ns;
+}
+
+static void bench_scale_json(FILE *f, const BenchThread *th, int n, double total, double base, const double *pooled, size_t count) {
+    const BenchResult *r = &th[0].r;
+    fprintf(f, "    {\"name\": \"%s\", \"unit\": \"%s\", \"size\": %lu, \"threads\": %d, \"ops_per_sec\": %.3f, \"speedup\": %.3f, "
+            "\"efficiency\": %.3f, \"p50_ns\": %.3f, \"p90_ns\": %.3f, \"p99_ns\": %.3f, \"max_ns\": %.3f, \"per_thread\": [",
+            r->name, r->unit, (unsigned long) r->size, n, total, total / base, total / base / n,
+            bench_pct(pooled, count, 0.50), bench_pct(pooled, count, 0.90), bench_pct(pooled, count, 0.99), pooled[count - 1]);
+    for(int i = 0; i < n; i++) {
+        fprintf(f, "%s{\"ops_per_sec\": %.3f, \"p50_ns\": %.3f, \"p99_ns\": %.3f}", i ? ", " : "",
+                bench_ops(&th[i].r), th[i].r.p50, th[i].r.p99);
+    }
+    fprintf(f, "]}");
+}
+
+/**
+ * one case and size from 1 to o->threads threads. speedup and efficiency are against the
+ * single thread run, latency percentiles are over the samples of all threads.
+*/
+static void bench_scale(const BenchCase *bc, size_t size, const BenchOpts *o, BenchCtx **ctxs, double *samples, FILE *json, int *first) {
+    BenchThread th[BENCH_MAX_THREADS];
+    size_t per = BENCH_MAX_SAMPLES / o->threads;
+    double base = 0;
+
+    for(int n = 1; n; n = bench_next_threads(n, o->threads)) {
+        for(int i = 0; i < n; i++) {
+            if(bc->prep) {
+                bc->prep(ctxs[i], size);
+            }
+            th[i].bc = bc;
+            th[i].size = size;
+            th[i].ctx = ctxs[i];
+            th[i].o = o;
+            th[i].samples = samples + i * per;
+            th[i].max_samples = per;
+            th[i].cpu = o->cpu < 0 ? -1 : o->cpu + i;
+        }
+        bench_gate_open = 0;
+        bench_gate_waiting = 0;
+        for(int i = 0; i < n; i++) {
+            pthread_create(&th[i].tid, NULL, bench_thread_run, &th[i]);
+        }
+        pthread_mutex_lock(&bench_gate_lock);
+        while(bench_gate_waiting < n) {
+            pthread_cond_wait(&bench_gate_cond, &bench_gate_lock);
+        }
+        bench_gate_open = 1;
+        pthread_cond_broadcast(&bench_gate_cond);
+        pthread_mutex_unlock(&bench_gate_lock);
+        for(int i = 0; i < n; i++) {
+            pthread_join(th[i].tid, NULL);
+        }
+
+        // pool the samples of all threads
+        double total = 0, lo = 0, hi = 0;
+        size_t count = 0;
+        for(int i = 0; i < n; i++) {
+            double ops = bench_ops(&th[i].r);
+            memmove(samples + count, th[i].samples, th[i].r.samples * sizeof(double));
+            count += th[i].r.samples;
+            total += ops;
+            lo = i && lo < ops ? lo : ops;
+            hi = hi > ops ? hi : ops;
+        }
+        qsort(samples, count, sizeof(double), bench_cmp);
+        if(n == 1) {
+            base = total;
+        }
+
+        char sz[32] = "";
+        if(strcmp(bc->unit, "bytes") || size != 1) {
+            snprintf(sz, sizeof(sz), "%lu %s", (unsigned long) size, bc->unit);
+        }
+        printf("%-36s %14s %8d %14.1f %8.2f %7.0f%% %12.1f %12.1f %12.1f %14.1f %14.1f\n", bc->name, sz, n, total, total / base,
+               100 * total / base / n, bench_pct(samples, count, 0.50), bench_pct(samples, count, 0.90), bench_pct(samples, count, 0.99), lo, hi);
+        fflush(stdout);
+        if(json) {
+            fprintf(json, *first ? "" : ",\n");
+            bench_scale_json(json, th, n, total, base, samples, count);
+            *first = 0;
+        }
+    }
+}
+
+// comma separated substrings of the case name, empty matches all
+static int bench_match(const char *filter, const char *name) {
+    if(!filter || !*filter) {
+        return 1;
+    }
+    const char *p = filter;
+    while(*p) {
+        const char *e = strchr(p, ',');
+        size_t l = e ? (size_t) (e - p) : strlen(p);
+        char part[128];
+        if(l && l < sizeof(part)) {
+            memcpy(part, p, l);
+            part[l] = 0;
+            if(strstr(name, part)) {
+                return 1;
+            }
+        }
+        if(!e) {
+            break;
+        }
+        p = e + 1;
+    }
+    return 0;
+}
+
+static void bench_usage() {
+    printf("usage: bench [options]\n"
+           "  -f a,b     run the cases whose name contains a or b\n"
+           "  -t ms      measuring time per case and size, default 300\n"
+           "  -w ms      warmup per case and size, default 100\n"
+           "  -r n       repetitions the measuring time is split into, default 3\n"
+           "  -c cpu     pin the benchmark thread to a cpu, with -p thread i to cpu + i\n"
+           "  -p n       run every case from 1, 2, 4 .. n threads, default filter " BENCH_SCALE_FILTER "\n"
+           "  -j file    write the results as json\n"
+           "  -l         list the cases\n");
+}
+
+int main(int argc, char **argv) {
+    BenchOpts o = {NULL, 300, 100, 3, -1, 0, NULL};
+    for(int i = 1; i < argc; i++) {
+        const char *a = argv[i], *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if(!strcmp(a, "-l")) {
+            for(size_t c = 0; c < BENCH_CASE_COUNT; c++) {
+                printf("%s\n", BENCH_CASES[c].name);
+            }
+            return 0;
+        } else if(!v || !strcmp(a, "-h")) {
+            bench_usage();
+            return strcmp(a, "-h") ? 1 : 0;
+        } else if(!strcmp(a, "-f")) {
+            o.filter = v;
+        } else if(!strcmp(a, "-t")) {
+            o.time_ms = atof(v);
+        } else if(!strcmp(a, "-w")) {
+            o.warmup_ms = atof(v);
+        } else if(!strcmp(a, "-r")) {
+            o.reps = atoi(v);
+        } else if(!strcmp(a, "-c")) {
+            o.cpu = atoi(v);
+        } else if(!strcmp(a, "-p")) {
+            o.threads = atoi(v);
+        } else if(!strcmp(a, "-j")) {
+            o.json = v;
+        } else {
+            bench_usage();
+            return 1;
+        }
+        i++;
+    }
+    if(o.reps < 1 || o.reps > BENCH_MAX_REPS || o.time_ms <= 0 || o.warmup_ms < 0 || o.threads < 0 || o.threads > BENCH_MAX_THREADS) {
+        bench_usage();
+        return 1;
+    }
+    if(o.threads && !o.filter) {
+        o.filter = BENCH_SCALE_FILTER;
+    }
+    if(!o.threads && !bench_pin(o.cpu)) {
+        fprintf(stderr, "cannot pin to cpu %d\n", o.cpu);
+        return 1;
+    }
+
+    FILE *json = NULL;
+    if(o.json && !(json = fopen(o.json, "w"))) {
+        fprintf(stderr, "cannot open %s\n", o.json);
+        return 1;
+    }
+    if(json) {
+        fprintf(json, "{\n  \"time_ms\": %.1f, \"warmup_ms\": %.1f, \"reps\": %d, \"cpu\": %d, \"threads\": %d, \"tsc\": %s,\n  \"results\": [\n",
+                o.time_ms, o.warmup_ms, o.reps, o.cpu, o.threads, bench_cycles() ? "true" : "false");
+    }
+
+    bench_fixtures();
+    BenchCtx *ctxs[BENCH_MAX_THREADS], *ctx;
+    int nctx = o.threads ? o.threads : 1;
+    for(int i = 0; i < nctx; i++) {
+        ctxs[i] = bench_ctx_new();
+    }
+    ctx = ctxs[0];
+    double *samples = malloc(BENCH_MAX_SAMPLES * sizeof(double));
+    if(o.threads) {
+        printf("%-36s %14s %8s %14s %8s %8s %12s %12s %12s %14s %14s\n", "case", "size", "threads", "ops/s", "speedup", "eff",
+               "p50 ns", "p90 ns", "p99 ns", "thread min/s", "thread max/s");
+    } else {
+        printf("%-36s %14s %14s %14s %12s %12s %12s %12s %10s\n", "case", "size", "ops/s", "ns/op", "cycles/op", "p50 ns", "p90 ns", "p99 ns", "MB/s");
+    }
+    int first = 1;
+    for(size_t c = 0; c < BENCH_CASE_COUNT; c++) {
+        const BenchCase *bc = &BENCH_CASES[c];
+        if(!bench_match(o.filter, bc->name)) {
+            continue;
+        }
+        for(const size_t *s = bc->sizes; *s; s++) {
+            BenchResult r;
+            if(o.threads) {
+                bench_scale(bc, *s, &o, ctxs, samples, json, &first);
+                continue;
+            }
+            if(bc->prep) {
+                bc->prep(ctx, *s);
+            }
+            bench_run(bc, *s, ctx, &o, samples, BENCH_MAX_SAMPLES, &r);
+            bench_print(&r);
+            if(json) {
+                fprintf(json, first ? "" : ",\n");
+                bench_json(json, &r);
+                first = 0;
+            }
+        }
+        if(bc->done) {
+            bc->done(ctx, 0);
+        }
+    }
+    if(json) {
+        fprintf(json, "\n  ]\n}\n");
+        fclose(json);
+    }
+
+    free(samples);
+    for(int i = 0; i < nctx; i++) {
+        bench_ctx_free(ctxs[i]);
+    }
+    archer_arena_free();
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include "ec_point.h"
+#include "arena.h"
 
 void ec_point_mul(mpz_t x, mpz_t y, mpz_t d, mpz_t p, mpz_t a, mpz_t b, mpz_t gx, mpz_t gy) {
     // char *bits = mpz_get_str(NULL, 2, d);
@@ -6,11 +7,10 @@ void ec_point_mul(mpz_t x, mpz_t y, mpz_t d, mpz_t p, mpz_t a, mpz_t b, mpz_t gx
 
     uint32_t len = mpz_sizeinbase(d, 2);
 
-    mpz_t inv, k, tx, ty;
-    mpz_init(inv);
-    mpz_init(k);
-    mpz_init_set(tx, gx);
-    mpz_init_set(ty, gy);
+    size_t mark = arena_mark();
+    mpz_ptr inv = arena_mpz(), k = arena_mpz(), tx = arena_mpz(), ty = arena_mpz();
+    mpz_set(tx, gx);
+    mpz_set(ty, gy);
     // for(int i = 1; i < len; i++) {
     
     for(int i = len - 2; i >= 0; --i) {
@@ -60,16 +60,12 @@ void ec_point_mul(mpz_t x, mpz_t y, mpz_t d, mpz_t p, mpz_t a, mpz_t b, mpz_t gx
             mpz_set(ty, y);
         }
     }
-    mpz_clear(inv);
-    mpz_clear(k);
-    mpz_clear(tx);
-    mpz_clear(ty);
+    arena_release(mark);
 }
 
 void ec_point_add(mpz_t x, mpz_t y, mpz_t x1, mpz_t y1, mpz_t x2, mpz_t y2, mpz_t p) {
-    mpz_t t, k;
-    mpz_init(t);
-    mpz_init(k);
+    size_t mark = arena_mark();
+    mpz_ptr t = arena_mpz(), k = arena_mpz();
 
     mpz_sub(t, x1, x2);
     mpz_invert(t, t, p);
@@ -87,8 +83,7 @@ void ec_point_add(mpz_t x, mpz_t y, mpz_t x1, mpz_t y1, mpz_t x2, mpz_t y2, mpz_
     mpz_sub(y, y, y1);
     mpz_mod(y, y, p);
 
-    mpz_clear(k);
-    mpz_clear(t);
+    arena_release(mark);
 }
 
 void ec_random_k(uint8_t *k, uint16_t seed) {
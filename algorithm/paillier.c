@@ -1,67 +1,202 @@
 #include "paillier.h"
+#include "arena.h"
+#include "paillier_simd.h"
 
-static void paillier_prime_random(mpz_t p, int bits) {
-    uint32_t seed = (uint64_t) p;
-    gmp_randstate_t grt;
-    gmp_randinit_default(grt);
-    gmp_randseed_ui(grt, seed);
-    mpz_urandomb(p, grt, bits);
-    while (!mpz_probab_prime_p(p, 25)) {
-        mpz_urandomb(p, grt, bits);
+#include <math.h>
+#include <pthread.h>
+
+#define PAILLIER_SEED_BYTES 32
+
+// gmp state seeded with PAILLIER_SEED_BYTES of os entropy
+static int paillier_seed(gmp_randstate_t rand) {
+    uint8_t buf[PAILLIER_SEED_BYTES];
+    mpz_t s;
+    if(!archer_entropy(buf, sizeof(buf))) {
+        return 0;
     }
-    gmp_randclear(grt);
+    mpz_init(s);
+    mpz_import(s, sizeof(buf), 1, 1, 0, 0, buf);
+    gmp_randseed(rand, s);
+    mpz_clear(s);
+    memset(buf, 0, sizeof(buf));
+    return 1;
 }
 
-static void paillier_random(mpz_t p, int bits) {
-    uint32_t seed = (uint64_t) p;
-    gmp_randstate_t grt;
-    gmp_randinit_default(grt);
-    gmp_randseed_ui(grt, seed);
-    mpz_urandomb(p, grt, bits);
-    gmp_randclear(grt);
+// uniform in [0, 2^bits), bits <= 8 * PAILLIER_N_MAX, straight from the os
+static int paillier_random(mpz_t p, int bits) {
+    uint8_t buf[PAILLIER_N_MAX];
+    size_t len = ((size_t) bits + 7) / 8;
+    if(!archer_entropy(buf, len)) {
+        return 0;
+    }
+    mpz_import(p, len, 1, 1, 0, 0, buf);
+    mpz_tdiv_r_2exp(p, p, bits);
+    memset(buf, 0, len);
+    return 1;
 }
 
-void paillier_key_gen(PaillierPrivateKey *sk, PaillierPublicKey *pk) {
-    mpz_t p, q, n, l;
-    mpz_init(p);
-    mpz_init(q);
+// significant bytes of a fixed size big endian number
+static size_t paillier_bytes(const uint8_t *v, const size_t size) {
+    size_t i = 0;
+    while(i < size && !v[i]) {
+        i++;
+    }
+    return size - i;
+}
+
+static int paillier_check_out(uint8_t *out, size_t *out_len, size_t need) {
+    if(!out_len) {
+        return 0;
+    }
+    if(!out || *out_len < need) {
+        *out_len = need;
+        return 0;
+    }
+    return 1;
+}
+
+// fixed size big endian, zero padded on the left
+static void paillier_export(uint8_t *out, const size_t size, const mpz_t v) {
+    size_t l = 0;
+    memset(out, 0, size);
+    if(mpz_sgn(v)) {
+        mpz_export(out + (size - (mpz_sizeinbase(v, 2) + 7) / 8), &l, 1, 1, 0, 0, v);
+    }
+}
+
+// odd primes below PAILLIER_SIEVE_LIMIT
+#define PAILLIER_SIEVE_LIMIT 8192
+#define PAILLIER_SIEVE_SIZE  1027
+
+static size_t paillier_small_primes(uint16_t primes[PAILLIER_SIEVE_SIZE]) {
+    uint8_t composite[PAILLIER_SIEVE_LIMIT] = {0};
+    size_t count = 0;
+    for(uint32_t i = 3; i < PAILLIER_SIEVE_LIMIT; i += 2) {
+        if(composite[i]) {
+            continue;
+        }
+        primes[count++] = i;
+        for(uint32_t j = i * i; j < PAILLIER_SIEVE_LIMIT; j += 2 * i) {
+            composite[j] = 1;
+        }
+    }
+    return count;
+}
+
+typedef struct PaillierPrimeJob {
+    mpz_t p;
+    int bits;
+    gmp_randstate_t rand;
+} PaillierPrimeJob;
+
+/**
+ * random prime of exactly bits bits with the top two bits set, so two of them
+ * multiply to a 2 * bits modulus. candidates walk up in steps of 2 from a random
+ * odd start, their residues modulo the small primes are updated by addition and
+ * only numbers without a small factor reach mpz_probab_prime_p.
+*/
+static void *paillier_prime_run(void *arg) {
+    PaillierPrimeJob *job = (PaillierPrimeJob *) arg;
+    uint16_t primes[PAILLIER_SIEVE_SIZE], mods[PAILLIER_SIEVE_SIZE];
+    size_t count = paillier_small_primes(primes);
+
+    for(;;) {
+        mpz_urandomb(job->p, job->rand, job->bits);
+        mpz_setbit(job->p, job->bits - 1);
+        mpz_setbit(job->p, job->bits - 2);
+        mpz_setbit(job->p, 0);
+        for(size_t i = 0; i < count; i++) {
+            mods[i] = mpz_fdiv_ui(job->p, primes[i]);
+        }
+        for(unsigned long delta = 0; delta < (1ul << 20); delta += 2) {
+            size_t i = 0;
+            while(i < count && (mods[i] + delta) % primes[i]) {
+                i++;
+            }
+            if(i < count) {
+                continue;
+            }
+            mpz_add_ui(job->p, job->p, delta);
+            if(mpz_sizeinbase(job->p, 2) == (size_t) job->bits && mpz_probab_prime_p(job->p, 25)) {
+                return NULL;
+            }
+            mpz_sub_ui(job->p, job->p, delta);
+        }
+    }
+}
+
+int paillier_key_gen_bits(PaillierPrivateKey *sk, PaillierPublicKey *pk, const int bits) {
+    if(!sk || !pk || bits < 1024 || bits > PAILLIER_N_MAX * 8 || bits % 64) {
+        return 0;
+    }
+    PaillierPrimeJob jobs[2];
+    mpz_t n, l;
+    pthread_t tid;
+    int seeded = 1;
+
+    // p and q are searched at the same time, each from its own os seeded state
+    for(int i = 0; i < 2; i++) {
+        mpz_init(jobs[i].p);
+        jobs[i].bits = bits / 2;
+        gmp_randinit_default(jobs[i].rand);
+        seeded &= paillier_seed(jobs[i].rand);
+    }
+    if(!seeded) {
+        for(int i = 0; i < 2; i++) {
+            mpz_clear(jobs[i].p);
+            gmp_randclear(jobs[i].rand);
+        }
+        return 0;
+    }
     mpz_init(n);
     mpz_init(l);
-
-    paillier_prime_random(p, P_SIZE * 8);
-    paillier_prime_random(q, P_SIZE * 8);
+    int started = !pthread_create(&tid, NULL, paillier_prime_run, &jobs[1]);
+    paillier_prime_run(&jobs[0]);
+    if(started) {
+        pthread_join(tid, NULL);
+    } else {
+        paillier_prime_run(&jobs[1]);
+    }
+    while(!mpz_cmp(jobs[0].p, jobs[1].p)) {
+        paillier_prime_run(&jobs[1]);
+    }
+    mpz_ptr p = jobs[0].p, q = jobs[1].p;
 
     mpz_mul(n, p, q);
+    paillier_export(sk->p, P_SIZE, p);
+    paillier_export(sk->q, P_SIZE, q);
     mpz_sub_ui(p, p, 1);
     mpz_sub_ui(q, q, 1);
     mpz_lcm(l, p, q);
 
-    
-    size_t ln = N_SIZE, ll = N_SIZE;
-    uint8_t nc[N_SIZE], lc[N_SIZE];
-    mpz_export(nc, &ln, 1, 1, 0, 0, n);
-    mpz_export(lc, &ll, 1, 1, 0, 0, l);
-
-    
-    memcpy(sk->l + (N_SIZE - ll), lc, ll);
-    memcpy(sk->n + (N_SIZE - ln), nc, ln);
-    
-    memcpy(pk->n, &(nc[N_SIZE-ln]), ln);
+    paillier_export(sk->n, N_SIZE, n);
+    paillier_export(sk->l, N_SIZE, l);
+    paillier_export(pk->n, N_SIZE, n);
 
     mpz_clear(p);
     mpz_clear(q);
+    gmp_randclear(jobs[0].rand);
+    gmp_randclear(jobs[1].rand);
     mpz_clear(n);
     mpz_clear(l);
+    return 1;
 }
 
-void paillier_encrypt(const PaillierPublicKey *pk, const uint8_t *msg, const size_t msg_len, uint8_t **cipher, size_t *cipher_len) {    
-    mpz_t r, m, n, mn, rl;
-    mpz_init(r);
-    mpz_init(m);
-    mpz_init(n);
-    mpz_init(mn);
-    mpz_init(rl);
-    paillier_random(r, P_SIZE);
+void paillier_key_gen(PaillierPrivateKey *sk, PaillierPublicKey *pk) {
+    paillier_key_gen_bits(sk, pk, PAILLIER_DEFAULT_BITS);
+}
+
+int paillier_encrypt_into(const PaillierPublicKey *pk, const uint8_t *msg, const size_t msg_len, uint8_t *cipher, size_t *cipher_len) {    
+    size_t nb = paillier_bytes(pk->n, N_SIZE);
+    if(!paillier_check_out(cipher, cipher_len, nb + nb)) {
+        return 0;
+    }
+    size_t mark = arena_mark();
+    mpz_ptr r = arena_mpz(), m = arena_mpz(), n = arena_mpz(), mn = arena_mpz(), rl = arena_mpz(), n2 = arena_mpz();
+    if(!paillier_random(r, nb * 8 - 1)) {
+        arena_release(mark);
+        return 0;
+    }
 
     mpz_import(m, msg_len, 1, 1, 0, 0, msg);
     mpz_import(n, N_SIZE, 1, 1, 0, 0, pk->n);
@@ -73,35 +208,114 @@ void paillier_encrypt(const PaillierPublicKey *pk, const uint8_t *msg, const siz
     mpz_mul(mn, m, n);
     mpz_add_ui(mn, mn, 1);
 
-    mpz_mul(rl, n, n);
-    mpz_powm(rl, r, n, rl);
+    mpz_mul(n2, n, n);
+    mpz_powm(rl, r, n, n2);
 
     mpz_mul(mn, mn, rl);
-    mpz_mul(rl, n, n);
-    mpz_mod(mn, mn, rl);
+    mpz_mod(mn, mn, n2);
     
-    size_t lc = N_SIZE + N_SIZE;
-    uint8_t c[N_SIZE + N_SIZE];
-    mpz_export(c, &lc, 1, 1, 0, 0, mn);
-    (*cipher) = (uint8_t *)malloc(lc);
-    (*cipher_len) = lc;
-    memcpy((*cipher), c, lc);
+    *cipher_len = nb + nb;
+    paillier_export(cipher, *cipher_len, mn);
 
-    mpz_clear(r);
-    mpz_clear(n);
-    mpz_clear(m);
-    mpz_clear(mn);
-    mpz_clear(rl);
+    arena_release(mark);
+    return 1;
 }
 
-void paillier_decrypt(const PaillierPrivateKey *sk, const uint8_t *cipher, const size_t cipher_len, uint8_t **msg, size_t *msg_len) {
-    mpz_t l, n, c, t, u;
-    mpz_init(l);
-    mpz_init(n);
-    mpz_init(c);
-    mpz_init(t);
-    mpz_init(u);
+void paillier_encrypt(const PaillierPublicKey *pk, const uint8_t *msg, const size_t msg_len, uint8_t **cipher, size_t *cipher_len) {
+    *cipher_len = 2 * paillier_bytes(pk->n, N_SIZE);
+    *cipher = (uint8_t *)archer_malloc(*cipher_len);
+    if(!paillier_encrypt_into(pk, msg, msg_len, *cipher, cipher_len)) {
+        archer_free(*cipher);
+        *cipher = NULL;
+        *cipher_len = 0;
+    }
+}
+
+/**
+ * h = L_p(g^(p-1) mod p^2)^-1 mod p, which for g = n + 1 is -q^-1 mod p,
+ * so hp = p - qinv and hq = q - pinv.
+ * m = L_p(c^(p-1) mod p^2) * hp mod p, two exponents of half the size over p^2 instead of n^2.
+*/
+// out = L_p(x) * h mod p for x = c^(p-1) mod p^2
+static void paillier_crt_finish(mpz_t out, const mpz_t x, const mpz_t p, const mpz_t h) {
+    mpz_sub_ui(out, x, 1);
+    mpz_divexact(out, out, p);
+    mpz_mul(out, out, h);
+    mpz_mod(out, out, p);
+}
+
+static void paillier_crt_half(mpz_t out, const mpz_t c, const mpz_t p, const mpz_t p2, const mpz_t h, mpz_t t) {
+    mpz_sub_ui(t, p, 1);
+    mpz_mod(out, c, p2);
+    mpz_powm(out, out, t, p2);
+    paillier_crt_finish(out, out, p, h);
+}
+
+// m = mq + q * ((mp - mq) * qinv mod p), m holds mp
+static void paillier_crt_join(mpz_t m, const mpz_t mq, const mpz_t p, const mpz_t q, const mpz_t qinv) {
+    mpz_sub(m, m, mq);
+    mpz_mul(m, m, qinv);
+    mpz_mod(m, m, p);
+    mpz_mul(m, m, q);
+    mpz_add(m, m, mq);
+}
+
+static void paillier_crt(mpz_t m, const mpz_t c, const mpz_t p, const mpz_t q, const mpz_t p2, const mpz_t q2, 
+                    const mpz_t hp, const mpz_t hq, const mpz_t qinv, mpz_t mq, mpz_t t) {
+    paillier_crt_half(m, c, p, p2, hp, t);
+    paillier_crt_half(mq, c, q, q2, hq, t);
+    paillier_crt_join(m, mq, p, q, qinv);
+}
+
+/**
+ * the crt values of the last key paillier_decrypt_into saw on this thread, so a run of
+ * decryptions under one key derives p^2, q^2 and the inverses only once.
+*/
+typedef struct PaillierCrtCache {
+    int ready;
+    uint8_t p[P_SIZE], q[P_SIZE];
+    PaillierCrtKey key;
+} PaillierCrtCache;
+
+static ARCHER_TLS PaillierCrtCache paillier_crt_cache;
+static pthread_once_t paillier_crt_once = PTHREAD_ONCE_INIT;
+
+static void paillier_crt_cache_clear() {
+    if(paillier_crt_cache.ready) {
+        paillier_crt_key_clear(&paillier_crt_cache.key);
+        memset(&paillier_crt_cache, 0, sizeof(paillier_crt_cache));
+    }
+}
 
+static void paillier_crt_cache_register() {
+    arena_on_free(paillier_crt_cache_clear);
+}
+
+static const PaillierCrtKey *paillier_crt_cached(const PaillierPrivateKey *sk) {
+    PaillierCrtCache *cache = &paillier_crt_cache;
+    if(cache->ready && !memcmp(cache->p, sk->p, P_SIZE) && !memcmp(cache->q, sk->q, P_SIZE)) {
+        return &cache->key;
+    }
+    pthread_once(&paillier_crt_once, paillier_crt_cache_register);
+    paillier_crt_cache_clear();
+    paillier_crt_key_init(&cache->key, sk);
+    memcpy(cache->p, sk->p, P_SIZE);
+    memcpy(cache->q, sk->q, P_SIZE);
+    cache->ready = 1;
+    return &cache->key;
+}
+
+int paillier_decrypt_into(const PaillierPrivateKey *sk, const uint8_t *cipher, const size_t cipher_len, uint8_t *msg, size_t *msg_len) {
+    if(!paillier_check_out(msg, msg_len, paillier_bytes(sk->n, N_SIZE))) {
+        return 0;
+    }
+    if(paillier_bytes(sk->p, P_SIZE) && paillier_bytes(sk->q, P_SIZE)) {
+        return paillier_crt_decrypt_into(paillier_crt_cached(sk), cipher, cipher_len, msg, msg_len);
+    }
+
+    // keys without p and q
+    size_t mark = arena_mark();
+    mpz_ptr l = arena_mpz(), n = arena_mpz(), c = arena_mpz(), t = arena_mpz(), u = arena_mpz();
     mpz_import(c, cipher_len, 1, 1, 0, 0, cipher);
     mpz_import(n, N_SIZE, 1, 1, 0, 0, sk->n);
     mpz_import(l, N_SIZE, 1, 1, 0, 0, sk->l);
@@ -121,25 +335,25 @@ void paillier_decrypt(const PaillierPrivateKey *sk, const uint8_t *cipher, const
 
     mpz_mod(t, t, n);
     
-    size_t mc = N_SIZE;
-    uint8_t m[N_SIZE];
-    mpz_export(m, &mc, 1, 1, 0, 0, t);
-    (*msg) = (uint8_t *)malloc(mc);
-    *msg_len = mc;
-    memcpy(*msg, m, mc);
+    mpz_export(msg, msg_len, 1, 1, 0, 0, t);
 
-    mpz_clear(l);
-    mpz_clear(n);
-    mpz_clear(c);
-    mpz_clear(t);
-    mpz_clear(u);
+    arena_release(mark);
+    return 1;
 }
 
-void paillier_add(const PaillierPublicKey *pk, const uint8_t *cipher0, const size_t cipher0_len, const uint8_t *cipher1, const size_t cipher1_len, uint8_t **cipher, size_t *cipher_len) {
-    mpz_t c0, c1, n;
-    mpz_init(c0);
-    mpz_init(c1);
-    mpz_init(n);
+void paillier_decrypt(const PaillierPrivateKey *sk, const uint8_t *cipher, const size_t cipher_len, uint8_t **msg, size_t *msg_len) {
+    *msg_len = paillier_bytes(sk->n, N_SIZE);
+    *msg = (uint8_t *)archer_malloc(*msg_len);
+    paillier_decrypt_into(sk, cipher, cipher_len, *msg, msg_len);
+}
+
+int paillier_add_into(const PaillierPublicKey *pk, const uint8_t *cipher0, const size_t cipher0_len, const uint8_t *cipher1, const size_t cipher1_len, uint8_t *cipher, size_t *cipher_len) {
+    size_t nb = paillier_bytes(pk->n, N_SIZE);
+    if(!paillier_check_out(cipher, cipher_len, nb + nb)) {
+        return 0;
+    }
+    size_t mark = arena_mark();
+    mpz_ptr c0 = arena_mpz(), c1 = arena_mpz(), n = arena_mpz();
 
     mpz_import(c0, cipher0_len, 1, 1, 0, 0, cipher0);
     mpz_import(c1, cipher1_len, 1, 1, 0, 0, cipher1);
@@ -153,23 +367,26 @@ void paillier_add(const PaillierPublicKey *pk, const uint8_t *cipher0, const siz
 
     // printf("add enc = %s\n", mpz_get_str(NULL, 10, c0));
 
-    size_t mc = N_SIZE + N_SIZE;
-    uint8_t m[N_SIZE + N_SIZE];
-    mpz_export(m, &mc, 1, 1, 0, 0, c0);
-    (*cipher) = (uint8_t *)malloc(mc);
-    *cipher_len = mc;
-    memcpy(*cipher, m, mc);
+    *cipher_len = nb + nb;
+    paillier_export(cipher, *cipher_len, c0);
 
-    mpz_clear(c0);
-    mpz_clear(c1);
-    mpz_clear(n);
+    arena_release(mark);
+    return 1;
 }
 
-void paillier_mul(const PaillierPublicKey *pk, const uint8_t *cipher_in, const size_t cipher_in_len, const uint8_t *msg, const size_t msg_len, uint8_t **cipher, size_t *cipher_len) {
-    mpz_t c, m, n;
-    mpz_init(c);
-    mpz_init(m);
-    mpz_init(n);
+void paillier_add(const PaillierPublicKey *pk, const uint8_t *cipher0, const size_t cipher0_len, const uint8_t *cipher1, const size_t cipher1_len, uint8_t **cipher, size_t *cipher_len) {
+    *cipher_len = 2 * paillier_bytes(pk->n, N_SIZE);
+    *cipher = (uint8_t *)archer_malloc(*cipher_len);
+    paillier_add_into(pk, cipher0, cipher0_len, cipher1, cipher1_len, *cipher, cipher_len);
+}
+
+int paillier_mul_into(const PaillierPublicKey *pk, const uint8_t *cipher_in, const size_t cipher_in_len, const uint8_t *msg, const size_t msg_len, uint8_t *cipher, size_t *cipher_len) {
+    size_t nb = paillier_bytes(pk->n, N_SIZE);
+    if(!paillier_check_out(cipher, cipher_len, nb + nb)) {
+        return 0;
+    }
+    size_t mark = arena_mark();
+    mpz_ptr c = arena_mpz(), m = arena_mpz(), n = arena_mpz();
 
     mpz_import(c, cipher_in_len, 1, 1, 0, 0, cipher_in);
     mpz_import(m, msg_len, 1, 1, 0, 0, msg);
@@ -178,14 +395,1083 @@ void paillier_mul(const PaillierPublicKey *pk, const uint8_t *cipher_in, const s
     mpz_mul(n, n, n);
     mpz_powm(c, c, m, n);
     
-    size_t mc = N_SIZE + N_SIZE;
-    uint8_t c_out[N_SIZE + N_SIZE];
-    mpz_export(c_out, &mc, 1, 1, 0, 0, c);
-    (*cipher) = (uint8_t *)malloc(mc);
-    *cipher_len = mc;
-    memcpy(*cipher, c_out, mc);
+    *cipher_len = nb + nb;
+    paillier_export(cipher, *cipher_len, c);
+
+    arena_release(mark);
+    return 1;
+}
+
+void paillier_mul(const PaillierPublicKey *pk, const uint8_t *cipher_in, const size_t cipher_in_len, const uint8_t *msg, const size_t msg_len, uint8_t **cipher, size_t *cipher_len) {
+    *cipher_len = 2 * paillier_bytes(pk->n, N_SIZE);
+    *cipher = (uint8_t *)archer_malloc(*cipher_len);
+    paillier_mul_into(pk, cipher_in, cipher_in_len, msg, msg_len, *cipher, cipher_len);
+}
+
+int paillier_neg_into(const PaillierPublicKey *pk, const uint8_t *cipher_in, const size_t cipher_in_len, uint8_t *cipher, size_t *cipher_len) {
+    size_t nb = paillier_bytes(pk->n, N_SIZE);
+    if(!paillier_check_out(cipher, cipher_len, nb + nb)) {
+        return 0;
+    }
+    size_t mark = arena_mark();
+    mpz_ptr c = arena_mpz(), n = arena_mpz();
+
+    mpz_import(c, cipher_in_len, 1, 1, 0, 0, cipher_in);
+    mpz_import(n, N_SIZE, 1, 1, 0, 0, pk->n);
+
+    // E(m)^-1 = E(-m)
+    mpz_mul(n, n, n);
+    int ok = mpz_invert(c, c, n);
+    if(ok) {
+        *cipher_len = nb + nb;
+        paillier_export(cipher, *cipher_len, c);
+    }
+
+    arena_release(mark);
+    return ok;
+}
+
+void paillier_neg(const PaillierPublicKey *pk, const uint8_t *cipher_in, const size_t cipher_in_len, uint8_t **cipher, size_t *cipher_len) {
+    *cipher_len = 2 * paillier_bytes(pk->n, N_SIZE);
+    *cipher = (uint8_t *)archer_malloc(*cipher_len);
+    paillier_neg_into(pk, cipher_in, cipher_in_len, *cipher, cipher_len);
+}
+
+int paillier_sub_into(const PaillierPublicKey *pk, const uint8_t *cipher0, const size_t cipher0_len, const uint8_t *cipher1, const size_t cipher1_len, uint8_t *cipher, size_t *cipher_len) {
+    size_t nb = paillier_bytes(pk->n, N_SIZE);
+    if(!paillier_check_out(cipher, cipher_len, nb + nb)) {
+        return 0;
+    }
+    size_t mark = arena_mark();
+    mpz_ptr c0 = arena_mpz(), c1 = arena_mpz(), n = arena_mpz();
+
+    mpz_import(c0, cipher0_len, 1, 1, 0, 0, cipher0);
+    mpz_import(c1, cipher1_len, 1, 1, 0, 0, cipher1);
+    mpz_import(n, N_SIZE, 1, 1, 0, 0, pk->n);
+
+    mpz_mul(n, n, n);
+    int ok = mpz_invert(c1, c1, n);
+    if(ok) {
+        mpz_mul(c0, c0, c1);
+        mpz_mod(c0, c0, n);
+        *cipher_len = nb + nb;
+        paillier_export(cipher, *cipher_len, c0);
+    }
+
+    arena_release(mark);
+    return ok;
+}
+
+void paillier_sub(const PaillierPublicKey *pk, const uint8_t *cipher0, const size_t cipher0_len, const uint8_t *cipher1, const size_t cipher1_len, uint8_t **cipher, size_t *cipher_len) {
+    *cipher_len = 2 * paillier_bytes(pk->n, N_SIZE);
+    *cipher = (uint8_t *)archer_malloc(*cipher_len);
+    paillier_sub_into(pk, cipher0, cipher0_len, cipher1, cipher1_len, *cipher, cipher_len);
+}
+
+void paillier_crt_key_init(PaillierCrtKey *key, const PaillierPrivateKey *sk) {
+    mpz_inits(key->n, key->n2, key->p, key->q, key->p2, key->q2, key->hp, key->hq, key->qinv, key->l, key->mu, NULL);
+    mpz_import(key->n, N_SIZE, 1, 1, 0, 0, sk->n);
+    mpz_import(key->l, N_SIZE, 1, 1, 0, 0, sk->l);
+    mpz_import(key->p, P_SIZE, 1, 1, 0, 0, sk->p);
+    mpz_import(key->q, P_SIZE, 1, 1, 0, 0, sk->q);
+    mpz_mul(key->n2, key->n, key->n);
+    mpz_invert(key->mu, key->l, key->n);
+
+    key->crt = mpz_sgn(key->p) && mpz_sgn(key->q);
+    if(key->crt) {
+        mpz_mul(key->p2, key->p, key->p);
+        mpz_mul(key->q2, key->q, key->q);
+        mpz_invert(key->qinv, key->q, key->p);
+        mpz_sub(key->hp, key->p, key->qinv);
+        mpz_invert(key->hq, key->p, key->q);
+        mpz_sub(key->hq, key->q, key->hq);
+    }
+}
+
+void paillier_crt_key_clear(PaillierCrtKey *key) {
+    mpz_clears(key->n, key->n2, key->p, key->q, key->p2, key->q2, key->hp, key->hq, key->qinv, key->l, key->mu, NULL);
+}
+
+int paillier_crt_decrypt_into(const PaillierCrtKey *key, const uint8_t *cipher, const size_t cipher_len, uint8_t *msg, size_t *msg_len) {
+    if(!paillier_check_out(msg, msg_len, (mpz_sizeinbase(key->n, 2) + 7) / 8)) {
+        return 0;
+    }
+    size_t mark = arena_mark();
+    mpz_ptr c = arena_mpz(), m = arena_mpz(), t = arena_mpz(), u = arena_mpz();
+    mpz_import(c, cipher_len, 1, 1, 0, 0, cipher);
+
+    if(key->crt) {
+        paillier_crt(m, c, key->p, key->q, key->p2, key->q2, key->hp, key->hq, key->qinv, t, u);
+    } else {
+        mpz_powm(m, c, key->l, key->n2);
+        mpz_sub_ui(m, m, 1);
+        mpz_divexact(m, m, key->n);
+        mpz_mul(m, m, key->mu);
+        mpz_mod(m, m, key->n);
+    }
+    mpz_export(msg, msg_len, 1, 1, 0, 0, m);
+
+    arena_release(mark);
+    return 1;
+}
+
+
+struct PaillierEncCtx {
+    mpz_t n, n2;
+    gmp_randstate_t rand;
+    // ring of r^n mod n^2, count values from head
+    mpz_t *pool;
+    size_t cap, head, count;
+    pthread_mutex_t lock;
+    pthread_cond_t room;
+    int stop;
+    int threads;
+    pthread_t tid[PAILLIER_MAX_THREADS];
+};
+
+// r^n mod n^2 for a fresh r in [0, n)
+static void paillier_ctx_rn(PaillierEncCtx *ctx, mpz_t rn, gmp_randstate_t rand) {
+    mpz_urandomm(rn, rand, ctx->n);
+    mpz_powm(rn, rn, ctx->n, ctx->n2);
+}
+
+// hand over v (swapped, v gets the old slot value), 0 when the pool is full
+static int paillier_ctx_push(PaillierEncCtx *ctx, mpz_t v) {
+    if(ctx->count == ctx->cap) {
+        return 0;
+    }
+    mpz_swap(ctx->pool[(ctx->head + ctx->count) % ctx->cap], v);
+    ctx->count++;
+    return 1;
+}
+
+static void *paillier_ctx_worker(void *arg) {
+    PaillierEncCtx *ctx = (PaillierEncCtx *) arg;
+    gmp_randstate_t rand;
+    mpz_t rn;
+    mpz_init(rn);
+
+    // without its own seed the worker leaves the pool to paillier_enc_ctx_fill and inline draws
+    gmp_randinit_default(rand);
+    int seeded = paillier_seed(rand);
+    pthread_mutex_lock(&ctx->lock);
+    while(seeded && !ctx->stop) {
+        if(ctx->count == ctx->cap) {
+            pthread_cond_wait(&ctx->room, &ctx->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&ctx->lock);
+        paillier_ctx_rn(ctx, rn, rand);
+        pthread_mutex_lock(&ctx->lock);
+        paillier_ctx_push(ctx, rn);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    gmp_randclear(rand);
+    mpz_clear(rn);
+    return NULL;
+}
+
+PaillierEncCtx *paillier_enc_ctx_new(const PaillierPublicKey *pk, const size_t pool_size, const int threads) {
+    PaillierEncCtx *ctx = (PaillierEncCtx *) malloc(sizeof(PaillierEncCtx));
+    if(!ctx) {
+        return NULL;
+    }
+    mpz_init(ctx->n);
+    mpz_init(ctx->n2);
+    mpz_import(ctx->n, N_SIZE, 1, 1, 0, 0, pk->n);
+    mpz_mul(ctx->n2, ctx->n, ctx->n);
+    gmp_randinit_default(ctx->rand);
+    if(!paillier_seed(ctx->rand)) {
+        gmp_randclear(ctx->rand);
+        mpz_clear(ctx->n);
+        mpz_clear(ctx->n2);
+        free(ctx);
+        return NULL;
+    }
+
+    ctx->head = ctx->count = 0;
+    ctx->pool = pool_size ? (mpz_t *) malloc(pool_size * sizeof(mpz_t)) : NULL;
+    ctx->cap = ctx->pool ? pool_size : 0;
+    for(size_t i = 0; i < ctx->cap; i++) {
+        mpz_init(ctx->pool[i]);
+    }
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_cond_init(&ctx->room, NULL);
+    ctx->stop = 0;
+    ctx->threads = 0;
+    if(ctx->pool) {
+        for(int i = 0; i < threads && i < PAILLIER_MAX_THREADS; i++) {
+            if(!pthread_create(&ctx->tid[ctx->threads], NULL, paillier_ctx_worker, ctx)) {
+                ctx->threads++;
+            }
+        }
+    }
+    return ctx;
+}
+
+void paillier_enc_ctx_free(PaillierEncCtx *ctx) {
+    if(!ctx) {
+        return ;
+    }
+    pthread_mutex_lock(&ctx->lock);
+    ctx->stop = 1;
+    pthread_cond_broadcast(&ctx->room);
+    pthread_mutex_unlock(&ctx->lock);
+    for(int i = 0; i < ctx->threads; i++) {
+        pthread_join(ctx->tid[i], NULL);
+    }
+    for(size_t i = 0; i < ctx->cap; i++) {
+        mpz_clear(ctx->pool[i]);
+    }
+    free(ctx->pool);
+    pthread_mutex_destroy(&ctx->lock);
+    pthread_cond_destroy(&ctx->room);
+    gmp_randclear(ctx->rand);
+    mpz_clear(ctx->n);
+    mpz_clear(ctx->n2);
+    free(ctx);
+}
+
+size_t paillier_enc_ctx_fill(PaillierEncCtx *ctx, const size_t count) {
+    size_t added = 0;
+    size_t mark = arena_mark();
+    mpz_ptr rn = arena_mpz();
+    for(; added < count; added++) {
+        pthread_mutex_lock(&ctx->lock);
+        mpz_urandomm(rn, ctx->rand, ctx->n);
+        pthread_mutex_unlock(&ctx->lock);
+        mpz_powm(rn, rn, ctx->n, ctx->n2);
+
+        pthread_mutex_lock(&ctx->lock);
+        int pushed = paillier_ctx_push(ctx, rn);
+        pthread_mutex_unlock(&ctx->lock);
+        if(!pushed) {
+            break;
+        }
+    }
+    arena_release(mark);
+    return added;
+}
+
+size_t paillier_enc_ctx_available(PaillierEncCtx *ctx) {
+    pthread_mutex_lock(&ctx->lock);
+    size_t count = ctx->count;
+    pthread_mutex_unlock(&ctx->lock);
+    return count;
+}
+
+int paillier_enc_ctx_encrypt_into(PaillierEncCtx *ctx, const uint8_t *msg, const size_t msg_len, uint8_t *cipher, size_t *cipher_len) {
+    size_t nb = (mpz_sizeinbase(ctx->n, 2) + 7) / 8;
+    if(!paillier_check_out(cipher, cipher_len, nb + nb)) {
+        return 0;
+    }
+    size_t mark = arena_mark();
+    mpz_ptr m = arena_mpz(), rn = arena_mpz();
+    int pooled = 0;
+
+    pthread_mutex_lock(&ctx->lock);
+    if(ctx->count) {
+        mpz_swap(rn, ctx->pool[ctx->head]);
+        ctx->head = (ctx->head + 1) % ctx->cap;
+        ctx->count--;
+        pooled = 1;
+        pthread_cond_signal(&ctx->room);
+    } else {
+        mpz_urandomm(rn, ctx->rand, ctx->n);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    if(!pooled) {
+        mpz_powm(rn, rn, ctx->n, ctx->n2);
+    }
+
+    // g = n + 1: g^m = 1 + m * n mod n^2
+    mpz_import(m, msg_len, 1, 1, 0, 0, msg);
+    mpz_mul(m, m, ctx->n);
+    mpz_add_ui(m, m, 1);
+    mpz_mul(m, m, rn);
+    mpz_mod(m, m, ctx->n2);
+    *cipher_len = nb + nb;
+    paillier_export(cipher, *cipher_len, m);
+
+    arena_release(mark);
+    return 1;
+}
+
+
+static int paillier_par_threads = 1;
+static size_t paillier_par_threshold = 1024;
+
+void paillier_set_parallel(int threads, size_t threshold) {
+    paillier_par_threads = threads > PAILLIER_MAX_THREADS ? PAILLIER_MAX_THREADS : threads;
+    paillier_par_threshold = threshold;
+}
+
+// products of this many factors are built before one reduction modulo n^2
+#define PAILLIER_LAZY 4
+// bases sharing one run of squarings, each with a table of up to PAILLIER_WINDOW_SIZE powers
+#define PAILLIER_STRAUS_BATCH 32
+#define PAILLIER_WINDOW 4
+#define PAILLIER_WINDOW_SIZE (1 << PAILLIER_WINDOW)
+// largest pippenger window, 4096 buckets
+#define PAILLIER_BUCKET_BITS 12
+// weighted sums import and exponentiate this many ciphertexts at a time
+#define PAILLIER_MULTI_CHUNK 1024
+
+typedef struct PaillierSumJob {
+    const uint8_t *const *ciphers;
+    const size_t *cipher_lens;
+    const uint8_t *const *weights;
+    const size_t *weight_lens;
+    size_t count;
+    mpz_srcptr n2;
+    mpz_t acc;
+} PaillierSumJob;
 
+static void paillier_sum_plain(PaillierSumJob *job) {
+    mpz_t c;
+    mpz_init(c);
+    mpz_set_ui(job->acc, 1);
+    for(size_t i = 0; i < job->count; i++) {
+        mpz_import(c, job->cipher_lens[i], 1, 1, 0, 0, job->ciphers[i]);
+        mpz_mul(job->acc, job->acc, c);
+        if(i % PAILLIER_LAZY == PAILLIER_LAZY - 1) {
+            mpz_mod(job->acc, job->acc, job->n2);
+        }
+    }
+    mpz_mod(job->acc, job->acc, job->n2);
     mpz_clear(c);
-    mpz_clear(m);
-    mpz_clear(n);
+}
+
+static unsigned paillier_window(const mpz_t e, const size_t win, const int w) {
+    unsigned d = 0;
+    for(int b = w - 1; b >= 0; b--) {
+        d = (d << 1) | mpz_tstbit(e, win * w + b);
+    }
+    return d;
+}
+
+// acc = acc^(2^w) mod m, skipped while acc is still 1
+static void paillier_square_w(mpz_t acc, const int w, const mpz_t mod) {
+    if(!mpz_cmp_ui(acc, 1)) {
+        return ;
+    }
+    for(int b = 0; b < w; b++) {
+        mpz_mul(acc, acc, acc);
+        mpz_mod(acc, acc, mod);
+    }
+}
+
+/**
+ * straus: every base keeps a table of its first 2^w - 1 powers (base[i] itself is
+ * the first), one accumulator walks all exponents w bits at a time so the squarings
+ * are shared by PAILLIER_STRAUS_BATCH bases.
+*/
+static void paillier_straus(mpz_t out, mpz_t *base, mpz_t *exp, const size_t count, const size_t bits, const int w, const mpz_t mod) {
+    mpz_t tab[PAILLIER_STRAUS_BATCH][PAILLIER_WINDOW_SIZE], acc;
+    for(int i = 0; i < PAILLIER_STRAUS_BATCH; i++) {
+        for(int j = 2; j < (1 << w); j++) {
+            mpz_init(tab[i][j]);
+        }
+    }
+    mpz_init(acc);
+    mpz_set_ui(out, 1);
+
+    for(size_t off = 0; off < count; off += PAILLIER_STRAUS_BATCH) {
+        size_t batch = count - off < PAILLIER_STRAUS_BATCH ? count - off : PAILLIER_STRAUS_BATCH;
+        for(size_t i = 0; i < batch; i++) {
+            for(int j = 2; j < (1 << w); j++) {
+                mpz_mul(tab[i][j], j == 2 ? base[off + i] : tab[i][j - 1], base[off + i]);
+                mpz_mod(tab[i][j], tab[i][j], mod);
+            }
+        }
+        mpz_set_ui(acc, 1);
+        for(size_t win = (bits + w - 1) / w; win-- > 0;) {
+            paillier_square_w(acc, w, mod);
+            for(size_t i = 0; i < batch; i++) {
+                unsigned d = paillier_window(exp[off + i], win, w);
+                if(d) {
+                    mpz_mul(acc, acc, d == 1 ? base[off + i] : tab[i][d]);
+                    mpz_mod(acc, acc, mod);
+                }
+            }
+        }
+        mpz_mul(out, out, acc);
+        mpz_mod(out, out, mod);
+    }
+
+    for(int i = 0; i < PAILLIER_STRAUS_BATCH; i++) {
+        for(int j = 2; j < (1 << w); j++) {
+            mpz_clear(tab[i][j]);
+        }
+    }
+    mpz_clear(acc);
+}
+
+/**
+ * pippenger: per window of c bits every base is multiplied into the bucket of its
+ * digit, then prod bucket_d^d comes from two running products (2^(c+1) multiplications),
+ * so the per base cost is one multiplication per window whatever the digit.
+*/
+static void paillier_pippenger(mpz_t out, mpz_t *base, mpz_t *exp, const size_t count, const size_t bits, const int c, const mpz_t mod) {
+    size_t buckets = (size_t) 1 << c;
+    mpz_t *bucket = (mpz_t *) malloc(buckets * sizeof(mpz_t)), run, sum;
+    uint8_t *used = (uint8_t *) malloc(buckets);
+    for(size_t j = 0; j < buckets; j++) {
+        mpz_init(bucket[j]);
+    }
+    mpz_init(run);
+    mpz_init(sum);
+    mpz_set_ui(out, 1);
+
+    for(size_t win = (bits + c - 1) / c; win-- > 0;) {
+        paillier_square_w(out, c, mod);
+        memset(used, 0, buckets);
+        for(size_t i = 0; i < count; i++) {
+            unsigned d = paillier_window(exp[i], win, c);
+            if(!d) {
+                continue;
+            }
+            if(used[d]) {
+                mpz_mul(bucket[d], bucket[d], base[i]);
+                mpz_mod(bucket[d], bucket[d], mod);
+            } else {
+                mpz_set(bucket[d], base[i]);
+                used[d] = 1;
+            }
+        }
+        // sum = prod_d bucket_d^d = prod_d (prod_{j >= d} bucket_j)
+        int run_set = 0, sum_set = 0;
+        for(size_t d = buckets - 1; d > 0; d--) {
+            if(used[d]) {
+                if(run_set) {
+                    mpz_mul(run, run, bucket[d]);
+                    mpz_mod(run, run, mod);
+                } else {
+                    mpz_set(run, bucket[d]);
+                    run_set = 1;
+                }
+            }
+            if(!run_set) {
+                continue;
+            }
+            if(sum_set) {
+                mpz_mul(sum, sum, run);
+                mpz_mod(sum, sum, mod);
+            } else {
+                mpz_set(sum, run);
+                sum_set = 1;
+            }
+        }
+        if(sum_set) {
+            mpz_mul(out, out, sum);
+            mpz_mod(out, out, mod);
+        }
+    }
+
+    for(size_t j = 0; j < buckets; j++) {
+        mpz_clear(bucket[j]);
+    }
+    free(bucket);
+    free(used);
+    mpz_clear(run);
+    mpz_clear(sum);
+}
+
+/**
+ * picks straus or pippenger and the window from the estimated number of modular
+ * multiplications: straus count * (2^w - 2 + bits / w * (1 - 2^-w)),
+ * pippenger bits / c * (count * (1 - 2^-c) + 2^(c+1)), plus bits squarings for both.
+*/
+static void paillier_multi_exp(mpz_t out, mpz_t *base, mpz_t *exp, const size_t count, const mpz_t mod) {
+    size_t bits = 0;
+    for(size_t i = 0; i < count; i++) {
+        if(mpz_sgn(exp[i]) && mpz_sizeinbase(exp[i], 2) > bits) {
+            bits = mpz_sizeinbase(exp[i], 2);
+        }
+    }
+    int best = 1, pippenger = 0;
+    double best_cost = 0;
+    for(int w = 1; w <= PAILLIER_WINDOW; w++) {
+        double cost = (double) count * ((double) ((1 << w) - 2) + (double) ((bits + w - 1) / w) * (1.0 - 1.0 / (1 << w)));
+        if(w == 1 || cost < best_cost) {
+            best = w;
+            best_cost = cost;
+        }
+    }
+    for(int c = 1; c <= PAILLIER_BUCKET_BITS; c++) {
+        double cost = (double) ((bits + c - 1) / c) * ((double) count * (1.0 - 1.0 / (1 << c)) + (double) (2 << c));
+        if(cost < best_cost) {
+            best = c;
+            best_cost = cost;
+            pippenger = 1;
+        }
+    }
+    if(pippenger) {
+        paillier_pippenger(out, base, exp, count, bits, best, mod);
+    } else {
+        paillier_straus(out, base, exp, count, bits, best, mod);
+    }
+}
+
+void paillier_multi_powm(mpz_t out, mpz_t *bases, mpz_t *exps, const size_t count, const mpz_t mod) {
+    mpz_t r;
+    mpz_init(r);
+    paillier_multi_exp(r, bases, exps, count, mod);
+    mpz_swap(out, r);
+    mpz_clear(r);
+}
+
+// prod c_i^w_i, PAILLIER_MULTI_CHUNK ciphertexts imported at a time
+static void paillier_sum_weighted(PaillierSumJob *job) {
+    size_t chunk = job->count < PAILLIER_MULTI_CHUNK ? job->count : PAILLIER_MULTI_CHUNK;
+    mpz_t *base = (mpz_t *) malloc((chunk + 1) * sizeof(mpz_t)), *exp = (mpz_t *) malloc((chunk + 1) * sizeof(mpz_t)), part;
+    for(size_t i = 0; i < chunk; i++) {
+        mpz_init(base[i]);
+        mpz_init(exp[i]);
+    }
+    mpz_init(part);
+    mpz_set_ui(job->acc, 1);
+
+    for(size_t off = 0; off < job->count; off += chunk) {
+        size_t batch = job->count - off < chunk ? job->count - off : chunk;
+        for(size_t i = 0; i < batch; i++) {
+            mpz_import(base[i], job->cipher_lens[off + i], 1, 1, 0, 0, job->ciphers[off + i]);
+            mpz_import(exp[i], job->weight_lens[off + i], 1, 1, 0, 0, job->weights[off + i]);
+        }
+        paillier_multi_exp(part, base, exp, batch, job->n2);
+        mpz_mul(job->acc, job->acc, part);
+        mpz_mod(job->acc, job->acc, job->n2);
+    }
+
+    for(size_t i = 0; i < chunk; i++) {
+        mpz_clear(base[i]);
+        mpz_clear(exp[i]);
+    }
+    free(base);
+    free(exp);
+    mpz_clear(part);
+}
+
+static void *paillier_sum_run(void *arg) {
+    PaillierSumJob *job = (PaillierSumJob *) arg;
+    if(job->weights) {
+        paillier_sum_weighted(job);
+    } else {
+        paillier_sum_plain(job);
+    }
+    return NULL;
+}
+
+/**
+ * one contiguous range per thread, the partial products are then
+ * multiplied pairwise (tree) into jobs[0].acc.
+*/
+static void paillier_sum_jobs(const uint8_t *const *ciphers, const size_t *cipher_lens, const uint8_t *const *weights, 
+                    const size_t *weight_lens, const size_t count, mpz_srcptr n2, mpz_t out) {
+    PaillierSumJob jobs[PAILLIER_MAX_THREADS];
+    pthread_t tid[PAILLIER_MAX_THREADS];
+    int started[PAILLIER_MAX_THREADS];
+    int threads = paillier_par_threads < 2 || count < paillier_par_threshold ? 1 : paillier_par_threads;
+    size_t share = (count + threads - 1) / threads, off = 0;
+    int n = 0;
+
+    for(; n < threads && (off < count || !n); n++) {
+        jobs[n].count = count - off < share ? count - off : share;
+        jobs[n].ciphers = ciphers + off;
+        jobs[n].cipher_lens = cipher_lens + off;
+        jobs[n].weights = weights ? weights + off : NULL;
+        jobs[n].weight_lens = weights ? weight_lens + off : NULL;
+        jobs[n].n2 = n2;
+        mpz_init(jobs[n].acc);
+        off += jobs[n].count;
+    }
+    for(int i = 1; i < n; i++) {
+        started[i] = !pthread_create(&tid[i], NULL, paillier_sum_run, &jobs[i]);
+        if(!started[i]) {
+            paillier_sum_run(&jobs[i]);
+        }
+    }
+    paillier_sum_run(&jobs[0]);
+    for(int i = 1; i < n; i++) {
+        if(started[i]) {
+            pthread_join(tid[i], NULL);
+        }
+    }
+    for(int step = 1; step < n; step <<= 1) {
+        for(int i = 0; i + step < n; i += step << 1) {
+            mpz_mul(jobs[i].acc, jobs[i].acc, jobs[i + step].acc);
+            mpz_mod(jobs[i].acc, jobs[i].acc, n2);
+        }
+    }
+    mpz_swap(out, jobs[0].acc);
+    for(int i = 0; i < n; i++) {
+        mpz_clear(jobs[i].acc);
+    }
+}
+
+int paillier_sum_into(const PaillierPublicKey *pk, const uint8_t *const *ciphers, const size_t *cipher_lens, const size_t count, uint8_t *cipher, size_t *cipher_len) {
+    size_t nb = paillier_bytes(pk->n, N_SIZE);
+    if(!paillier_check_out(cipher, cipher_len, nb + nb)) {
+        return 0;
+    }
+    size_t mark = arena_mark();
+    mpz_ptr n2 = arena_mpz(), c = arena_mpz();
+    mpz_import(n2, N_SIZE, 1, 1, 0, 0, pk->n);
+    mpz_mul(n2, n2, n2);
+
+    paillier_sum_jobs(ciphers, cipher_lens, NULL, NULL, count, n2, c);
+    *cipher_len = nb + nb;
+    paillier_export(cipher, *cipher_len, c);
+
+    arena_release(mark);
+    return 1;
+}
+
+void paillier_sum(const PaillierPublicKey *pk, const uint8_t *const *ciphers, const size_t *cipher_lens, const size_t count, uint8_t **cipher, size_t *cipher_len) {
+    *cipher_len = 2 * paillier_bytes(pk->n, N_SIZE);
+    *cipher = (uint8_t *)archer_malloc(*cipher_len);
+    paillier_sum_into(pk, ciphers, cipher_lens, count, *cipher, cipher_len);
+}
+
+int paillier_weighted_sum_into(const PaillierPublicKey *pk, const uint8_t *const *ciphers, const size_t *cipher_lens, 
+                    const uint8_t *const *weights, const size_t *weight_lens, const size_t count, uint8_t *cipher, size_t *cipher_len) {
+    size_t nb = paillier_bytes(pk->n, N_SIZE);
+    if(!weights || !weight_lens || !paillier_check_out(cipher, cipher_len, nb + nb)) {
+        return 0;
+    }
+    size_t mark = arena_mark();
+    mpz_ptr n2 = arena_mpz(), c = arena_mpz();
+    mpz_import(n2, N_SIZE, 1, 1, 0, 0, pk->n);
+    mpz_mul(n2, n2, n2);
+
+    paillier_sum_jobs(ciphers, cipher_lens, weights, weight_lens, count, n2, c);
+    *cipher_len = nb + nb;
+    paillier_export(cipher, *cipher_len, c);
+
+    arena_release(mark);
+    return 1;
+}
+
+void paillier_weighted_sum(const PaillierPublicKey *pk, const uint8_t *const *ciphers, const size_t *cipher_lens, 
+                    const uint8_t *const *weights, const size_t *weight_lens, const size_t count, uint8_t **cipher, size_t *cipher_len) {
+    *cipher_len = 2 * paillier_bytes(pk->n, N_SIZE);
+    *cipher = (uint8_t *)archer_malloc(*cipher_len);
+    paillier_weighted_sum_into(pk, ciphers, cipher_lens, weights, weight_lens, count, *cipher, cipher_len);
+}
+
+struct PaillierFixedBase {
+    mpz_t n2;
+    size_t nb;
+    size_t bits;
+    size_t windows;
+    // tab[i * 15 + d - 1] = c^(d * 16^i)
+    mpz_t *tab;
+};
+
+PaillierFixedBase *paillier_fixed_base_new(const PaillierPublicKey *pk, const uint8_t *cipher, const size_t cipher_len, const size_t max_bits) {
+    PaillierFixedBase *fb = (PaillierFixedBase *) malloc(sizeof(PaillierFixedBase));
+    if(!fb) {
+        return NULL;
+    }
+    fb->bits = max_bits ? max_bits : 1;
+    fb->windows = (fb->bits + PAILLIER_WINDOW - 1) / PAILLIER_WINDOW;
+    fb->tab = (mpz_t *) malloc(fb->windows * (PAILLIER_WINDOW_SIZE - 1) * sizeof(mpz_t));
+    if(!fb->tab) {
+        free(fb);
+        return NULL;
+    }
+    fb->nb = paillier_bytes(pk->n, N_SIZE);
+    mpz_init(fb->n2);
+    mpz_import(fb->n2, N_SIZE, 1, 1, 0, 0, pk->n);
+    mpz_mul(fb->n2, fb->n2, fb->n2);
+
+    mpz_t *t = fb->tab;
+    mpz_init(t[0]);
+    mpz_import(t[0], cipher_len, 1, 1, 0, 0, cipher);
+    mpz_mod(t[0], t[0], fb->n2);
+    for(size_t i = 0; i < fb->windows; i++, t += PAILLIER_WINDOW_SIZE - 1) {
+        if(i) {
+            // c^(16^i) = c^(15 * 16^(i-1)) * c^(16^(i-1))
+            mpz_init(t[0]);
+            mpz_mul(t[0], t[-1], t[-(PAILLIER_WINDOW_SIZE - 1)]);
+            mpz_mod(t[0], t[0], fb->n2);
+        }
+        for(int d = 1; d < PAILLIER_WINDOW_SIZE - 1; d++) {
+            mpz_init(t[d]);
+            mpz_mul(t[d], t[d - 1], t[0]);
+            mpz_mod(t[d], t[d], fb->n2);
+        }
+    }
+    return fb;
+}
+
+void paillier_fixed_base_free(PaillierFixedBase *fb) {
+    if(!fb) {
+        return ;
+    }
+    for(size_t i = 0; i < fb->windows * (PAILLIER_WINDOW_SIZE - 1); i++) {
+        mpz_clear(fb->tab[i]);
+    }
+    free(fb->tab);
+    mpz_clear(fb->n2);
+    free(fb);
+}
+
+int paillier_fixed_base_mul_into(const PaillierFixedBase *fb, const uint8_t *msg, const size_t msg_len, uint8_t *cipher, size_t *cipher_len) {
+    if(!paillier_check_out(cipher, cipher_len, fb->nb + fb->nb)) {
+        return 0;
+    }
+    size_t mark = arena_mark();
+    mpz_ptr m = arena_mpz(), c = arena_mpz();
+    mpz_import(m, msg_len, 1, 1, 0, 0, msg);
+
+    if(mpz_sgn(m) && mpz_sizeinbase(m, 2) > fb->bits) {
+        mpz_powm(c, fb->tab[0], m, fb->n2);
+    } else {
+        // one multiplication per non zero 4 bit digit, no squarings
+        mpz_set_ui(c, 1);
+        for(size_t i = 0; i < fb->windows; i++) {
+            unsigned d = paillier_window(m, i, PAILLIER_WINDOW);
+            if(d) {
+                mpz_mul(c, c, fb->tab[i * (PAILLIER_WINDOW_SIZE - 1) + d - 1]);
+                mpz_mod(c, c, fb->n2);
+            }
+        }
+    }
+    *cipher_len = fb->nb + fb->nb;
+    paillier_export(cipher, *cipher_len, c);
+
+    arena_release(mark);
+    return 1;
+}
+
+int paillier_pack_init(PaillierPacking *pack, const PaillierPublicKey *pk, const int value_bits, const int headroom_bits) {
+    size_t bits = paillier_bytes(pk->n, N_SIZE) * 8;
+    if(!pack || value_bits < 1 || headroom_bits < 0 || value_bits + headroom_bits > 64 || bits < 2) {
+        return 0;
+    }
+    pack->value_bits = value_bits;
+    pack->slot_bits = value_bits + headroom_bits;
+    // the packed number stays below 2^(|n| * 8 - 8) < n
+    pack->slots = (bits - 8) / pack->slot_bits;
+    pack->bytes = bits / 8;
+    return 1;
+}
+
+int paillier_pack(const PaillierPacking *pack, const uint64_t *values, const size_t count, uint8_t *msg, size_t *msg_len) {
+    if(!pack || count > pack->slots || !paillier_check_out(msg, msg_len, pack->bytes)) {
+        return 0;
+    }
+    for(size_t i = 0; i < count; i++) {
+        if(pack->value_bits < 64 && values[i] >> pack->value_bits) {
+            return 0;
+        }
+    }
+    // slot 0 in the lowest bits, msg is big endian
+    memset(msg, 0, pack->bytes);
+    for(size_t i = 0; i < count; i++) {
+        size_t off = i * pack->slot_bits;
+        for(int b = 0; b < pack->value_bits; b++) {
+            if((values[i] >> b) & 1) {
+                size_t pos = off + b;
+                msg[pack->bytes - 1 - pos / 8] |= (uint8_t) (1 << (pos % 8));
+            }
+        }
+    }
+    *msg_len = pack->bytes;
+    return 1;
+}
+
+int paillier_unpack(const PaillierPacking *pack, const uint8_t *msg, const size_t msg_len, uint64_t *values, const size_t count) {
+    if(!pack || count > pack->slots) {
+        return 0;
+    }
+    for(size_t i = 0; i < count; i++) {
+        size_t off = i * pack->slot_bits;
+        uint64_t v = 0;
+        for(int b = pack->slot_bits - 1; b >= 0; b--) {
+            size_t pos = off + b;
+            v <<= 1;
+            if(pos / 8 < msg_len) {
+                v |= (msg[msg_len - 1 - pos / 8] >> (pos % 8)) & 1;
+            }
+        }
+        values[i] = v;
+    }
+    return 1;
+}
+
+// v mod n, negative values map to the upper half
+static int paillier_encode_mpz(const PaillierPublicKey *pk, mpz_t v, uint8_t *msg, size_t *msg_len) {
+    size_t nb = paillier_bytes(pk->n, N_SIZE);
+    if(!paillier_check_out(msg, msg_len, nb)) {
+        return 0;
+    }
+    size_t mark = arena_mark();
+    mpz_ptr n = arena_mpz(), h = arena_mpz();
+    mpz_import(n, N_SIZE, 1, 1, 0, 0, pk->n);
+    mpz_fdiv_q_2exp(h, n, 1);
+    int ok = mpz_cmpabs(v, h) <= 0;
+    if(ok) {
+        mpz_mod(h, v, n);
+        paillier_export(msg, nb, h);
+        *msg_len = nb;
+    }
+    arena_release(mark);
+    return ok;
+}
+
+// m in [0, n) back to (-n/2, n/2]
+static void paillier_decode_mpz(const PaillierPublicKey *pk, const uint8_t *msg, const size_t msg_len, mpz_t v) {
+    size_t mark = arena_mark();
+    mpz_ptr n = arena_mpz(), h = arena_mpz();
+    mpz_import(n, N_SIZE, 1, 1, 0, 0, pk->n);
+    mpz_import(v, msg_len, 1, 1, 0, 0, msg);
+    mpz_mod(v, v, n);
+    mpz_fdiv_q_2exp(h, n, 1);
+    if(mpz_cmp(v, h) > 0) {
+        mpz_sub(v, v, n);
+    }
+    arena_release(mark);
+}
+
+int paillier_encode_signed(const PaillierPublicKey *pk, const int64_t value, uint8_t *msg, size_t *msg_len) {
+    uint8_t be[8];
+    // magnitude without overflowing on INT64_MIN
+    uint64_t mag = value < 0 ? 0 - (uint64_t) value : (uint64_t) value;
+    for(int i = 0; i < 8; i++) {
+        be[i] = (uint8_t) (mag >> (56 - 8 * i));
+    }
+    size_t mark = arena_mark();
+    mpz_ptr v = arena_mpz();
+    mpz_import(v, 8, 1, 1, 0, 0, be);
+    if(value < 0) {
+        mpz_neg(v, v);
+    }
+    int ok = paillier_encode_mpz(pk, v, msg, msg_len);
+    arena_release(mark);
+    return ok;
+}
+
+int paillier_decode_signed(const PaillierPublicKey *pk, const uint8_t *msg, const size_t msg_len, int64_t *value) {
+    size_t mark = arena_mark();
+    mpz_ptr v = arena_mpz();
+    paillier_decode_mpz(pk, msg, msg_len, v);
+    int neg = mpz_sgn(v) < 0, ok = 0;
+    mpz_abs(v, v);
+    if(mpz_sizeinbase(v, 2) <= 64) {
+        uint8_t be[8] = {0};
+        size_t l = 0;
+        if(mpz_sgn(v)) {
+            mpz_export(be + 8 - (mpz_sizeinbase(v, 2) + 7) / 8, &l, 1, 1, 0, 0, v);
+        }
+        uint64_t mag = 0;
+        for(int i = 0; i < 8; i++) {
+            mag = mag << 8 | be[i];
+        }
+        if(neg ? mag <= (uint64_t) INT64_MAX + 1 : mag <= INT64_MAX) {
+            *value = neg ? (int64_t) (0 - mag) : (int64_t) mag;
+            ok = 1;
+        }
+    }
+    arena_release(mark);
+    return ok;
+}
+
+int paillier_encode_fixed(const PaillierPublicKey *pk, const double value, const double scale, uint8_t *msg, size_t *msg_len) {
+    double x = value * scale;
+    if(!isfinite(x) || !(scale > 0)) {
+        return 0;
+    }
+    size_t mark = arena_mark();
+    mpz_ptr v = arena_mpz();
+    // mpz_set_d truncates, round half away from zero
+    mpz_set_d(v, x < 0 ? x - 0.5 : x + 0.5);
+    int ok = paillier_encode_mpz(pk, v, msg, msg_len);
+    arena_release(mark);
+    return ok;
+}
+
+int paillier_decode_fixed(const PaillierPublicKey *pk, const uint8_t *msg, const size_t msg_len, const double scale, double *value) {
+    if(!(scale > 0)) {
+        return 0;
+    }
+    size_t mark = arena_mark();
+    mpz_ptr v = arena_mpz();
+    paillier_decode_mpz(pk, msg, msg_len, v);
+    *value = mpz_get_d(v) / scale;
+    arena_release(mark);
+    return 1;
+}
+
+size_t paillier_cipher_width(const PaillierPublicKey *pk) {
+    return 2 * paillier_bytes(pk->n, N_SIZE);
+}
+
+int paillier_cipher_store(const PaillierPublicKey *pk, const uint8_t *cipher, const size_t cipher_len, const int format, uint8_t *out) {
+    size_t width = paillier_cipher_width(pk), l = 0;
+    if((format != PAILLIER_BE && format != PAILLIER_LIMB64) || (format == PAILLIER_LIMB64 && width % 8)) {
+        return 0;
+    }
+    size_t mark = arena_mark();
+    mpz_ptr c = arena_mpz();
+    mpz_import(c, cipher_len, 1, 1, 0, 0, cipher);
+    int ok = (mpz_sizeinbase(c, 2) + 7) / 8 <= width;
+    if(ok && format == PAILLIER_BE) {
+        paillier_export(out, width, c);
+    } else if(ok) {
+        memset(out, 0, width);
+        mpz_export(out, &l, -1, 8, 0, 0, c);
+    }
+    arena_release(mark);
+    return ok;
+}
+
+int paillier_cipher_load(const PaillierPublicKey *pk, const uint8_t *in, const int format, uint8_t *cipher, size_t *cipher_len) {
+    size_t width = paillier_cipher_width(pk);
+    if(!paillier_check_out(cipher, cipher_len, width)) {
+        return 0;
+    }
+    if(format == PAILLIER_BE) {
+        memmove(cipher, in, width);
+    } else if(format == PAILLIER_LIMB64 && !(width % 8)) {
+        size_t mark = arena_mark();
+        mpz_ptr c = arena_mpz();
+        mpz_import(c, width / 8, -1, 8, 0, 0, in);
+        paillier_export(cipher, width, c);
+        arena_release(mark);
+    } else {
+        return 0;
+    }
+    *cipher_len = width;
+    return 1;
+}
+
+#define PAILLIER_BATCH_CHUNK 64
+
+// out[i] = base[i]^e mod mod, on the simd kernel where there is one
+static void paillier_powm_batch(mpz_t *out, mpz_t *base, const size_t count, const mpz_t e, const mpz_t mod) {
+    for(size_t i = paillier_simd_powm(out, base, count, e, mod); i < count; i++) {
+        mpz_powm(out[i], base[i], e, mod);
+    }
+}
+
+int paillier_encrypt_batch_into(const PaillierPublicKey *pk, const uint8_t *msgs, const size_t count, uint8_t *ciphers, size_t *ciphers_len) {
+    size_t nb = paillier_bytes(pk->n, N_SIZE);
+    if(!paillier_check_out(ciphers, ciphers_len, count * 2 * nb)) {
+        return 0;
+    }
+    mpz_t n, n2, t, r[PAILLIER_BATCH_CHUNK], rn[PAILLIER_BATCH_CHUNK];
+    int ok = 1;
+    mpz_inits(n, n2, t, NULL);
+    for(int i = 0; i < PAILLIER_BATCH_CHUNK; i++) {
+        mpz_init(r[i]);
+        mpz_init(rn[i]);
+    }
+    mpz_import(n, N_SIZE, 1, 1, 0, 0, pk->n);
+    mpz_mul(n2, n, n);
+
+    for(size_t done = 0; ok && done < count; done += PAILLIER_BATCH_CHUNK) {
+        size_t k = count - done < PAILLIER_BATCH_CHUNK ? count - done : PAILLIER_BATCH_CHUNK;
+        for(size_t i = 0; ok && i < k; i++) {
+            ok = paillier_random(r[i], nb * 8 - 1);
+        }
+        if(!ok) {
+            break;
+        }
+        paillier_powm_batch(rn, r, k, n, n2);
+        for(size_t i = 0; i < k; i++) {
+            // (1 + m * n) * r^n mod n^2
+            mpz_import(t, nb, 1, 1, 0, 0, msgs + (done + i) * nb);
+            mpz_mul(t, t, n);
+            mpz_add_ui(t, t, 1);
+            mpz_mul(t, t, rn[i]);
+            mpz_mod(t, t, n2);
+            paillier_export(ciphers + (done + i) * 2 * nb, 2 * nb, t);
+        }
+    }
+    if(ok) {
+        *ciphers_len = count * 2 * nb;
+    }
+
+    for(int i = 0; i < PAILLIER_BATCH_CHUNK; i++) {
+        mpz_clear(r[i]);
+        mpz_clear(rn[i]);
+    }
+    mpz_clears(n, n2, t, NULL);
+    return ok;
+}
+
+int paillier_decrypt_batch_into(const PaillierPrivateKey *sk, const uint8_t *ciphers, const size_t count, uint8_t *msgs, size_t *msgs_len) {
+    size_t nb = paillier_bytes(sk->n, N_SIZE);
+    if(!paillier_check_out(msgs, msgs_len, count * nb)) {
+        return 0;
+    }
+    mpz_t n, n2, p, q, p2, q2, hp, hq, qinv, pe, qe, c[PAILLIER_BATCH_CHUNK], xp[PAILLIER_BATCH_CHUNK], xq[PAILLIER_BATCH_CHUNK];
+    mpz_inits(n, n2, p, q, p2, q2, hp, hq, qinv, pe, qe, NULL);
+    for(int i = 0; i < PAILLIER_BATCH_CHUNK; i++) {
+        mpz_init(c[i]);
+        mpz_init(xp[i]);
+        mpz_init(xq[i]);
+    }
+    mpz_import(n, N_SIZE, 1, 1, 0, 0, sk->n);
+    mpz_import(p, P_SIZE, 1, 1, 0, 0, sk->p);
+    mpz_import(q, P_SIZE, 1, 1, 0, 0, sk->q);
+    int crt = mpz_sgn(p) && mpz_sgn(q);
+    if(crt) {
+        mpz_mul(p2, p, p);
+        mpz_mul(q2, q, q);
+        mpz_invert(qinv, q, p);
+        mpz_sub(hp, p, qinv);
+        mpz_invert(hq, p, q);
+        mpz_sub(hq, q, hq);
+        mpz_sub_ui(pe, p, 1);
+        mpz_sub_ui(qe, q, 1);
+    } else {
+        // keys without p and q: m = L(c^l mod n^2) * l^-1 mod n
+        mpz_mul(n2, n, n);
+        mpz_import(pe, N_SIZE, 1, 1, 0, 0, sk->l);
+        mpz_invert(hp, pe, n);
+    }
+
+    for(size_t done = 0; done < count; done += PAILLIER_BATCH_CHUNK) {
+        size_t k = count - done < PAILLIER_BATCH_CHUNK ? count - done : PAILLIER_BATCH_CHUNK;
+        for(size_t i = 0; i < k; i++) {
+            mpz_import(c[i], 2 * nb, 1, 1, 0, 0, ciphers + (done + i) * 2 * nb);
+        }
+        if(crt) {
+            for(size_t i = 0; i < k; i++) {
+                mpz_mod(xp[i], c[i], p2);
+                mpz_mod(xq[i], c[i], q2);
+            }
+            paillier_powm_batch(xp, xp, k, pe, p2);
+            paillier_powm_batch(xq, xq, k, qe, q2);
+            for(size_t i = 0; i < k; i++) {
+                paillier_crt_finish(xp[i], xp[i], p, hp);
+                paillier_crt_finish(xq[i], xq[i], q, hq);
+                paillier_crt_join(xp[i], xq[i], p, q, qinv);
+            }
+        } else {
+            paillier_powm_batch(xp, c, k, pe, n2);
+            for(size_t i = 0; i < k; i++) {
+                mpz_sub_ui(xp[i], xp[i], 1);
+                mpz_divexact(xp[i], xp[i], n);
+                mpz_mul(xp[i], xp[i], hp);
+                mpz_mod(xp[i], xp[i], n);
+            }
+        }
+        for(size_t i = 0; i < k; i++) {
+            paillier_export(msgs + (done + i) * nb, nb, xp[i]);
+        }
+    }
+    *msgs_len = count * nb;
+
+    for(int i = 0; i < PAILLIER_BATCH_CHUNK; i++) {
+        mpz_clear(c[i]);
+        mpz_clear(xp[i]);
+        mpz_clear(xq[i]);
+    }
+    mpz_clears(n, n2, p, q, p2, q2, hp, hq, qinv, pe, qe, NULL);
+    return 1;
 }
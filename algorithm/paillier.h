@@ -3,12 +3,53 @@
 
 #include "archer.h"
 
-#define P_SIZE  64
-#define N_SIZE  128
+// storage size of the key fields, values are right aligned
+#define P_SIZE  PAILLIER_P_MAX
+#define N_SIZE  PAILLIER_N_MAX
+
+#define PAILLIER_MAX_THREADS 64
 
 void paillier_key_gen(PaillierPrivateKey *sk, PaillierPublicKey *pk);
+int paillier_key_gen_bits(PaillierPrivateKey *sk, PaillierPublicKey *pk, const int bits);
 void paillier_encrypt(const PaillierPublicKey *pk, const uint8_t *msg, const size_t msg_len, uint8_t **cipher, size_t *cipher_len);
 void paillier_decrypt(const PaillierPrivateKey *sk, const uint8_t *cipher, const size_t cipher_len, uint8_t **msg, size_t *msg_len);
 void paillier_add(const PaillierPublicKey *pk, const uint8_t *cipher0, const size_t cipher0_len, const uint8_t *cipher1, const size_t cipher1_len, uint8_t **cipher, size_t *cipher_len);
 void paillier_mul(const PaillierPublicKey *pk, const uint8_t *cipher_in, const size_t cipher_in_len, const uint8_t *msg, const size_t msg_len, uint8_t **cipher, size_t *cipher_len);
+int paillier_encrypt_into(const PaillierPublicKey *pk, const uint8_t *msg, const size_t msg_len, uint8_t *cipher, size_t *cipher_len);
+int paillier_decrypt_into(const PaillierPrivateKey *sk, const uint8_t *cipher, const size_t cipher_len, uint8_t *msg, size_t *msg_len);
+int paillier_add_into(const PaillierPublicKey *pk, const uint8_t *cipher0, const size_t cipher0_len, const uint8_t *cipher1, const size_t cipher1_len, uint8_t *cipher, size_t *cipher_len);
+void paillier_crt_key_init(PaillierCrtKey *key, const PaillierPrivateKey *sk);
+void paillier_crt_key_clear(PaillierCrtKey *key);
+int paillier_crt_decrypt_into(const PaillierCrtKey *key, const uint8_t *cipher, const size_t cipher_len, uint8_t *msg, size_t *msg_len);
+PaillierEncCtx *paillier_enc_ctx_new(const PaillierPublicKey *pk, const size_t pool_size, const int threads);
+void paillier_enc_ctx_free(PaillierEncCtx *ctx);
+size_t paillier_enc_ctx_fill(PaillierEncCtx *ctx, const size_t count);
+size_t paillier_enc_ctx_available(PaillierEncCtx *ctx);
+int paillier_enc_ctx_encrypt_into(PaillierEncCtx *ctx, const uint8_t *msg, const size_t msg_len, uint8_t *cipher, size_t *cipher_len);
+void paillier_set_parallel(int threads, size_t threshold);
+void paillier_sum(const PaillierPublicKey *pk, const uint8_t *const *ciphers, const size_t *cipher_lens, const size_t count, uint8_t **cipher, size_t *cipher_len);
+int paillier_sum_into(const PaillierPublicKey *pk, const uint8_t *const *ciphers, const size_t *cipher_lens, const size_t count, uint8_t *cipher, size_t *cipher_len);
+void paillier_weighted_sum(const PaillierPublicKey *pk, const uint8_t *const *ciphers, const size_t *cipher_lens, 
+                    const uint8_t *const *weights, const size_t *weight_lens, const size_t count, uint8_t **cipher, size_t *cipher_len);
+int paillier_weighted_sum_into(const PaillierPublicKey *pk, const uint8_t *const *ciphers, const size_t *cipher_lens, 
+                    const uint8_t *const *weights, const size_t *weight_lens, const size_t count, uint8_t *cipher, size_t *cipher_len);
+void paillier_multi_powm(mpz_t out, mpz_t *bases, mpz_t *exps, const size_t count, const mpz_t mod);
+PaillierFixedBase *paillier_fixed_base_new(const PaillierPublicKey *pk, const uint8_t *cipher, const size_t cipher_len, const size_t max_bits);
+void paillier_fixed_base_free(PaillierFixedBase *fb);
+int paillier_fixed_base_mul_into(const PaillierFixedBase *fb, const uint8_t *msg, const size_t msg_len, uint8_t *cipher, size_t *cipher_len);
+int paillier_neg_into(const PaillierPublicKey *pk, const uint8_t *cipher_in, const size_t cipher_in_len, uint8_t *cipher, size_t *cipher_len);
+int paillier_sub_into(const PaillierPublicKey *pk, const uint8_t *cipher0, const size_t cipher0_len, const uint8_t *cipher1, const size_t cipher1_len, uint8_t *cipher, size_t *cipher_len);
+int paillier_encode_signed(const PaillierPublicKey *pk, const int64_t value, uint8_t *msg, size_t *msg_len);
+int paillier_decode_signed(const PaillierPublicKey *pk, const uint8_t *msg, const size_t msg_len, int64_t *value);
+int paillier_encode_fixed(const PaillierPublicKey *pk, const double value, const double scale, uint8_t *msg, size_t *msg_len);
+int paillier_decode_fixed(const PaillierPublicKey *pk, const uint8_t *msg, const size_t msg_len, const double scale, double *value);
+size_t paillier_cipher_width(const PaillierPublicKey *pk);
+int paillier_cipher_store(const PaillierPublicKey *pk, const uint8_t *cipher, const size_t cipher_len, const int format, uint8_t *out);
+int paillier_cipher_load(const PaillierPublicKey *pk, const uint8_t *in, const int format, uint8_t *cipher, size_t *cipher_len);
+int paillier_encrypt_batch_into(const PaillierPublicKey *pk, const uint8_t *msgs, const size_t count, uint8_t *ciphers, size_t *ciphers_len);
+int paillier_decrypt_batch_into(const PaillierPrivateKey *sk, const uint8_t *ciphers, const size_t count, uint8_t *msgs, size_t *msgs_len);
+int paillier_pack_init(PaillierPacking *pack, const PaillierPublicKey *pk, const int value_bits, const int headroom_bits);
+int paillier_pack(const PaillierPacking *pack, const uint64_t *values, const size_t count, uint8_t *msg, size_t *msg_len);
+int paillier_unpack(const PaillierPacking *pack, const uint8_t *msg, const size_t msg_len, uint64_t *values, const size_t count);
+int paillier_mul_into(const PaillierPublicKey *pk, const uint8_t *cipher_in, const size_t cipher_in_len, const uint8_t *msg, const size_t msg_len, uint8_t *cipher, size_t *cipher_len);
 #endif
\ No newline at end of file
@@ -0,0 +1,215 @@
+#include "paillier_simd.h"
+#include "arena.h"
+
+/**
+ * montgomery multiplication in radix 2^52 on vpmadd52luq/vpmadd52huq. numbers are stored
+ * vertically, limb j of 8 different numbers in one 512-bit vector, so 8 exponentiations
+ * sharing exponent and modulus run in lockstep, one per 64-bit lane.
+ *
+ * partial products are added to 64-bit words without carrying, every word takes at most
+ * 4 * limbs values below 2^52 (< 2^62 for 158 limbs), and the carries are propagated
+ * once per multiplication. with R = 2^(52 * limbs) > 4 * mod, inputs below 2 * mod give
+ * a result below 2 * mod, which is only reduced after leaving montgomery form.
+*/
+#if defined(__GNUC__) && defined(__x86_64__)
+
+#include <immintrin.h>
+
+#define PAILLIER_SIMD_X86
+
+#define PAILLIER_IFMA_TARGET __attribute__((target("avx512f,avx512ifma")))
+
+#endif
+
+#define PAILLIER_SIMD_LANES   8
+#define PAILLIER_LIMB_BITS    52
+#define PAILLIER_LIMB_MASK    ((1ULL << PAILLIER_LIMB_BITS) - 1)
+// n^2 of a 4096 bit key
+#define PAILLIER_SIMD_LIMBS   158
+#define PAILLIER_SIMD_WINDOW  5
+#define PAILLIER_SIMD_MIN_LANES 3
+
+// exponent bits [pos, pos + w)
+static unsigned paillier_simd_window(const mpz_t e, const size_t pos, const int w) {
+    unsigned d = 0;
+    for(int i = w - 1; i >= 0; i--) {
+        d = d << 1 | mpz_tstbit(e, pos + i);
+    }
+    return d;
+}
+
+#ifdef PAILLIER_SIMD_X86
+
+// r = a * b / R mod m, r may alias a or b, t holds 2 * limbs + 1 vectors
+PAILLIER_IFMA_TARGET
+static void paillier_ifma_mul(__m512i *r, const __m512i *a, const __m512i *b, const __m512i *m, const __m512i k0, const size_t limbs, __m512i *t) {
+    const __m512i zero = _mm512_setzero_si512(), mask = _mm512_set1_epi64(PAILLIER_LIMB_MASK);
+    for(size_t j = 0; j <= 2 * limbs; j++) {
+        t[j] = zero;
+    }
+    for(size_t i = 0; i < limbs; i++) {
+        __m512i *ti = t + i, ai = a[i], x, u;
+        // u = t_i * -m^-1 mod 2^52 clears the low 52 bits of t_i + a_i * b + u * m
+        x = _mm512_madd52lo_epu64(ti[0], ai, b[0]);
+        u = _mm512_madd52lo_epu64(zero, x, k0);
+        x = _mm512_madd52lo_epu64(x, u, m[0]);
+        // the high halves of column j and the low halves of column j + 1 as separate chains
+        for(size_t j = 0; j + 1 < limbs; j++) {
+            __m512i h = _mm512_madd52hi_epu64(_mm512_madd52hi_epu64(ti[j + 1], ai, b[j]), u, m[j]);
+            __m512i l = _mm512_madd52lo_epu64(_mm512_madd52lo_epu64(zero, ai, b[j + 1]), u, m[j + 1]);
+            ti[j + 1] = _mm512_add_epi64(h, l);
+        }
+        ti[limbs] = _mm512_madd52hi_epu64(_mm512_madd52hi_epu64(ti[limbs], ai, b[limbs - 1]), u, m[limbs - 1]);
+        ti[1] = _mm512_add_epi64(ti[1], _mm512_srli_epi64(x, PAILLIER_LIMB_BITS));
+    }
+    __m512i c = zero;
+    for(size_t j = 0; j < limbs; j++) {
+        __m512i v = _mm512_add_epi64(t[limbs + j], c);
+        r[j] = _mm512_and_si512(v, mask);
+        c = _mm512_srli_epi64(v, PAILLIER_LIMB_BITS);
+    }
+}
+
+/**
+ * acc = base^exp in montgomery form, fixed 5 bit window.
+ * work holds (2^5 + 2) * limbs + 1 vectors.
+*/
+PAILLIER_IFMA_TARGET
+static void paillier_ifma_powm(uint64_t *acc, const uint64_t *base, const uint64_t *mod, const uint64_t k0, const mpz_t exp, const size_t limbs, uint64_t *work) {
+    const int w = PAILLIER_SIMD_WINDOW;
+    const __m512i k = _mm512_set1_epi64((long long) k0);
+    __m512i *a = (__m512i *) acc, *m = (__m512i *) mod, *tab = (__m512i *) work;
+    __m512i *t = tab + ((size_t) 1 << w) * limbs;
+
+    memcpy(tab + limbs, base, limbs * sizeof(__m512i));
+    for(size_t d = 2; d < ((size_t) 1 << w); d++) {
+        paillier_ifma_mul(tab + d * limbs, tab + (d - 1) * limbs, tab + limbs, m, k, limbs, t);
+    }
+
+    size_t bits = mpz_sizeinbase(exp, 2);
+    size_t pos = bits - ((bits - 1) % w + 1);
+    memcpy(a, tab + paillier_simd_window(exp, pos, bits - pos) * limbs, limbs * sizeof(__m512i));
+    while(pos > 0) {
+        pos -= w;
+        for(int i = 0; i < w; i++) {
+            paillier_ifma_mul(a, a, a, m, k, limbs, t);
+        }
+        unsigned d = paillier_simd_window(exp, pos, w);
+        if(d) {
+            paillier_ifma_mul(a, a, tab + d * limbs, m, k, limbs, t);
+        }
+    }
+}
+
+// acc = acc / R, out of montgomery form
+PAILLIER_IFMA_TARGET
+static void paillier_ifma_leave(uint64_t *acc, const uint64_t *mod, const uint64_t k0, const size_t limbs, uint64_t *work) {
+    __m512i *one = (__m512i *) work, *t = one + limbs;
+    memset(one, 0, limbs * sizeof(__m512i));
+    one[0] = _mm512_set1_epi64(1);
+    paillier_ifma_mul((__m512i *) acc, (__m512i *) acc, one, (__m512i *) mod, _mm512_set1_epi64((long long) k0), limbs, t);
+}
+
+#endif
+
+typedef void (*paillier_powm_fn)(uint64_t *acc, const uint64_t *base, const uint64_t *mod, const uint64_t k0, const mpz_t exp, const size_t limbs, uint64_t *work);
+typedef void (*paillier_leave_fn)(uint64_t *acc, const uint64_t *mod, const uint64_t k0, const size_t limbs, uint64_t *work);
+
+static int paillier_simd_resolved = 0;
+static paillier_powm_fn paillier_simd_fn = NULL, paillier_simd_best = NULL;
+static paillier_leave_fn paillier_simd_leave = NULL;
+
+static void paillier_simd_resolve() {
+#ifdef PAILLIER_SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512ifma")) {
+        paillier_simd_best = paillier_ifma_powm;
+        paillier_simd_leave = paillier_ifma_leave;
+    }
+#endif
+    paillier_simd_fn = paillier_simd_best;
+    paillier_simd_resolved = 1;
+}
+
+// lane k of a vertical number from an mpz below 2^(52 * limbs)
+static void paillier_simd_set(uint64_t *v, const size_t lane, const mpz_t x, const size_t limbs, uint64_t *tmp) {
+    size_t l = 0;
+    memset(tmp, 0, limbs * sizeof(uint64_t));
+    mpz_export(tmp, &l, -1, sizeof(uint64_t), 0, 64 - PAILLIER_LIMB_BITS, x);
+    for(size_t j = 0; j < limbs; j++) {
+        v[j * PAILLIER_SIMD_LANES + lane] = tmp[j];
+    }
+}
+
+static void paillier_simd_get(mpz_t x, const uint64_t *v, const size_t lane, const size_t limbs, uint64_t *tmp) {
+    for(size_t j = 0; j < limbs; j++) {
+        tmp[j] = v[j * PAILLIER_SIMD_LANES + lane];
+    }
+    mpz_import(x, limbs, -1, sizeof(uint64_t), 0, 64 - PAILLIER_LIMB_BITS, tmp);
+}
+
+size_t paillier_simd_powm(mpz_t *out, mpz_t *base, size_t count, const mpz_t exp, const mpz_t mod) {
+    if(!paillier_simd_resolved) {
+        paillier_simd_resolve();
+    }
+    // a group with few lanes in use is slower than mpz_powm on each
+    if(count % PAILLIER_SIMD_LANES < PAILLIER_SIMD_MIN_LANES) {
+        count -= count % PAILLIER_SIMD_LANES;
+    }
+    size_t limbs = (mpz_sizeinbase(mod, 2) + 2 + PAILLIER_LIMB_BITS - 1) / PAILLIER_LIMB_BITS;
+    if(!paillier_simd_fn || !mpz_odd_p(mod) || mpz_cmp_ui(mod, 1) <= 0 || limbs > PAILLIER_SIMD_LIMBS || mpz_sgn(exp) <= 0 || !count) {
+        return 0;
+    }
+    size_t vec = limbs * PAILLIER_SIMD_LANES, words = (3 + ((size_t) 1 << PAILLIER_SIMD_WINDOW) + 2) * vec + PAILLIER_SIMD_LANES + limbs;
+    uint8_t *raw = (uint8_t *) malloc(words * sizeof(uint64_t) + 64);
+    if(!raw) {
+        return 0;
+    }
+    // scratch, archer_set_allocator only covers returned buffers. vectors need 64 byte alignment
+    uint64_t *m = (uint64_t *) (((uintptr_t) raw + 63) & ~(uintptr_t) 63);
+    uint64_t *b = m + vec, *acc = b + vec, *work = acc + vec, *tmp = work + words - 3 * vec - limbs;
+
+    mpz_t x, k0;
+    mpz_inits(x, k0, NULL);
+    for(size_t k = 0; k < PAILLIER_SIMD_LANES; k++) {
+        paillier_simd_set(m, k, mod, limbs, tmp);
+    }
+    // k0 = -mod^-1 mod 2^52
+    mpz_setbit(x, PAILLIER_LIMB_BITS);
+    mpz_invert(k0, mod, x);
+    mpz_sub(k0, x, k0);
+    uint64_t k0v = 0;
+    for(size_t i = 0; i < PAILLIER_LIMB_BITS; i++) {
+        k0v |= (uint64_t) mpz_tstbit(k0, i) << i;
+    }
+
+    for(size_t done = 0; done < count; done += PAILLIER_SIMD_LANES) {
+        size_t lanes = count - done < PAILLIER_SIMD_LANES ? count - done : PAILLIER_SIMD_LANES;
+        memset(b, 0, vec * sizeof(uint64_t));
+        for(size_t k = 0; k < lanes; k++) {
+            mpz_mul_2exp(x, base[done + k], limbs * PAILLIER_LIMB_BITS);
+            mpz_mod(x, x, mod);
+            paillier_simd_set(b, k, x, limbs, tmp);
+        }
+        paillier_simd_fn(acc, b, m, k0v, exp, limbs, work);
+        paillier_simd_leave(acc, m, k0v, limbs, work);
+        for(size_t k = 0; k < lanes; k++) {
+            paillier_simd_get(out[done + k], acc, k, limbs, tmp);
+            if(mpz_cmp(out[done + k], mod) >= 0) {
+                mpz_sub(out[done + k], out[done + k], mod);
+            }
+        }
+    }
+
+    mpz_clears(x, k0, NULL);
+    free(raw);
+    return count;
+}
+
+int paillier_set_simd(int enable) {
+    if(!paillier_simd_resolved) {
+        paillier_simd_resolve();
+    }
+    paillier_simd_fn = enable ? paillier_simd_best : NULL;
+    return paillier_simd_fn != NULL;
+}
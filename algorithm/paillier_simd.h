@@ -0,0 +1,15 @@
+#ifndef _PAILLIER_SIMD_H_
+#define _PAILLIER_SIMD_H_
+
+#include "archer.h"
+
+/**
+ * out[i] = base[i]^exp mod mod for count bases sharing an odd modulus (up to 8214 bits)
+ * and a positive exponent, 8 at a time on the AVX-512 IFMA kernel.
+ * @return number of leading outputs computed, the caller runs mpz_powm on the rest.
+ * 0 when there is no kernel or it is disabled
+*/
+size_t paillier_simd_powm(mpz_t *out, mpz_t *base, size_t count, const mpz_t exp, const mpz_t mod);
+int paillier_set_simd(int enable);
+
+#endif
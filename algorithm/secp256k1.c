@@ -1,4 +1,5 @@
 #include "secp256k1.h"
+#include "arena.h"
 
 typedef struct secp256k1_curve {
     mpz_t p, a, b, gx, gy, n, _0;
@@ -34,10 +35,8 @@ void secp256k1_privateKey_to_publicKey(const EcPrivateKey *sk, EcPublicKey *pk)
 
     secp256k1_init();
     
-    mpz_t x, y, d;
-    mpz_init(x);
-    mpz_init(y);
-    mpz_init(d);
+    size_t mark = arena_mark();
+    mpz_ptr x = arena_mpz(), y = arena_mpz(), d = arena_mpz();
     mpz_import(d, 32, 1, 1, 0, 0, sk->d);
     ec_point_mul(x, y, d, _secp256k1->p, _secp256k1->a, _secp256k1->b, _secp256k1->gx, _secp256k1->gy);
     
@@ -51,9 +50,7 @@ void secp256k1_privateKey_to_publicKey(const EcPrivateKey *sk, EcPublicKey *pk)
     memcpy(pk->x + (32 - lx), xc, lx);
     memcpy(pk->y + (32 - lx), yc, ly);
 
-    mpz_clear(x);
-    mpz_clear(y);
-    mpz_clear(d);
+    arena_release(mark);
 }
 
 void secp256k1_sign(const EcPrivateKey *sk, const uint8_t *msg, const size_t msg_len, EcSignature *sig, int *recv_id) {
@@ -68,12 +65,8 @@ void secp256k1_sign(const EcPrivateKey *sk, const uint8_t *msg, const size_t msg
     uint16_t seed = (uint16_t) ((int64_t) raw_k);
     ec_random_k(raw_k, seed++);
 
-    mpz_t d, m, k, r, s;
-    mpz_init(d);
-    mpz_init(m);
-    mpz_init(k);
-    mpz_init(r);
-    mpz_init(s);
+    size_t mark = arena_mark();
+    mpz_ptr d = arena_mpz(), m = arena_mpz(), k = arena_mpz(), r = arena_mpz(), s = arena_mpz();
     mpz_import(d, 32, 1, 1, 0, 0, sk->d);
     mpz_import(m, msg_len, 1, 1, 0, 0, msg);
     mpz_import(k, 32, 1, 1, 0, 0, raw_k);
@@ -103,11 +96,7 @@ void secp256k1_sign(const EcPrivateKey *sk, const uint8_t *msg, const size_t msg
     memcpy(sig->r + (32 - lr), rc, lr);
     memcpy(sig->s + (32 - ls), sc, ls);
 
-    mpz_clear(d);
-    mpz_clear(m);
-    mpz_clear(k);
-    mpz_clear(r);
-    mpz_clear(s);
+    arena_release(mark);
 }
 
 
@@ -120,16 +109,9 @@ int secp256k1_verify(const EcPublicKey *pk, const uint8_t *msg, const size_t msg
 
     int ret = 0;
 
-    mpz_t x, y, m, r, s, b0x, b0y, b1x, b1y;
-    mpz_init(x);
-    mpz_init(y);
-    mpz_init(m);
-    mpz_init(r);
-    mpz_init(s);
-    mpz_init(b0x);
-    mpz_init(b0y);
-    mpz_init(b1x);
-    mpz_init(b1y);
+    size_t mark = arena_mark();
+    mpz_ptr x = arena_mpz(), y = arena_mpz(), m = arena_mpz(), r = arena_mpz(), s = arena_mpz();
+    mpz_ptr b0x = arena_mpz(), b0y = arena_mpz(), b1x = arena_mpz(), b1y = arena_mpz();
 
     mpz_import(x, 32, 1, 1, 0, 0, pk->x);
     mpz_import(y, 32, 1, 1, 0, 0, pk->y);
@@ -151,15 +133,7 @@ int secp256k1_verify(const EcPublicKey *pk, const uint8_t *msg, const size_t msg
     mpz_mod(x, x, _secp256k1->p);
     ret = !(mpz_cmp(x, r));
 
-    mpz_clear(x);
-    mpz_clear(y);
-    mpz_clear(m);
-    mpz_clear(r);
-    mpz_clear(s);
-    mpz_clear(b0x);
-    mpz_clear(b0y);
-    mpz_clear(b1x);
-    mpz_clear(b1y);
+    arena_release(mark);
 
     return ret;
 }
@@ -171,16 +145,9 @@ void secp256k1_recover_publicKey(const EcSignature *sig, const uint8_t *msg, con
     
     secp256k1_init();
 
-    mpz_t x, y, t, m, mx, my, s, sx, sy;
-    mpz_init(x);
-    mpz_init(y);
-    mpz_init(t);
-    mpz_init(mx);
-    mpz_init(my);
-    mpz_init(m);
-    mpz_init(s);
-    mpz_init(sx);
-    mpz_init(sy);
+    size_t mark = arena_mark();
+    mpz_ptr x = arena_mpz(), y = arena_mpz(), t = arena_mpz(), m = arena_mpz(), mx = arena_mpz();
+    mpz_ptr my = arena_mpz(), s = arena_mpz(), sx = arena_mpz(), sy = arena_mpz();
     mpz_import(x, 32, 1, 1, 0, 0, sig->r);
     mpz_import(s, 32, 1, 1, 0, 0, sig->s);
     mpz_import(m, msg_len, 1, 1, 0, 0, msg);
@@ -218,13 +185,5 @@ void secp256k1_recover_publicKey(const EcSignature *sig, const uint8_t *msg, con
     memcpy(pk->x + (32 - lx), xc, lx);
     memcpy(pk->y + (32 - ly), yc, ly);
 
-    mpz_clear(x);
-    mpz_clear(y);
-    mpz_clear(t);
-    mpz_clear(mx);
-    mpz_clear(my);
-    mpz_clear(m);
-    mpz_clear(s);
-    mpz_clear(sx);
-    mpz_clear(sy);
+    arena_release(mark);
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "sm2p256v1.h"
+#include "arena.h"
 
 typedef struct sm2p256v1_curve {
     mpz_t p, a, b, gx, gy, n;
@@ -6,9 +7,8 @@ typedef struct sm2p256v1_curve {
 
 static sm2p256v1_curve *_sm2p256v1 = NULL;
 
-// userId = "1234567812345678"
-static void sm2p256v1_get_za(const uint8_t *x, const uint8_t *y, const uint8_t *msg, const size_t msg_len, Hash32 *out) {
-    uint8_t base[146] = {0,-128,49,50,51,52,53,54,55,56,49,50,51,52,53,54,55,
+// ENTL || userId "1234567812345678" || a || b || gx || gy
+static const uint8_t SM2_Z_BASE[146] = {0,-128,49,50,51,52,53,54,55,56,49,50,51,52,53,54,55,
                 56,-1,-1,-1,-2,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
                 -1,-1,-1,0,0,0,0,-1,-1,-1,-1,-1,-1,-1,-4,40,-23,-6,-98,
                 -99,-97,94,52,77,90,-98,75,-49,101,9,-89,-13,-105,-119,
@@ -18,27 +18,37 @@ static void sm2p256v1_get_za(const uint8_t *x, const uint8_t *y, const uint8_t *
                 -57,-68,55,54,-94,-12,-10,119,-100,89,-67,-50,-29,107,
                 105,33,83,-48,-87,-121,124,-58,42,71,64,2,-33,50,-27,33,
                 57,-16,-96};
-    uint8_t input[210];
-    memcpy(input, base, 146);
-    memcpy(&(input[146]), x, 32);
-    memcpy(&(input[146 + 32]), y, 32);
+
+// Z = SM3(ENTL || userId || a || b || gx || gy || x || y)
+static void sm2p256v1_get_z(const uint8_t *id, const size_t id_len, const uint8_t *x, const uint8_t *y, Hash32 *z) {
+    uint8_t entl[2] = {(uint8_t) ((id_len << 3) >> 8), (uint8_t) (id_len << 3)};
+    Sm3Ctx ctx;
+    sm3_init(&ctx);
+    sm3_update(&ctx, entl, 2);
+    sm3_update(&ctx, id, id_len);
+    sm3_update(&ctx, SM2_Z_BASE + 18, 128);
+    sm3_update(&ctx, x, 32);
+    sm3_update(&ctx, y, 32);
+    sm3_final(&ctx, z);
+}
+
+// userId = "1234567812345678"
+static void sm2p256v1_get_za(const uint8_t *x, const uint8_t *y, const uint8_t *msg, const size_t msg_len, Hash32 *out) {
     Hash32 z;
-    sm3(input, 210, &z);
-    uint8_t *e = malloc(32 + msg_len);
-    memcpy(e, z.h, 32);
-    memcpy(&(e[32]), msg, msg_len);
-    sm3(e, 32 + msg_len, out);
-    free(e);
+    Sm3Ctx ctx;
+    sm2p256v1_get_z(SM2_Z_BASE + 2, 16, x, y, &z);
+    sm3_init(&ctx);
+    sm3_update(&ctx, z.h, 32);
+    sm3_update(&ctx, msg, msg_len);
+    sm3_final(&ctx, out);
 }
 
 static void sm2p256v1_cal_rs(mpz_t d, mpz_t e, mpz_t r, mpz_t s) {
     uint8_t raw_k[32];
     uint16_t seed = (uint16_t) ((int64_t) raw_k);
     ec_random_k(raw_k, seed++);
-    mpz_t k, kx, ky;
-    mpz_init(k);
-    mpz_init(kx);
-    mpz_init(ky);
+    size_t mark = arena_mark();
+    mpz_ptr k = arena_mpz(), kx = arena_mpz(), ky = arena_mpz();
     mpz_import(k, 32, 1, 1, 0, 0, raw_k);
     ec_point_mul(kx, ky, k, _sm2p256v1->p, _sm2p256v1->a, _sm2p256v1->b, _sm2p256v1->gx, _sm2p256v1->gy);
     mpz_add(kx, kx, e);
@@ -62,32 +72,138 @@ static void sm2p256v1_cal_rs(mpz_t d, mpz_t e, mpz_t r, mpz_t s) {
     mpz_mul(s, s, kx);
     mpz_mod(s, s, _sm2p256v1->n);
 
-    mpz_clear(k);
-    mpz_clear(kx);
-    mpz_clear(ky);
+    arena_release(mark);
 }
 
-static void kdf(uint8_t *c1x, size_t x_l, uint8_t *c1y, size_t y_l, uint8_t *c2, size_t c2_l) {
-    size_t l = x_l + y_l, off = 0, ct = 0, digest_size = 32;
+/**
+ * out ^= KDF(z, out_len)
+ * z is absorbed once, every 32 byte output block then only hashes its counter
+ * from a copy of that state: one compression each when z_len is a multiple of 64.
+*/
+static void kdf(const uint8_t *z, const size_t z_len, uint8_t *out, const size_t out_len) {
+    size_t off = 0, ct = 0, digest_size = 32;
+    uint8_t ct_bytes[4];
     Hash32 buf;
-    uint8_t *in = malloc(l + 4);
-    memcpy(in, c1x, x_l);
-    memcpy(in + x_l, c1y, y_l);
-    while(off < c2_l) {
+    Sm3Ctx prefix, ctx;
+    sm3_init(&prefix);
+    sm3_update(&prefix, z, z_len);
+    while(off < out_len) {
         ++ct;
-        in[l] = (ct >> 24) & 0xff;
-        in[l+1] = (ct >> 16) & 0xff;
-        in[l+2] = (ct >> 8) & 0xff;
-        in[l+3] = ct & 0xff;
-
-        sm3(in, l+4, &buf);
-        digest_size = (c2_l - off) > 32 ? 32 : (c2_l - off);
+        ct_bytes[0] = (ct >> 24) & 0xff;
+        ct_bytes[1] = (ct >> 16) & 0xff;
+        ct_bytes[2] = (ct >> 8) & 0xff;
+        ct_bytes[3] = ct & 0xff;
+
+        ctx = prefix;
+        sm3_update(&ctx, ct_bytes, 4);
+        sm3_final(&ctx, &buf);
+        digest_size = (out_len - off) > 32 ? 32 : (out_len - off);
         for(int i = 0; i < digest_size; i++) {
-            c2[off + i] ^= buf.h[i];
+            out[off + i] ^= buf.h[i];
         }
         off += digest_size;
     }
-    free(in);
+}
+
+// fixed 32 byte big endian
+static void sm2p256v1_export32(uint8_t out[32], const mpz_t v) {
+    size_t l = 32;
+    uint8_t buf[32];
+    mpz_export(buf, &l, 1, 1, 0, 0, v);
+    if(!mpz_sgn(v)) {
+        l = 0;
+    }
+    memset(out, 0, 32 - l);
+    memcpy(out + (32 - l), buf, l);
+}
+
+// keystream counter and c3 hash start over for z
+static void sm2p256v1_stream_start(Sm2Stream *s) {
+    sm3_init(&s->kdf);
+    sm3_update(&s->kdf, s->z, 64);
+    sm3_init(&s->mac);
+    sm3_update(&s->mac, s->z, 32);
+    s->ct = 0;
+    s->ks_num = 32;
+}
+
+/**
+ * xor the next len bytes of the kdf(z) keystream into in and hash x2 || M, M being
+ * in when encrypting and out when decrypting. in and out may be the same buffer.
+*/
+static void sm2p256v1_stream_xor(Sm2Stream *s, const uint8_t *in, uint8_t *out, const size_t len) {
+    size_t off = 0, n;
+    uint8_t ct_bytes[4];
+    Hash32 buf;
+    Sm3Ctx ctx;
+    while(off < len) {
+        if(s->ks_num == 32) {
+            ++s->ct;
+            ct_bytes[0] = (s->ct >> 24) & 0xff;
+            ct_bytes[1] = (s->ct >> 16) & 0xff;
+            ct_bytes[2] = (s->ct >> 8) & 0xff;
+            ct_bytes[3] = s->ct & 0xff;
+
+            ctx = s->kdf;
+            sm3_update(&ctx, ct_bytes, 4);
+            sm3_final(&ctx, &buf);
+            memcpy(s->ks, buf.h, 32);
+            s->ks_num = 0;
+        }
+        n = (len - off) > (32 - s->ks_num) ? (32 - s->ks_num) : (len - off);
+        if(s->enc) {
+            sm3_update(&s->mac, in + off, n);
+        }
+        for(size_t i = 0; i < n; i++) {
+            out[off + i] = in[off + i] ^ s->ks[s->ks_num + i];
+        }
+        if(!s->enc) {
+            sm3_update(&s->mac, out + off, n);
+        }
+        s->ks_num += n;
+        off += n;
+    }
+}
+
+static void sm2p256v1_stream_c3(Sm2Stream *s, Hash32 *c3) {
+    sm3_update(&s->mac, s->z + 32, 32);
+    sm3_final(&s->mac, c3);
+}
+
+// random k, c1 = [k]G and z = x2 || y2 of [k]pk
+static void sm2p256v1_encrypt_point(const EcPublicKey *pk, uint8_t c1[65], uint8_t z[64]) {
+    uint8_t raw_k[32];
+    ec_random_k(raw_k, (uint16_t) ((int64_t) raw_k));
+    
+    size_t mark = arena_mark();
+    mpz_ptr k = arena_mpz(), kx = arena_mpz(), ky = arena_mpz(), kpx = arena_mpz(), kpy = arena_mpz();
+    mpz_ptr x = arena_mpz(), y = arena_mpz();
+    mpz_import(k, 32, 1, 1, 0, 0, raw_k);
+    mpz_import(x, 32, 1, 1, 0, 0, pk->x);
+    mpz_import(y, 32, 1, 1, 0, 0, pk->y);
+
+    ec_point_mul(kx, ky, k, _sm2p256v1->p, _sm2p256v1->a, _sm2p256v1->b, _sm2p256v1->gx, _sm2p256v1->gy);
+    ec_point_mul(kpx, kpy, k, _sm2p256v1->p, _sm2p256v1->a, _sm2p256v1->b, x, y);
+
+    c1[0] = 4;
+    sm2p256v1_export32(c1 + 1, kx);
+    sm2p256v1_export32(c1 + 33, ky);
+    sm2p256v1_export32(z, kpx);
+    sm2p256v1_export32(z + 32, kpy);
+    arena_release(mark);
+}
+
+// z = x2 || y2 of [d]c1
+static void sm2p256v1_decrypt_point(const uint8_t d_raw[32], const uint8_t c1[65], uint8_t z[64]) {
+    size_t mark = arena_mark();
+    mpz_ptr x = arena_mpz(), y = arena_mpz(), d = arena_mpz(), kx = arena_mpz(), ky = arena_mpz();
+    mpz_import(d, 32, 1, 1, 0, 0, d_raw);
+    mpz_import(kx, 32, 1, 1, 0, 0, c1+1);
+    mpz_import(ky, 32, 1, 1, 0, 0, c1+33);
+    ec_point_mul(x, y, d, _sm2p256v1->p, _sm2p256v1->a, _sm2p256v1->b, kx, ky);
+    sm2p256v1_export32(z, x);
+    sm2p256v1_export32(z + 32, y);
+    arena_release(mark);
 }
 
 void sm2p256v1_init() {
@@ -111,131 +227,229 @@ void sm2p256v1_key_gen(EcPrivateKey *sk, EcPublicKey *pk) {
 }
 
 
-void sm2p256v1_encrypt(const EcPublicKey *pk, const uint8_t *msg, const size_t msg_len, const int mode, uint8_t **out, size_t *out_len) {
-    if(!pk || !msg) {
-        return ;
+int sm2p256v1_encrypt_into(const EcPublicKey *pk, const uint8_t *msg, const size_t msg_len, const int mode, uint8_t *out, size_t *out_len) {
+    if(!pk || !msg || !out_len) {
+        return 0;
+    }
+    if(!out || *out_len < 97 + msg_len) {
+        *out_len = 97 + msg_len;
+        return 0;
     }
     
     sm2p256v1_init();
 
-    uint8_t raw_k[32];
-    ec_random_k(raw_k, (uint16_t) ((int64_t) raw_k));
-    
-    mpz_t k, kx, ky, kpx, kpy, x, y;
-    mpz_init(k);
-    mpz_init(kx);
-    mpz_init(ky);
-    mpz_init(kpx);
-    mpz_init(kpy);
-    mpz_init(x);
-    mpz_init(y);
-    mpz_import(k, 32, 1, 1, 0, 0, raw_k);
-    mpz_import(x, 32, 1, 1, 0, 0, pk->x);
-    mpz_import(y, 32, 1, 1, 0, 0, pk->y);
+    Hash32 c3;
+    Sm2Stream st;
+    st.enc = 1;
+    sm2p256v1_encrypt_point(pk, out, st.z);
+    sm2p256v1_stream_start(&st);
+    sm2p256v1_stream_xor(&st, msg, out + (SM2_C1C3C2 == mode ? 97 : 65), msg_len);
+    sm2p256v1_stream_c3(&st, &c3);
+    memcpy(SM2_C1C3C2 == mode ? out + 65 : out + (65 + msg_len), c3.h, 32);
+    *out_len = 97 + msg_len;
+    return 1;
+}
 
-    ec_point_mul(kx, ky, k, _sm2p256v1->p, _sm2p256v1->a, _sm2p256v1->b, _sm2p256v1->gx, _sm2p256v1->gy);
-    ec_point_mul(kpx, kpy, k, _sm2p256v1->p, _sm2p256v1->a, _sm2p256v1->b, x, y);
+void sm2p256v1_encrypt(const EcPublicKey *pk, const uint8_t *msg, const size_t msg_len, const int mode, uint8_t **out, size_t *out_len) {
+    if(!pk || !msg) {
+        return ;
+    }
+    *out_len = 97 + msg_len;
+    *out = archer_malloc(*out_len);
+    if(!*out) {
+        *out_len = 0;
+        return ;
+    }
+    sm2p256v1_encrypt_into(pk, msg, msg_len, mode, *out, out_len);
+}
 
-    Hash32 c3;
-    uint8_t xc[32], yc[32], c1x[32], c1y[32], *c2 = malloc(msg_len);
-    size_t lx = 32, ly = 32, c1_xl = 32, c1_yl = 32;
 
-    mpz_export(c1x, &c1_xl, 1, 1, 0, 0, kx);
-    mpz_export(c1y, &c1_yl, 1, 1, 0, 0, ky);
+int sm2p256v1_decrypt_into(const EcPrivateKey *sk, const uint8_t *cipher, const size_t cipher_len, const int mode, uint8_t *out, size_t *out_len) {
+    if(!sk || !cipher || !out_len || cipher_len <= 97) {
+        return 0;
+    }
+    if(!out || *out_len < cipher_len - 97) {
+        *out_len = cipher_len - 97;
+        return 0;
+    }
     
-    mpz_export(xc, &lx, 1, 1, 0, 0, kpx);
-    mpz_export(yc, &ly, 1, 1, 0, 0, kpy);
-
-    memcpy(c2, msg, msg_len);
-    kdf(xc, lx, yc, ly, c2, msg_len);
+    sm2p256v1_init();
     
-    *out_len = 65 + msg_len + 32;
-    *out = malloc(*out_len);
-    memset(*out, 0, *out_len);
-
-    memcpy(*out, xc + (32 - lx), lx);
-    memcpy((*out) + 32, msg, msg_len);
-    memcpy((*out) + (32 + msg_len), yc + (32 - ly), ly);
-    sm3(*out, 64 + msg_len, &c3);
-
-    memset(*out, 0, *out_len);
-    (*out)[0] = 4;
-    memcpy((*out) + 1, c1x + (32 - c1_xl), c1_xl);
-    memcpy((*out) + 33, c1y+ (32 - c1_yl), c1_yl);
-    if(SM2_C1C2C3 == mode) {
-        memcpy((*out) + 65, c2, msg_len);
-        memcpy((*out) + (65 + msg_len), c3.h, 32);
-    } else if(SM2_C1C3C2 == mode) {
-        memcpy((*out) + 65, c3.h, 32);
-        memcpy((*out) + 97, c2, msg_len);
-    }
-    free(c2);
-    mpz_clear(k);
-    mpz_clear(kx);
-    mpz_clear(ky);
-    mpz_clear(kpx);
-    mpz_clear(kpy);
-    mpz_clear(x);
-    mpz_clear(y);
-}
+    *out_len = cipher_len - 97;
+    const uint8_t *c1 = cipher, *c2, *c3;
+    if(SM2_C1C3C2 == mode) {
+        c3 = cipher + 65;
+        c2 = cipher + 97;
+    } else {
+        c2 = cipher + 65;
+        c3 = cipher + (cipher_len - 32);
+    }
 
+    Hash32 c3_cpy;
+    Sm2Stream st;
+    uint8_t diff = 0;
+    st.enc = 0;
+    sm2p256v1_decrypt_point(sk->d, c1, st.z);
+    sm2p256v1_stream_start(&st);
+    sm2p256v1_stream_xor(&st, c2, out, *out_len);
+    sm2p256v1_stream_c3(&st, &c3_cpy);
+    for(int i = 0; i < 32; i++) {
+        diff |= c3[i] ^ c3_cpy.h[i];
+    }
+    if(diff) {
+        // no plaintext leaves a failed check
+        memset(out, 0, *out_len);
+        *out_len = 0;
+        return 0;
+    }
+    return 1;
+}
 
 int sm2p256v1_decrypt(const EcPrivateKey *sk, const uint8_t *cipher, const size_t cipher_len, const int mode, uint8_t **out, size_t *out_len) {
+    *out = NULL;
+    *out_len = 0;
     if(cipher_len <= 97) {
         return 0;
     }
-    
+    *out_len = cipher_len - 97;
+    *out = archer_malloc(*out_len);
+    if(!*out || !sm2p256v1_decrypt_into(sk, cipher, cipher_len, mode, *out, out_len)) {
+        archer_free(*out);
+        *out = NULL;
+        *out_len = 0;
+        return 0;
+    }
+    return 1;
+}
+
+int sm2p256v1_stream_encrypt_init(Sm2Stream *s, const EcPublicKey *pk, const int mode, uint8_t c1[65]) {
+    if(!s || !pk || !c1 || (SM2_C1C2C3 != mode && SM2_C1C3C2 != mode)) {
+        return 0;
+    }
     sm2p256v1_init();
-    
-    int ret = 1;
-    *out_len =  cipher_len - 65 - 32;
-    *out = malloc(*out_len);
-    uint8_t c1[65], *c2 = (*out), c3[32];
-    memcpy(c1, cipher, 65);
-    if(SM2_C1C2C3 == mode) {
-        memcpy(c2, cipher + 65, cipher_len - 65 - 32);
-        memcpy(c3, cipher + (cipher_len - 32), 32);
-    } else if(SM2_C1C3C2 == mode) {
-        memcpy(c3, cipher + 65, 32);
-        memcpy(c2, cipher + 97, cipher_len - 97);
-    }
-
-    mpz_t x, y, d, kx, ky;
-    mpz_init(x);
-    mpz_init(y);
-    mpz_init(d);
-    mpz_init(kx);
-    mpz_init(ky);
-    mpz_import(d, 32, 1, 1, 0, 0, sk->d);
-    mpz_import(kx, 32, 1, 1, 0, 0, c1+1);
-    mpz_import(ky, 32, 1, 1, 0, 0, c1+33);
-    ec_point_mul(x, y, d, _sm2p256v1->p, _sm2p256v1->a, _sm2p256v1->b, kx, ky);
 
-    Hash32 c3_cpy;
-    uint8_t xc[32], yc[32], *hash_in = malloc(64 + *out_len);
-    size_t lx = 32, ly = 32;
-    mpz_export(xc, &lx, 1, 1, 0, 0, x);
-    mpz_export(yc, &ly, 1, 1, 0, 0, y);
+    memset(s, 0, sizeof(Sm2Stream));
+    s->mode = mode;
+    s->enc = 1;
+    sm2p256v1_encrypt_point(pk, c1, s->z);
+    sm2p256v1_stream_start(s);
+    return 1;
+}
 
-    kdf(xc, lx, yc, ly, c2, *out_len);
-    memcpy(hash_in, xc+(32-lx), lx);
-    memcpy(hash_in + 32, c2, *out_len);
-    memcpy(hash_in + (32 + *out_len), yc+(32-lx), ly);
+int sm2p256v1_stream_decrypt_init(Sm2Stream *s, const EcPrivateKey *sk, const int mode, const int release) {
+    if(!s || !sk || (SM2_C1C2C3 != mode && SM2_C1C3C2 != mode)) {
+        return 0;
+    }
+    sm2p256v1_init();
 
-    sm3(hash_in, 64 + *out_len, &c3_cpy);
-    for(int i = 0; i < 32; i++) {
-        if(c3[i] != c3_cpy.h[i]) {
-            ret = 0;
-            break ;
+    memset(s, 0, sizeof(Sm2Stream));
+    s->mode = mode;
+    s->release = release;
+    s->sk = *sk;
+    return 1;
+}
+
+// plaintext goes to out, or to the held buffer until c3 is checked
+static int sm2p256v1_stream_plain(Sm2Stream *s, const uint8_t *in, const size_t len, uint8_t *out, size_t *out_len) {
+    if(s->release) {
+        sm2p256v1_stream_xor(s, in, out + *out_len, len);
+        *out_len += len;
+        return 1;
+    }
+    if(s->held_len + len > s->held_cap) {
+        size_t cap = s->held_cap ? s->held_cap : 4096;
+        while(cap < s->held_len + len) {
+            cap <<= 1;
+        }
+        uint8_t *held = (uint8_t *)archer_malloc(cap);
+        if(!held) {
+            return 0;
         }
+        if(s->held) {
+            memcpy(held, s->held, s->held_len);
+            archer_free(s->held);
+        }
+        s->held = held;
+        s->held_cap = cap;
+    }
+    sm2p256v1_stream_xor(s, in, s->held + s->held_len, len);
+    s->held_len += len;
+    return 1;
+}
+
+int sm2p256v1_stream_update(Sm2Stream *s, const uint8_t *in, const size_t in_len, uint8_t *out, size_t *out_len) {
+    size_t off = 0, head = SM2_C1C3C2 == s->mode ? 97 : 65;
+
+    *out_len = 0;
+    if(s->enc) {
+        sm2p256v1_stream_xor(s, in, out, in_len);
+        *out_len = in_len;
+        return 1;
     }
-    free(hash_in);
-    mpz_clear(x);
-    mpz_clear(y);
-    mpz_clear(d);
-    mpz_clear(kx);
-    mpz_clear(ky);
+    if(s->head_num < head) {
+        off = (head - s->head_num) < in_len ? (head - s->head_num) : in_len;
+        memcpy(s->head + s->head_num, in, off);
+        s->head_num += off;
+        if(s->head_num < head) {
+            return 1;
+        }
+        if(s->head[0] != 4) {
+            return 0;
+        }
+        sm2p256v1_decrypt_point(s->sk.d, s->head, s->z);
+        sm2p256v1_stream_start(s);
+    }
+    in += off;
+    size_t rem = in_len - off;
+    if(SM2_C1C3C2 == s->mode) {
+        return sm2p256v1_stream_plain(s, in, rem, out, out_len);
+    }
+
+    // c1c2c3: the last 32 bytes seen so far may be c3, keep them back
+    if(s->tail_num + rem <= 32) {
+        memcpy(s->tail + s->tail_num, in, rem);
+        s->tail_num += rem;
+        return 1;
+    }
+    size_t k = s->tail_num + rem - 32, from_tail = k < s->tail_num ? k : s->tail_num;
+    if(!sm2p256v1_stream_plain(s, s->tail, from_tail, out, out_len) || 
+        !sm2p256v1_stream_plain(s, in, k - from_tail, out, out_len)) {
+        return 0;
+    }
+    memmove(s->tail, s->tail + from_tail, s->tail_num - from_tail);
+    s->tail_num -= from_tail;
+    memcpy(s->tail + s->tail_num, in + (k - from_tail), 32 - s->tail_num);
+    s->tail_num = 32;
+    return 1;
+}
 
+void sm2p256v1_stream_encrypt_final(Sm2Stream *s, uint8_t c3[32]) {
+    Hash32 h;
+    sm2p256v1_stream_c3(s, &h);
+    memcpy(c3, h.h, 32);
+}
+
+int sm2p256v1_stream_decrypt_final(Sm2Stream *s, uint8_t **out, size_t *out_len) {
+    Hash32 h;
+    uint8_t diff = 0, *c3 = SM2_C1C3C2 == s->mode ? s->head + 65 : s->tail;
+    int ret = s->head_num == (SM2_C1C3C2 == s->mode ? 97 : 65) && (SM2_C1C3C2 == s->mode || s->tail_num == 32);
+
+    if(ret) {
+        sm2p256v1_stream_c3(s, &h);
+        for(int i = 0; i < 32; i++) {
+            diff |= c3[i] ^ h.h[i];
+        }
+        ret = !diff;
+    }
+    if(!s->release && ret && out && out_len) {
+        *out = s->held;
+        *out_len = s->held_len;
+    } else if(s->held) {
+        memset(s->held, 0, s->held_len);
+        archer_free(s->held);
+    }
+    s->held = NULL;
+    s->held_len = s->held_cap = 0;
     return ret;
 }
 
@@ -246,10 +460,8 @@ void sm2p256v1_privateKey_to_publicKey(const EcPrivateKey *sk, EcPublicKey *pk)
 
     sm2p256v1_init();
 
-    mpz_t x, y, d;
-    mpz_init(x);
-    mpz_init(y);
-    mpz_init(d);
+    size_t mark = arena_mark();
+    mpz_ptr x = arena_mpz(), y = arena_mpz(), d = arena_mpz();
     mpz_import(d, 32, 1, 1, 0, 0, sk->d);
     ec_point_mul(x, y, d, _sm2p256v1->p, _sm2p256v1->a, _sm2p256v1->b, _sm2p256v1->gx, _sm2p256v1->gy);
     
@@ -263,9 +475,7 @@ void sm2p256v1_privateKey_to_publicKey(const EcPrivateKey *sk, EcPublicKey *pk)
     memcpy(pk->x + (32 - lx), xc, lx);
     memcpy(pk->y + (32 - ly), yc, ly);
 
-    mpz_clear(x);
-    mpz_clear(y);
-    mpz_clear(d);
+    arena_release(mark);
 }
 
 void sm2p256v1_sign(const EcPrivateKey *sk, const uint8_t *msg, const size_t msg_len, EcSignature *sig) {
@@ -280,12 +490,9 @@ void sm2p256v1_sign(const EcPrivateKey *sk, const uint8_t *msg, const size_t msg
     sm2p256v1_privateKey_to_publicKey(sk, &pk);
     sm2p256v1_get_za(pk.x, pk.y, msg, msg_len, &za);
 
-    mpz_t d, e, r, s;
-    mpz_init(r);
-    mpz_init(s);
+    size_t mark = arena_mark();
+    mpz_ptr d = arena_mpz(), e = arena_mpz(), r = arena_mpz(), s = arena_mpz();
 
-    mpz_init(d);
-    mpz_init(e);
     mpz_import(d, 32, 1, 1, 0, 0, sk->d);
     mpz_import(e, 32, 1, 1, 0, 0, za.h);
 
@@ -301,10 +508,7 @@ void sm2p256v1_sign(const EcPrivateKey *sk, const uint8_t *msg, const size_t msg
     memcpy(sig->r + (32 - lr),rc, lr);
     memcpy(sig->s + (32 - ls), sc, ls);
 
-    mpz_clear(r);
-    mpz_clear(s);
-    mpz_clear(d);
-    mpz_clear(e);
+    arena_release(mark);
 }
 
 
@@ -319,16 +523,9 @@ int sm2p256v1_verify(const EcPublicKey *pk, const uint8_t *msg, const size_t msg
     Hash32 za;
     sm2p256v1_get_za(pk->x, pk->y, msg, msg_len, &za);
 
-    mpz_t x, y, e, r, s, b0x, b0y, b1x, b1y;
-    mpz_init(x);
-    mpz_init(y);
-    mpz_init(e);
-    mpz_init(r);
-    mpz_init(s);
-    mpz_init(b0x);
-    mpz_init(b0y);
-    mpz_init(b1x);
-    mpz_init(b1y);
+    size_t mark = arena_mark();
+    mpz_ptr x = arena_mpz(), y = arena_mpz(), e = arena_mpz(), r = arena_mpz(), s = arena_mpz();
+    mpz_ptr b0x = arena_mpz(), b0y = arena_mpz(), b1x = arena_mpz(), b1y = arena_mpz();
 
     mpz_import(x, 32, 1, 1, 0, 0, pk->x);
     mpz_import(y, 32, 1, 1, 0, 0, pk->y);
@@ -345,15 +542,147 @@ int sm2p256v1_verify(const EcPublicKey *pk, const uint8_t *msg, const size_t msg
     mpz_mod(x, x, _sm2p256v1->n);
     ret = !(mpz_cmp(x, r));
 
-    mpz_clear(x);
-    mpz_clear(y);
-    mpz_clear(e);
-    mpz_clear(r);
-    mpz_clear(s);
-    mpz_clear(b0x);
-    mpz_clear(b0y);
-    mpz_clear(b1x);
-    mpz_clear(b1y);
+    arena_release(mark);
 
     return ret;
-}
\ No newline at end of file
+}
+
+// y^2 = x^3 + ax + b
+static int sm2p256v1_on_curve(const mpz_t x, const mpz_t y) {
+    size_t mark = arena_mark();
+    mpz_ptr l = arena_mpz(), r = arena_mpz();
+    int ret = mpz_cmp(x, _sm2p256v1->p) < 0 && mpz_cmp(y, _sm2p256v1->p) < 0;
+
+    mpz_mul(l, y, y);
+    mpz_mod(l, l, _sm2p256v1->p);
+    mpz_mul(r, x, x);
+    mpz_add(r, r, _sm2p256v1->a);
+    mpz_mul(r, r, x);
+    mpz_add(r, r, _sm2p256v1->b);
+    mpz_mod(r, r, _sm2p256v1->p);
+    ret &= !mpz_cmp(l, r);
+
+    arena_release(mark);
+    return ret;
+}
+
+int sm2p256v1_exchange_init(Sm2Exchange *ctx, const int initiator, const EcPrivateKey *sk, const EcPublicKey *pk, const uint8_t *id, const size_t id_len, 
+                    const EcPublicKey *peer_pk, const uint8_t *peer_id, const size_t peer_id_len, EcPublicKey *r) {
+    if(!ctx || !sk || !pk || !peer_pk || !r || id_len > 8191 || peer_id_len > 8191) {
+        return 0;
+    }
+
+    sm2p256v1_init();
+
+    ctx->initiator = initiator;
+    ctx->sk = *sk;
+    ctx->peer = *peer_pk;
+    sm2p256v1_get_z(id, id_len, pk->x, pk->y, initiator ? &ctx->za : &ctx->zb);
+    sm2p256v1_get_z(peer_id, peer_id_len, peer_pk->x, peer_pk->y, initiator ? &ctx->zb : &ctx->za);
+
+    size_t mark = arena_mark();
+    mpz_ptr k = arena_mpz(), x = arena_mpz(), y = arena_mpz();
+    // r uniform in [1, n-1], redrawn until it lands there
+    do {
+        if(!archer_entropy(ctx->r.d, 32)) {
+            arena_release(mark);
+            return 0;
+        }
+        mpz_import(k, 32, 1, 1, 0, 0, ctx->r.d);
+    } while(!mpz_sgn(k) || mpz_cmp(k, _sm2p256v1->n) >= 0);
+    ec_point_mul(x, y, k, _sm2p256v1->p, _sm2p256v1->a, _sm2p256v1->b, _sm2p256v1->gx, _sm2p256v1->gy);
+    sm2p256v1_export32(ctx->rp.x, x);
+    sm2p256v1_export32(ctx->rp.y, y);
+    *r = ctx->rp;
+
+    arena_release(mark);
+    return 1;
+}
+
+// 2^w + (x & (2^w - 1)), w = 127
+static void sm2p256v1_x_bar(mpz_t out, const uint8_t x[32]) {
+    mpz_import(out, 32, 1, 1, 0, 0, x);
+    mpz_tdiv_r_2exp(out, out, 127);
+    mpz_setbit(out, 127);
+}
+
+int sm2p256v1_exchange_key(Sm2Exchange *ctx, const EcPublicKey *peer_r, uint8_t *key, const size_t key_len, uint8_t s_send[32], uint8_t s_check[32]) {
+    if(!ctx || !peer_r || !key) {
+        return 0;
+    }
+
+    sm2p256v1_init();
+
+    size_t mark = arena_mark();
+    mpz_ptr t = arena_mpz(), k = arena_mpz(), rx = arena_mpz(), ry = arena_mpz(), px = arena_mpz();
+    mpz_ptr py = arena_mpz(), ux = arena_mpz(), uy = arena_mpz();
+
+    mpz_import(rx, 32, 1, 1, 0, 0, peer_r->x);
+    mpz_import(ry, 32, 1, 1, 0, 0, peer_r->y);
+    if(!sm2p256v1_on_curve(rx, ry)) {
+        arena_release(mark);
+        return 0;
+    }
+
+    // t = (d + x_bar * r) mod n
+    sm2p256v1_x_bar(t, ctx->rp.x);
+    mpz_import(k, 32, 1, 1, 0, 0, ctx->r.d);
+    mpz_mul(t, t, k);
+    mpz_import(k, 32, 1, 1, 0, 0, ctx->sk.d);
+    mpz_add(t, t, k);
+    mpz_mod(t, t, _sm2p256v1->n);
+
+    // U = [t](P_peer + [x_bar_peer]R_peer), O when t = 0 or P_peer = -[x_bar_peer]R_peer.
+    // the sum is a point of order n otherwise, so [t] of it with 0 < t < n is never O
+    sm2p256v1_x_bar(k, peer_r->x);
+    ec_point_mul(ux, uy, k, _sm2p256v1->p, _sm2p256v1->a, _sm2p256v1->b, rx, ry);
+    mpz_import(px, 32, 1, 1, 0, 0, ctx->peer.x);
+    mpz_import(py, 32, 1, 1, 0, 0, ctx->peer.y);
+    if(!mpz_sgn(t) || !mpz_cmp(px, ux)) {
+        arena_release(mark);
+        return 0;
+    }
+    ec_point_add(rx, ry, px, py, ux, uy, _sm2p256v1->p);
+    ec_point_mul(ux, uy, t, _sm2p256v1->p, _sm2p256v1->a, _sm2p256v1->b, rx, ry);
+
+    // K = KDF(xU || yU || ZA || ZB, klen)
+    uint8_t z[128];
+    sm2p256v1_export32(z, ux);
+    sm2p256v1_export32(z + 32, uy);
+    memcpy(z + 64, ctx->za.h, 32);
+    memcpy(z + 96, ctx->zb.h, 32);
+    memset(key, 0, key_len);
+    kdf(z, 128, key, key_len);
+
+    // S = SM3(tag || yU || SM3(xU || ZA || ZB || x1 || y1 || x2 || y2)), tag 0x02 from the responder, 0x03 from the initiator
+    if(s_send || s_check) {
+        const EcPublicKey *ra = ctx->initiator ? &ctx->rp : peer_r, *rb = ctx->initiator ? peer_r : &ctx->rp;
+        uint8_t tag;
+        Hash32 inner, s2, s3;
+        Sm3Ctx sm3_ctx;
+        sm3_init(&sm3_ctx);
+        sm3_update(&sm3_ctx, z, 32);
+        sm3_update(&sm3_ctx, z + 64, 64);
+        sm3_update(&sm3_ctx, ra->x, 32);
+        sm3_update(&sm3_ctx, ra->y, 32);
+        sm3_update(&sm3_ctx, rb->x, 32);
+        sm3_update(&sm3_ctx, rb->y, 32);
+        sm3_final(&sm3_ctx, &inner);
+        for(tag = 2; tag <= 3; tag++) {
+            sm3_init(&sm3_ctx);
+            sm3_update(&sm3_ctx, &tag, 1);
+            sm3_update(&sm3_ctx, z + 32, 32);
+            sm3_update(&sm3_ctx, inner.h, 32);
+            sm3_final(&sm3_ctx, tag == 2 ? &s2 : &s3);
+        }
+        if(s_send) {
+            memcpy(s_send, ctx->initiator ? s3.h : s2.h, 32);
+        }
+        if(s_check) {
+            memcpy(s_check, ctx->initiator ? s2.h : s3.h, 32);
+        }
+    }
+
+    arena_release(mark);
+    return 1;
+}
@@ -9,6 +9,13 @@ void sm2p256v1_init();
 void sm2p256v1_key_gen(EcPrivateKey *sk, EcPublicKey *pk);
 void sm2p256v1_encrypt(const EcPublicKey *pk, const uint8_t *msg, const size_t msg_len, const int mode, uint8_t **out, size_t *out_len);
 int sm2p256v1_decrypt(const EcPrivateKey *sk, const uint8_t *cipher, const size_t cipher_len, const int mode, uint8_t **out, size_t *out_len);
+int sm2p256v1_encrypt_into(const EcPublicKey *pk, const uint8_t *msg, const size_t msg_len, const int mode, uint8_t *out, size_t *out_len);
+int sm2p256v1_decrypt_into(const EcPrivateKey *sk, const uint8_t *cipher, const size_t cipher_len, const int mode, uint8_t *out, size_t *out_len);
+int sm2p256v1_stream_encrypt_init(Sm2Stream *s, const EcPublicKey *pk, const int mode, uint8_t c1[65]);
+int sm2p256v1_stream_decrypt_init(Sm2Stream *s, const EcPrivateKey *sk, const int mode, const int release);
+int sm2p256v1_stream_update(Sm2Stream *s, const uint8_t *in, const size_t in_len, uint8_t *out, size_t *out_len);
+void sm2p256v1_stream_encrypt_final(Sm2Stream *s, uint8_t c3[32]);
+int sm2p256v1_stream_decrypt_final(Sm2Stream *s, uint8_t **out, size_t *out_len);
 
 // sm2 sign algorithm
 // void sm2p256v1_init();
@@ -16,4 +23,9 @@ void sm2p256v1_privateKey_to_publicKey(const EcPrivateKey *sk, EcPublicKey *pk);
 void sm2p256v1_sign(const EcPrivateKey *sk, const uint8_t *msg, const size_t msg_len, EcSignature *sig);
 int sm2p256v1_verify(const EcPublicKey *pk, const uint8_t *msg, const size_t msg_len, const EcSignature *sig);
 
+// sm2 key exchange
+int sm2p256v1_exchange_init(Sm2Exchange *ctx, const int initiator, const EcPrivateKey *sk, const EcPublicKey *pk, const uint8_t *id, const size_t id_len, 
+                    const EcPublicKey *peer_pk, const uint8_t *peer_id, const size_t peer_id_len, EcPublicKey *r);
+int sm2p256v1_exchange_key(Sm2Exchange *ctx, const EcPublicKey *peer_r, uint8_t *key, const size_t key_len, uint8_t s_send[32], uint8_t s_check[32]);
+
 #endif
\ No newline at end of file
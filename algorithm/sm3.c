@@ -12,19 +12,32 @@
 #define P2(a) (a^SM3_ROTL(a,15)^SM3_ROTL(a,23))
 #define SM3_ENDIAN32(a) (((a&0xff)<<24)|(((a>>8)&0xff)<<16)|(((a>>16)&0xff)<<8)|((a>>24)&0xff))
 
+// T[i] <<< (i mod 32), rotating by i >= 32 directly is undefined
+static const uint32_t SM3_T[64] = {
+    0x79cc4519, 0xf3988a32, 0xe7311465, 0xce6228cb,
+    0x9cc45197, 0x3988a32f, 0x7311465e, 0xe6228cbc,
+    0xcc451979, 0x988a32f3, 0x311465e7, 0x6228cbce,
+    0xc451979c, 0x88a32f39, 0x11465e73, 0x228cbce6,
+    0x9d8a7a87, 0x3b14f50f, 0x7629ea1e, 0xec53d43c,
+    0xd8a7a879, 0xb14f50f3, 0x629ea1e7, 0xc53d43ce,
+    0x8a7a879d, 0x14f50f3b, 0x29ea1e76, 0x53d43cec,
+    0xa7a879d8, 0x4f50f3b1, 0x9ea1e762, 0x3d43cec5,
+    0x7a879d8a, 0xf50f3b14, 0xea1e7629, 0xd43cec53,
+    0xa879d8a7, 0x50f3b14f, 0xa1e7629e, 0x43cec53d,
+    0x879d8a7a, 0x0f3b14f5, 0x1e7629ea, 0x3cec53d4,
+    0x79d8a7a8, 0xf3b14f50, 0xe7629ea1, 0xcec53d43,
+    0x9d8a7a87, 0x3b14f50f, 0x7629ea1e, 0xec53d43c,
+    0xd8a7a879, 0xb14f50f3, 0x629ea1e7, 0xc53d43ce,
+    0x8a7a879d, 0x14f50f3b, 0x29ea1e76, 0x53d43cec,
+    0xa7a879d8, 0x4f50f3b1, 0x9ea1e762, 0x3d43cec5,
+};
+
 
 static int sm3CF(uint32_t *in, uint32_t *hash) {
     uint32_t W[68], W1[64];
     uint32_t a = hash[0], b = hash[1], c = hash[2], d = hash[3];
     uint32_t e = hash[4], f = hash[5], g = hash[6], h = hash[7];
     uint32_t ss1, ss2, tt1, tt2;
-    uint32_t T[64];
-    for(int i = 0; i < 16; i++) {
-        T[i] = 0x79cc4519;
-    }
-    for(int i = 16; i < 64; i++) {
-        T[i] = 0x7a879d8a;
-    }
 
     for(int i = 0; i < 16; i++) {
         W[i] = SM3_ENDIAN32(in[i]);;
@@ -36,7 +49,7 @@ static int sm3CF(uint32_t *in, uint32_t *hash) {
         W1[i] = W[i] ^ W[i + 4];
     }
     for(int i = 0; i < 64; i++) {
-        ss1 = SM3_ROTL((SM3_ROTL(a, (uint32_t)12) + e + SM3_ROTL(T[i], (uint32_t)i)), (uint32_t)7);
+        ss1 = SM3_ROTL((SM3_ROTL(a, (uint32_t)12) + e + SM3_T[i]), (uint32_t)7);
         ss2 = ss1 ^ SM3_ROTL(a, (uint32_t)12);
         if(i >= 0 && i <= 15) {
             tt1 = FF1(a, b, c) + d + ss2 + W1[i];
@@ -68,49 +81,74 @@ static int sm3CF(uint32_t *in, uint32_t *hash) {
     return 1;
 }
 
-void sm3(const uint8_t *content, const size_t content_len,  Hash32 *hash) {
+void sm3_init(Sm3Ctx *ctx) {
     uint32_t hash_base[] = {0x7380166f, 0x4914b2b9, 0x172442d7, 0xda8a0600, 
                 0xa96f30bc, 0x163138aa, 0xe38dee4d, 0xb0fb0e4e};
+    memcpy(ctx->digest, hash_base, sizeof(hash_base));
+    ctx->num = 0;
+    ctx->nblocks = 0;
+}
+
+void sm3_update(Sm3Ctx *ctx, const uint8_t *in, const size_t in_len) {
     uint32_t buf[SM3_BLOCK_SIZE >> 2];
-    uint32_t count = 0, offset = 0, len = content_len;
+    size_t len = in_len;
+    if(ctx->num) {
+        size_t l = SM3_BLOCK_SIZE - ctx->num;
+        if(len < l) {
+            memcpy(ctx->block + ctx->num, in, len);
+            ctx->num += len;
+            return ;
+        }
+        memcpy(ctx->block + ctx->num, in, l);
+        memcpy(buf, ctx->block, SM3_BLOCK_SIZE);
+        sm3CF(buf, ctx->digest);
+        ctx->nblocks++;
+        in += l;
+        len -= l;
+    }
     while(len >= SM3_BLOCK_SIZE) {
-        memcpy(buf, &content[offset], SM3_BLOCK_SIZE);
+        memcpy(buf, in, SM3_BLOCK_SIZE);
+        sm3CF(buf, ctx->digest);
+        ctx->nblocks++;
+        in += SM3_BLOCK_SIZE;
         len -= SM3_BLOCK_SIZE;
-        offset += SM3_BLOCK_SIZE;
-        count++;
-
-        sm3CF(buf, hash_base);
     }
+    ctx->num = len;
+    if(len) {
+        memcpy(ctx->block, in, len);
+    }
+}
 
-    int32_t k = 448 - (8 * len + 1) % 512;
-    if(k < 0) {
-        k = 960 - (8 * len + 1) % 512;
+void sm3_final(Sm3Ctx *ctx, Hash32 *hash) {
+    uint32_t buf[SM3_BLOCK_SIZE >> 2];
+    uint64_t count_len = (ctx->nblocks * SM3_BLOCK_SIZE + ctx->num) * 8;
+
+    ctx->block[ctx->num] = 0x80;
+    if(ctx->num + 9 <= SM3_BLOCK_SIZE) {
+        memset(ctx->block + ctx->num + 1, 0, SM3_BLOCK_SIZE - ctx->num - 9);
+    } else {
+        memset(ctx->block + ctx->num + 1, 0, SM3_BLOCK_SIZE - ctx->num - 1);
+        memcpy(buf, ctx->block, SM3_BLOCK_SIZE);
+        sm3CF(buf, ctx->digest);
+        memset(ctx->block, 0, SM3_BLOCK_SIZE - 8);
     }
-    k++;
-    uint64_t count_len = (len * 8) + count * (SM3_BLOCK_SIZE * 8);
-    uint32_t rest_len = len + k / 8 + SM3_BLOCK_SIZE / 8;
-    uint8_t rest[rest_len];
-    memset(rest, 0, rest_len);
-    memcpy(rest, &content[offset], len);
-    rest[len] = 0x80;
     for(int i = 1; i <= 8; i++) {
-        rest[rest_len - i] = (count_len >> ((i - 1) * 8)) & 0xff;
-    }
-    offset = 0;
-    while(rest_len >= SM3_BLOCK_SIZE) {
-        memcpy(buf, &rest[offset], SM3_BLOCK_SIZE);
-        rest_len -= SM3_BLOCK_SIZE;
-        offset += SM3_BLOCK_SIZE;
-
-        sm3CF(buf, hash_base);
+        ctx->block[SM3_BLOCK_SIZE - i] = (count_len >> ((i - 1) * 8)) & 0xff;
     }
+    memcpy(buf, ctx->block, SM3_BLOCK_SIZE);
+    sm3CF(buf, ctx->digest);
 
     for(int i = 0; i < 8; i++) {
-        hash->h[i*4] = (hash_base[i] >> 24)&0xff;
-        hash->h[i*4+1] = (hash_base[i] >> 16)&0xff;
-        hash->h[i*4+2] = (hash_base[i] >> 8)&0xff;
-        hash->h[i*4+3] = hash_base[i] & 0xff;
+        hash->h[i*4] = (ctx->digest[i] >> 24)&0xff;
+        hash->h[i*4+1] = (ctx->digest[i] >> 16)&0xff;
+        hash->h[i*4+2] = (ctx->digest[i] >> 8)&0xff;
+        hash->h[i*4+3] = ctx->digest[i] & 0xff;
     }
 }
 
-
+void sm3(const uint8_t *content, const size_t content_len,  Hash32 *hash) {
+    Sm3Ctx ctx;
+    sm3_init(&ctx);
+    sm3_update(&ctx, content, content_len);
+    sm3_final(&ctx, hash);
+}
@@ -4,5 +4,8 @@
 #include "archer.h"
 
 void sm3(const uint8_t *content, const size_t content_len, Hash32 *hash);
+void sm3_init(Sm3Ctx *ctx);
+void sm3_update(Sm3Ctx *ctx, const uint8_t *in, const size_t in_len);
+void sm3_final(Sm3Ctx *ctx, Hash32 *hash);
 
 #endif
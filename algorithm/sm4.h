@@ -6,5 +6,35 @@
 // pkcs#7 padding
 void sm4_encrypt(const uint8_t user_key[16], const uint8_t *in, const size_t in_size, uint8_t **out, size_t *out_size);
 int sm4_decrypt(const uint8_t user_key[16], const uint8_t *in, const size_t in_size, uint8_t **out, size_t *out_size);
+int sm4_encrypt_into(const uint8_t user_key[16], const uint8_t *in, const size_t in_size, uint8_t *out, size_t *out_size);
+int sm4_decrypt_into(const uint8_t user_key[16], const uint8_t *in, const size_t in_size, uint8_t *out, size_t *out_size);
+
+// ctr (128-bit big endian counter) and gcm, no padding
+void sm4_ctr_encrypt(const uint8_t user_key[16], const uint8_t iv[16], const uint8_t *in, const size_t in_size, uint8_t *out);
+void sm4_ctr_decrypt(const uint8_t user_key[16], const uint8_t iv[16], const uint8_t *in, const size_t in_size, uint8_t *out);
+void sm4_gcm_encrypt(const uint8_t user_key[16], const uint8_t *iv, const size_t iv_len, const uint8_t *aad, const size_t aad_len, 
+                    const uint8_t *in, const size_t in_size, uint8_t *out, uint8_t tag[16]);
+int sm4_gcm_decrypt(const uint8_t user_key[16], const uint8_t *iv, const size_t iv_len, const uint8_t *aad, const size_t aad_len, 
+                    const uint8_t *in, const size_t in_size, const uint8_t tag[16], uint8_t *out);
+
+// split large ecb/ctr inputs over threads
+void sm4_set_parallel(int threads, size_t threshold, int pin_cpus);
+
+// expanded key, reused across calls
+void sm4_key_init(Sm4Key *key, const uint8_t user_key[16]);
+int sm4_key_encrypt_into(const Sm4Key *key, const uint8_t *in, const size_t in_size, uint8_t *out, size_t *out_size);
+int sm4_key_decrypt_into(const Sm4Key *key, const uint8_t *in, const size_t in_size, uint8_t *out, size_t *out_size);
+void sm4_key_ctr_encrypt(const Sm4Key *key, const uint8_t iv[16], const uint8_t *in, const size_t in_size, uint8_t *out);
+void sm4_key_gcm_encrypt(const Sm4Key *key, const uint8_t *iv, const size_t iv_len, const uint8_t *aad, const size_t aad_len, 
+                    const uint8_t *in, const size_t in_size, uint8_t *out, uint8_t tag[16]);
+int sm4_key_gcm_decrypt(const Sm4Key *key, const uint8_t *iv, const size_t iv_len, const uint8_t *aad, const size_t aad_len, 
+                    const uint8_t *in, const size_t in_size, const uint8_t tag[16], uint8_t *out);
+
+// streaming cbc (pkcs#7) / ctr / gcm, constant memory
+int sm4_stream_init(Sm4Stream *s, const int mode, const int enc, const uint8_t user_key[16], const uint8_t *iv, const size_t iv_len);
+int sm4_stream_aad(Sm4Stream *s, const uint8_t *aad, const size_t aad_len);
+int sm4_stream_update(Sm4Stream *s, const uint8_t *in, const size_t in_len, uint8_t *out, size_t *out_len);
+int sm4_stream_final(Sm4Stream *s, uint8_t *out, size_t *out_len, uint8_t tag[16]);
+int sm4_stream_fd(Sm4Stream *s, const int in_fd, const int out_fd, uint8_t tag[16]);
 
 #endif
\ No newline at end of file
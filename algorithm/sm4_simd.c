@@ -0,0 +1,281 @@
+#include "sm4_simd.h"
+
+/**
+ * the sm4 s-box is affine equivalent to the aes one, both being inversion in GF(2^8):
+ * S(x) = post(aesenclast(pre(x), 0x0f)), pre/post are 8x8 bit matrices applied as
+ * two 16-entry nibble lookups with pshufb. aesenclast also runs ShiftRows, which is
+ * undone by the byte shuffles of the linear transform.
+ *
+ * blocks are transposed so that each 32-bit lane holds the same word of a different
+ * block, 4 blocks per 128 bits, and every round works on all of them at once.
+*/
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#include <immintrin.h>
+
+#define SM4_SIMD_X86
+
+#define SM4_PRE_LO   0x078B37BB820EB23EULL, 0x9814A8241D912DA1ULL
+#define SM4_PRE_HI   0x37EB19C5F22EDC00ULL, 0x3FE311CDFA26D408ULL
+#define SM4_POST_LO  0x0BB3C179358DFF47ULL, 0x6CD4A61E52EA9820ULL
+#define SM4_POST_HI  0x2DCD7D9DB050E000ULL, 0xED0DBD5D709020C0ULL
+
+static const uint8_t SM4_SHUF[5][16] = {
+    // inverse ShiftRows
+    {0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3},
+    // inverse ShiftRows then rotate every word left by 8, 16, 24
+    {7, 0, 13, 10, 11, 4, 1, 14, 15, 8, 5, 2, 3, 12, 9, 6},
+    {10, 7, 0, 13, 14, 11, 4, 1, 2, 15, 8, 5, 6, 3, 12, 9},
+    {13, 10, 7, 0, 1, 14, 11, 4, 5, 2, 15, 8, 9, 6, 3, 12},
+    // big endian words
+    {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+};
+
+
+/**
+ * AES-NI, 8 blocks per call as two groups of 4 so two aesenclast chains are in flight.
+*/
+typedef struct {
+    __m128i pre_lo, pre_hi, post_lo, post_hi, m4, isr, r8, r16, r24, bswap;
+} Sm4Xmm;
+
+#define SM4_XMM_TARGET __attribute__((target("aes,ssse3")))
+#define SM4_XMM_CONST(c) SM4_XMM_CONST_(c)
+#define SM4_XMM_CONST_(lo, hi) _mm_set_epi64x(hi, lo)
+
+SM4_XMM_TARGET
+static inline __m128i sm4_xmm_affine(__m128i x, __m128i lo, __m128i hi, __m128i m4) {
+    __m128i t = _mm_srli_epi32(_mm_andnot_si128(m4, x), 4);
+    return _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(x, m4)), _mm_shuffle_epi8(hi, t));
+}
+
+// s0 ^= L(S(s1 ^ s2 ^ s3 ^ rk))
+SM4_XMM_TARGET
+static inline __m128i sm4_xmm_round(const Sm4Xmm *c, __m128i rk, __m128i s0, __m128i s1, __m128i s2, __m128i s3) {
+    __m128i x, y, t;
+
+    x = _mm_xor_si128(_mm_xor_si128(s1, s2), _mm_xor_si128(s3, rk));
+    x = sm4_xmm_affine(x, c->pre_lo, c->pre_hi, c->m4);
+    x = _mm_aesenclast_si128(x, c->m4);
+    x = sm4_xmm_affine(x, c->post_lo, c->post_hi, c->m4);
+
+    y = _mm_shuffle_epi8(x, c->isr);
+    t = _mm_xor_si128(y, _mm_shuffle_epi8(x, c->r8));
+    t = _mm_xor_si128(t, _mm_shuffle_epi8(x, c->r16));
+    s0 = _mm_xor_si128(s0, y);
+    s0 = _mm_xor_si128(s0, _mm_shuffle_epi8(x, c->r24));
+    s0 = _mm_xor_si128(s0, _mm_slli_epi32(t, 2));
+    return _mm_xor_si128(s0, _mm_srli_epi32(t, 30));
+}
+
+SM4_XMM_TARGET
+static inline void sm4_xmm_transpose(__m128i *x0, __m128i *x1, __m128i *x2, __m128i *x3) {
+    __m128i t0 = _mm_unpacklo_epi32(*x0, *x1);
+    __m128i t1 = _mm_unpacklo_epi32(*x2, *x3);
+    __m128i t2 = _mm_unpackhi_epi32(*x0, *x1);
+    __m128i t3 = _mm_unpackhi_epi32(*x2, *x3);
+    *x0 = _mm_unpacklo_epi64(t0, t1);
+    *x1 = _mm_unpackhi_epi64(t0, t1);
+    *x2 = _mm_unpacklo_epi64(t2, t3);
+    *x3 = _mm_unpackhi_epi64(t2, t3);
+}
+
+SM4_XMM_TARGET
+static inline void sm4_xmm_load(const Sm4Xmm *c, const uint8_t *in, __m128i *x) {
+    for (int i = 0; i < 4; i++) {
+        x[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (in + 16 * i)), c->bswap);
+    }
+    sm4_xmm_transpose(&x[0], &x[1], &x[2], &x[3]);
+}
+
+SM4_XMM_TARGET
+static inline void sm4_xmm_store(const Sm4Xmm *c, __m128i *x, uint8_t *out) {
+    sm4_xmm_transpose(&x[3], &x[2], &x[1], &x[0]);
+    for (int i = 0; i < 4; i++) {
+        _mm_storeu_si128((__m128i *) (out + 16 * i), _mm_shuffle_epi8(x[3 - i], c->bswap));
+    }
+}
+
+SM4_XMM_TARGET
+static size_t sm4_aesni_blocks(const uint32_t *key, const uint8_t *in, uint8_t *out, size_t blocks) {
+    Sm4Xmm c;
+    __m128i a[4], b[4], rk;
+    size_t done;
+
+    c.pre_lo = SM4_XMM_CONST(SM4_PRE_LO);
+    c.pre_hi = SM4_XMM_CONST(SM4_PRE_HI);
+    c.post_lo = SM4_XMM_CONST(SM4_POST_LO);
+    c.post_hi = SM4_XMM_CONST(SM4_POST_HI);
+    c.m4 = _mm_set1_epi8(0x0f);
+    c.isr = _mm_loadu_si128((const __m128i *) SM4_SHUF[0]);
+    c.r8 = _mm_loadu_si128((const __m128i *) SM4_SHUF[1]);
+    c.r16 = _mm_loadu_si128((const __m128i *) SM4_SHUF[2]);
+    c.r24 = _mm_loadu_si128((const __m128i *) SM4_SHUF[3]);
+    c.bswap = _mm_loadu_si128((const __m128i *) SM4_SHUF[4]);
+
+    for (done = 0; done + 8 <= blocks; done += 8, in += 128, out += 128) {
+        sm4_xmm_load(&c, in, a);
+        sm4_xmm_load(&c, in + 64, b);
+        for (int i = 0; i < 32; i += 4) {
+            rk = _mm_set1_epi32((int) key[i]);
+            a[0] = sm4_xmm_round(&c, rk, a[0], a[1], a[2], a[3]);
+            b[0] = sm4_xmm_round(&c, rk, b[0], b[1], b[2], b[3]);
+            rk = _mm_set1_epi32((int) key[i + 1]);
+            a[1] = sm4_xmm_round(&c, rk, a[1], a[2], a[3], a[0]);
+            b[1] = sm4_xmm_round(&c, rk, b[1], b[2], b[3], b[0]);
+            rk = _mm_set1_epi32((int) key[i + 2]);
+            a[2] = sm4_xmm_round(&c, rk, a[2], a[3], a[0], a[1]);
+            b[2] = sm4_xmm_round(&c, rk, b[2], b[3], b[0], b[1]);
+            rk = _mm_set1_epi32((int) key[i + 3]);
+            a[3] = sm4_xmm_round(&c, rk, a[3], a[0], a[1], a[2]);
+            b[3] = sm4_xmm_round(&c, rk, b[3], b[0], b[1], b[2]);
+        }
+        sm4_xmm_store(&c, a, out);
+        sm4_xmm_store(&c, b, out + 64);
+    }
+    return done;
+}
+
+
+/**
+ * AVX2 + VAES, same round on 256-bit registers: each 128-bit half carries its own
+ * 4 blocks, 16 blocks per call.
+*/
+typedef struct {
+    __m256i pre_lo, pre_hi, post_lo, post_hi, m4, isr, r8, r16, r24, bswap;
+} Sm4Ymm;
+
+#define SM4_YMM_TARGET __attribute__((target("avx2,vaes")))
+#define SM4_YMM_CONST(c) SM4_YMM_CONST_(c)
+#define SM4_YMM_CONST_(lo, hi) _mm256_set_epi64x(hi, lo, hi, lo)
+
+SM4_YMM_TARGET
+static inline __m256i sm4_ymm_affine(__m256i x, __m256i lo, __m256i hi, __m256i m4) {
+    __m256i t = _mm256_srli_epi32(_mm256_andnot_si256(m4, x), 4);
+    return _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(x, m4)), _mm256_shuffle_epi8(hi, t));
+}
+
+SM4_YMM_TARGET
+static inline __m256i sm4_ymm_round(const Sm4Ymm *c, __m256i rk, __m256i s0, __m256i s1, __m256i s2, __m256i s3) {
+    __m256i x, y, t;
+
+    x = _mm256_xor_si256(_mm256_xor_si256(s1, s2), _mm256_xor_si256(s3, rk));
+    x = sm4_ymm_affine(x, c->pre_lo, c->pre_hi, c->m4);
+    x = _mm256_aesenclast_epi128(x, c->m4);
+    x = sm4_ymm_affine(x, c->post_lo, c->post_hi, c->m4);
+
+    y = _mm256_shuffle_epi8(x, c->isr);
+    t = _mm256_xor_si256(y, _mm256_shuffle_epi8(x, c->r8));
+    t = _mm256_xor_si256(t, _mm256_shuffle_epi8(x, c->r16));
+    s0 = _mm256_xor_si256(s0, y);
+    s0 = _mm256_xor_si256(s0, _mm256_shuffle_epi8(x, c->r24));
+    s0 = _mm256_xor_si256(s0, _mm256_slli_epi32(t, 2));
+    return _mm256_xor_si256(s0, _mm256_srli_epi32(t, 30));
+}
+
+SM4_YMM_TARGET
+static inline void sm4_ymm_transpose(__m256i *x0, __m256i *x1, __m256i *x2, __m256i *x3) {
+    __m256i t0 = _mm256_unpacklo_epi32(*x0, *x1);
+    __m256i t1 = _mm256_unpacklo_epi32(*x2, *x3);
+    __m256i t2 = _mm256_unpackhi_epi32(*x0, *x1);
+    __m256i t3 = _mm256_unpackhi_epi32(*x2, *x3);
+    *x0 = _mm256_unpacklo_epi64(t0, t1);
+    *x1 = _mm256_unpackhi_epi64(t0, t1);
+    *x2 = _mm256_unpacklo_epi64(t2, t3);
+    *x3 = _mm256_unpackhi_epi64(t2, t3);
+}
+
+// 8 blocks, low halves hold blocks 0 2 4 6, high halves 1 3 5 7
+SM4_YMM_TARGET
+static inline void sm4_ymm_load(const Sm4Ymm *c, const uint8_t *in, __m256i *x) {
+    for (int i = 0; i < 4; i++) {
+        x[i] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) (in + 32 * i)), c->bswap);
+    }
+    sm4_ymm_transpose(&x[0], &x[1], &x[2], &x[3]);
+}
+
+SM4_YMM_TARGET
+static inline void sm4_ymm_store(const Sm4Ymm *c, __m256i *x, uint8_t *out) {
+    sm4_ymm_transpose(&x[3], &x[2], &x[1], &x[0]);
+    for (int i = 0; i < 4; i++) {
+        _mm256_storeu_si256((__m256i *) (out + 32 * i), _mm256_shuffle_epi8(x[3 - i], c->bswap));
+    }
+}
+
+SM4_YMM_TARGET
+static size_t sm4_vaes_blocks(const uint32_t *key, const uint8_t *in, uint8_t *out, size_t blocks) {
+    Sm4Ymm c;
+    __m256i a[4], b[4], rk;
+    size_t done;
+
+    c.pre_lo = SM4_YMM_CONST(SM4_PRE_LO);
+    c.pre_hi = SM4_YMM_CONST(SM4_PRE_HI);
+    c.post_lo = SM4_YMM_CONST(SM4_POST_LO);
+    c.post_hi = SM4_YMM_CONST(SM4_POST_HI);
+    c.m4 = _mm256_set1_epi8(0x0f);
+    c.isr = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) SM4_SHUF[0]));
+    c.r8 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) SM4_SHUF[1]));
+    c.r16 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) SM4_SHUF[2]));
+    c.r24 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) SM4_SHUF[3]));
+    c.bswap = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) SM4_SHUF[4]));
+
+    for (done = 0; done + 16 <= blocks; done += 16, in += 256, out += 256) {
+        sm4_ymm_load(&c, in, a);
+        sm4_ymm_load(&c, in + 128, b);
+        for (int i = 0; i < 32; i += 4) {
+            rk = _mm256_set1_epi32((int) key[i]);
+            a[0] = sm4_ymm_round(&c, rk, a[0], a[1], a[2], a[3]);
+            b[0] = sm4_ymm_round(&c, rk, b[0], b[1], b[2], b[3]);
+            rk = _mm256_set1_epi32((int) key[i + 1]);
+            a[1] = sm4_ymm_round(&c, rk, a[1], a[2], a[3], a[0]);
+            b[1] = sm4_ymm_round(&c, rk, b[1], b[2], b[3], b[0]);
+            rk = _mm256_set1_epi32((int) key[i + 2]);
+            a[2] = sm4_ymm_round(&c, rk, a[2], a[3], a[0], a[1]);
+            b[2] = sm4_ymm_round(&c, rk, b[2], b[3], b[0], b[1]);
+            rk = _mm256_set1_epi32((int) key[i + 3]);
+            a[3] = sm4_ymm_round(&c, rk, a[3], a[0], a[1], a[2]);
+            b[3] = sm4_ymm_round(&c, rk, b[3], b[0], b[1], b[2]);
+        }
+        sm4_ymm_store(&c, a, out);
+        sm4_ymm_store(&c, b, out + 128);
+    }
+    // the 8 block kernel takes what is left
+    return done + sm4_aesni_blocks(key, in, out, blocks - done);
+}
+
+#endif
+
+
+typedef size_t (*sm4_blocks_fn)(const uint32_t *key, const uint8_t *in, uint8_t *out, size_t blocks);
+
+static int sm4_simd_resolved = 0;
+static sm4_blocks_fn sm4_simd_fn = NULL;
+static sm4_blocks_fn sm4_simd_best = NULL;
+
+static void sm4_simd_resolve() {
+#ifdef SM4_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("vaes")) {
+        sm4_simd_best = sm4_vaes_blocks;
+    } else if (__builtin_cpu_supports("aes") && __builtin_cpu_supports("ssse3")) {
+        sm4_simd_best = sm4_aesni_blocks;
+    }
+#endif
+    sm4_simd_fn = sm4_simd_best;
+    sm4_simd_resolved = 1;
+}
+
+size_t sm4_simd_blocks(const uint32_t *key, const uint8_t *in, uint8_t *out, size_t blocks) {
+    if (!sm4_simd_resolved) {
+        sm4_simd_resolve();
+    }
+    return sm4_simd_fn && blocks >= 8 ? sm4_simd_fn(key, in, out, blocks) : 0;
+}
+
+int sm4_set_simd(int enable) {
+    if (!sm4_simd_resolved) {
+        sm4_simd_resolve();
+    }
+    sm4_simd_fn = enable ? sm4_simd_best : NULL;
+    return sm4_simd_fn != NULL;
+}
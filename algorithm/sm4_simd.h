@@ -0,0 +1,14 @@
+#ifndef _SM4_SIMD_H_
+#define _SM4_SIMD_H_
+
+#include "archer.h"
+
+/**
+ * encrypt (or decrypt, with the reversed round keys) as many leading blocks as
+ * the simd kernel of this cpu takes at once.
+ * @return number of blocks processed, 0 when no kernel is available or enabled
+*/
+size_t sm4_simd_blocks(const uint32_t *key, const uint8_t *in, uint8_t *out, size_t blocks);
+int sm4_set_simd(int enable);
+
+#endif
@@ -20,41 +20,6 @@ static void print_uints(const char *name, uint8_t *bs, size_t len) {
 }
 
 
-void sm2CostTest() {
-    printf("****begin sm2 sign cost test****\n");
-    uint8_t d[32] = {29, -3, 74, 47, 123, 64, 41, 123, 67, -9, 89, 16, 84, 115, 18, -8, -41, -97, -57, 36, 103, 60, 115, -123, -5, -38, -97, 127, 32, -21, -25, 2};
-    uint8_t p[64] = {124, -111, 78, 61, -127, 10, -126, -115, 18, -118, 16, 64, 63, -12, 77, 32, 8, 95, -32, 73, 36, 98, 63, -81, -1, -112, -45, -87, -119, -31, -91, -5, -76, 120, -20, -101, -57, 45, -115, -110, -52, -50, 83, -74, -117, -113, -38, -51, -125, 18, -42, -84, 59, -33, -105, -3, 23, -8, 83, 51, 45, 74, -31, -105};
-	
-
-    int count = 10000;
-    EcPrivateKey sk;
-    EcPublicKey pk;
-    // EcSignature *sig = calloc(count, sizeof(EcSignature));
-    EcSignature sig;
-
-    memcpy(sk.d, d, 32);
-    memcpy(pk.x, p, 32);
-    memcpy(pk.y, &(p[32]), 32);
-    printf("****start sm2 sign cost test****\n");
-    clock_t t1, t2, t3, t4;
-    t1 = clock();
-    for(int i = 0; i < count; i++) {
-        sm2p256v1_sign(&sk, d, 32, &sig);
-    }
-    t2 = clock();
-    printf("sm2 sign result:\n round: %d\n cost: %ldms\n", count, t2 - t1);
-    printf("****start sm2 verify cost test****\n");
-    t3 = clock();
-    for(int i = 0; i < count; i++) {
-        int ret = sm2p256v1_verify(&pk, d, 32, &sig);
-        if(!ret) {
-            printf("round[%d] verify failed\n", i);
-        }
-    }
-    t4 = clock();
-    printf("sm2 verify result:\n round: %d\n cost: %ldms\n", count, t4 - t3);
-}
-
 void secTest() {
     printf("****begin secp256k1 sign test****\n");
     uint8_t d[32] = {29, -3, 74, 47, 123, 64, 41, 123, 67, -9, 89, 16, 84, 115, 18, -8, -41, -97, -57, 36, 103, 60, 115, -123, -5, -38, -97, 127, 32, -21, -25, 2};
@@ -101,6 +66,111 @@ void sm2Test() {
     printf("ret = %d\n", ret);
 }
 
+void sm2ExchangeTest() {
+    printf("****begin sm2 key exchange test****\n");
+    EcPrivateKey ska, skb;
+    EcPublicKey pka, pkb, ra, rb;
+    Sm2Exchange a, b;
+    uint8_t ka[48], kb[48], sa[32], sa_check[32], sb[32], sb_check[32];
+    const uint8_t *ida = (const uint8_t *) "ALICE123@YAHOO.COM", *idb = (const uint8_t *) "BILL456@YAHOO.COM";
+    int ok = 1;
+
+    sm2p256v1_key_gen(&ska, &pka);
+    sm2p256v1_key_gen(&skb, &pkb);
+    // A -> B: ra, B -> A: rb, sb, A -> B: sa
+    ok &= sm2p256v1_exchange_init(&a, 1, &ska, &pka, ida, strlen((const char *) ida), &pkb, idb, strlen((const char *) idb), &ra);
+    ok &= sm2p256v1_exchange_init(&b, 0, &skb, &pkb, idb, strlen((const char *) idb), &pka, ida, strlen((const char *) ida), &rb);
+    ok &= sm2p256v1_exchange_key(&b, &ra, kb, sizeof(kb), sb, sa_check);
+    ok &= sm2p256v1_exchange_key(&a, &rb, ka, sizeof(ka), sa, sb_check);
+    ok &= !memcmp(ka, kb, sizeof(ka));
+    ok &= !memcmp(sb, sb_check, 32) && !memcmp(sa, sa_check, 32) && memcmp(sa, sb, 32);
+    print_uints("key = ", ka, sizeof(ka));
+
+    rb.y[31] ^= 1;
+    ok &= !sm2p256v1_exchange_key(&a, &rb, ka, sizeof(ka), NULL, NULL);
+
+    // a reused context gets a fresh ephemeral key
+    EcPublicKey ra2;
+    ok &= sm2p256v1_exchange_init(&a, 1, &ska, &pka, ida, strlen((const char *) ida), &pkb, idb, strlen((const char *) idb), &ra2);
+    ok &= memcmp(&ra, &ra2, sizeof(ra)) != 0;
+
+    // a peer key of -[x_bar]R makes U the point at infinity
+    EcPrivateKey skr, skp;
+    EcPublicKey pkr, pkp;
+    mpz_t n, d, x;
+    mpz_inits(n, d, x, NULL);
+    mpz_set_str(n, "FFFFFFFEFFFFFFFFFFFFFFFFFFFFFFFF7203DF6B21C6052B53BBF40939D54123", 16);
+    sm2p256v1_key_gen(&skr, &pkr);
+    mpz_import(x, 32, 1, 1, 0, 0, pkr.x);
+    mpz_tdiv_r_2exp(x, x, 127);
+    mpz_setbit(x, 127);
+    mpz_import(d, 32, 1, 1, 0, 0, skr.d);
+    mpz_mul(d, d, x);
+    mpz_neg(d, d);
+    mpz_mod(d, d, n);
+    memset(skp.d, 0, 32);
+    mpz_export(skp.d + 32 - (mpz_sizeinbase(d, 2) + 7) / 8, NULL, 1, 1, 0, 0, d);
+    sm2p256v1_privateKey_to_publicKey(&skp, &pkp);
+    ok &= sm2p256v1_exchange_init(&a, 1, &ska, &pka, ida, strlen((const char *) ida), &pkp, idb, strlen((const char *) idb), &ra2);
+    ok &= !sm2p256v1_exchange_key(&a, &pkr, ka, sizeof(ka), NULL, NULL);
+    mpz_clears(n, d, x, NULL);
+
+    printf(ok ? "sm2 key exchange test success\n" : "sm2 key exchange test failed\n");
+}
+
+void sm2StreamTest() {
+    printf("****begin sm2 stream test****\n");
+    EcPrivateKey sk;
+    EcPublicKey pk;
+    uint8_t text[1000], cipher[1100], back[1100], *held = NULL;
+    size_t l, held_len = 0;
+    int ok = 1, modes[2] = {SM2_C1C2C3, SM2_C1C3C2};
+    for(int i = 0; i < 1000; i++) {
+        text[i] = i * 31;
+    }
+    sm2p256v1_key_gen(&sk, &pk);
+
+    for(int m = 0; m < 2; m++) {
+        Sm2Stream s;
+        size_t c2 = SM2_C1C3C2 == modes[m] ? 97 : 65, off, total = 0;
+        ok &= sm2p256v1_stream_encrypt_init(&s, &pk, modes[m], cipher);
+        // uneven chunks cross the 32 byte keystream blocks
+        for(off = 0; off < 1000; off += l) {
+            l = 1000 - off < 77 ? 1000 - off : 77;
+            ok &= sm2p256v1_stream_update(&s, text + off, l, cipher + c2 + off, &l);
+        }
+        sm2p256v1_stream_encrypt_final(&s, SM2_C1C3C2 == modes[m] ? cipher + 65 : cipher + 1065);
+
+        l = sizeof(back);
+        ok &= sm2p256v1_decrypt_into(&sk, cipher, 1097, modes[m], back, &l) && l == 1000 && !memcmp(back, text, 1000);
+
+        sm2p256v1_stream_decrypt_init(&s, &sk, modes[m], 1);
+        for(off = 0; off < 1097; off += 13) {
+            ok &= sm2p256v1_stream_update(&s, cipher + off, 1097 - off < 13 ? 1097 - off : 13, back + total, &l);
+            total += l;
+        }
+        ok &= sm2p256v1_stream_decrypt_final(&s, NULL, NULL) && total == 1000 && !memcmp(back, text, 1000);
+
+        cipher[600] ^= 1;
+        sm2p256v1_stream_decrypt_init(&s, &sk, modes[m], 0);
+        ok &= sm2p256v1_stream_update(&s, cipher, 1097, back, &l) && l == 0;
+        ok &= !sm2p256v1_stream_decrypt_final(&s, &held, &held_len) && !held;
+        cipher[600] ^= 1;
+        sm2p256v1_stream_decrypt_init(&s, &sk, modes[m], 0);
+        ok &= sm2p256v1_stream_update(&s, cipher, 1097, back, &l) && l == 0;
+        ok &= sm2p256v1_stream_decrypt_final(&s, &held, &held_len) && held_len == 1000 && !memcmp(held, text, 1000);
+        archer_free(held);
+        held = NULL;
+
+        // truncated
+        sm2p256v1_stream_decrypt_init(&s, &sk, modes[m], 1);
+        ok &= sm2p256v1_stream_update(&s, cipher, 80, back, &l);
+        ok &= !sm2p256v1_stream_decrypt_final(&s, NULL, NULL);
+    }
+
+    printf(ok ? "sm2 stream test success\n" : "sm2 stream test failed\n");
+}
+
 void sm4Test() {
     uint8_t key[16] = "keys0123456789ab";
     const char *text = "nihao,shijie,.:.";
@@ -125,6 +195,268 @@ void sm4Test() {
     free(de_text);
 }
 
+void sm4CostTest() {
+    printf("****begin sm4 cost test****\n");
+    uint8_t key[16] = "keys0123456789ab", iv[16] = {0};
+    size_t len = 1 << 20, out_len;
+    int count = 64, ok = 1;
+    uint8_t *in = malloc(len + 64), *out = malloc(len + 16);
+    for(size_t i = 0; i < len + 64; i++) {
+        in[i] = i * 31 + 7;
+    }
+    // not multiples of 16 blocks, so the 8/16 block simd kernels leave a tail to the one block code
+    const size_t check_len[] = {17 * 16, 24 * 16 + 5, 257 * 16 + 9, 31 * 16 + 15};
+    uint8_t *ecb[2], *ctr[2], ctr_iv[16];
+    memset(ctr_iv, 0xff, 16);
+    ctr_iv[0] = 1;
+
+    for(int simd = 0; simd < 2; simd++) {
+        int on = sm4_set_simd(simd);
+        clock_t t1, t2, t3;
+        t1 = clock();
+        for(int i = 0; i < count; i++) {
+            out_len = len + 16;
+            sm4_encrypt_into(key, in, len, out, &out_len);
+        }
+        t2 = clock();
+        for(int i = 0; i < count; i++) {
+            sm4_ctr_encrypt(key, iv, in, len, out);
+        }
+        t3 = clock();
+        double mb = (double) count * len / (1 << 20);
+        printf("%s:\n ecb: %.1f MB/s\n ctr: %.1f MB/s\n", on ? "simd" : "table", 
+                mb * CLOCKS_PER_SEC / (t2 - t1 + 1), mb * CLOCKS_PER_SEC / (t3 - t2 + 1));
+
+        // keep both outputs, the simd kernel must match the table path byte for byte
+        ecb[simd] = calloc(1, len + 16);
+        ctr[simd] = calloc(1, len + 16);
+        for(size_t c = 0, off = 0; c < sizeof(check_len) / sizeof(check_len[0]); c++) {
+            out_len = check_len[c] + 16;
+            ok &= sm4_encrypt_into(key, in + c, check_len[c], ecb[simd] + off, &out_len);
+            sm4_ctr_encrypt(key, ctr_iv, in + c, check_len[c], ctr[simd] + off);
+            off += check_len[c] + 16;
+        }
+    }
+    size_t total = 0;
+    for(size_t c = 0; c < sizeof(check_len) / sizeof(check_len[0]); c++) {
+        total += check_len[c] + 16;
+    }
+    ok &= !memcmp(ecb[0], ecb[1], total) && !memcmp(ctr[0], ctr[1], total);
+    for(int simd = 0; simd < 2; simd++) {
+        free(ecb[simd]);
+        free(ctr[simd]);
+    }
+
+    // many small records under one key
+    Sm4Key k;
+    uint8_t rec[64] = {0}, rec_out[80];
+    clock_t t1 = clock();
+    for(int i = 0; i < 200000; i++) {
+        out_len = sizeof(rec_out);
+        sm4_encrypt_into(key, rec, sizeof(rec), rec_out, &out_len);
+    }
+    clock_t t2 = clock();
+    sm4_key_init(&k, key);
+    for(int i = 0; i < 200000; i++) {
+        out_len = sizeof(rec_out);
+        sm4_key_encrypt_into(&k, rec, sizeof(rec), rec_out, &out_len);
+    }
+    clock_t t3 = clock();
+    printf("64 byte records:\n user_key: %ldms\n Sm4Key: %ldms\n", (t2 - t1) * 1000 / CLOCKS_PER_SEC, (t3 - t2) * 1000 / CLOCKS_PER_SEC);
+    sm4_set_simd(1);
+    free(in);
+    free(out);
+    printf(ok ? "sm4 cost test success\n" : "sm4 cost test failed\n");
+}
+
+void sm4ModeTest() {
+    printf("****begin sm4 ctr/gcm test****\n");
+    // RFC 8998 A.1
+    uint8_t key[16] = {
+        0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef, 0xfe, 0xdc, 0xba, 0x98, 0x76, 0x54, 0x32, 0x10,
+    };
+    uint8_t iv[12] = {
+        0x00, 0x00, 0x12, 0x34, 0x56, 0x78, 0x00, 0x00, 0x00, 0x00, 0xab, 0xcd,
+    };
+    uint8_t aad[20] = {
+        0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef, 0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+        0xab, 0xad, 0xda, 0xd2,
+    };
+    uint8_t text[64] = {
+        0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xbb, 0xbb, 0xbb, 0xbb, 0xbb, 0xbb, 0xbb, 0xbb,
+        0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd, 0xdd,
+        0xee, 0xee, 0xee, 0xee, 0xee, 0xee, 0xee, 0xee, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xee, 0xee, 0xee, 0xee, 0xee, 0xee, 0xee, 0xee, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+    };
+    uint8_t expect[64] = {
+        0x17, 0xf3, 0x99, 0xf0, 0x8c, 0x67, 0xd5, 0xee, 0x19, 0xd0, 0xdc, 0x99, 0x69, 0xc4, 0xbb, 0x7d,
+        0x5f, 0xd4, 0x6f, 0xd3, 0x75, 0x64, 0x89, 0x06, 0x91, 0x57, 0xb2, 0x82, 0xbb, 0x20, 0x07, 0x35,
+        0xd8, 0x27, 0x10, 0xca, 0x5c, 0x22, 0xf0, 0xcc, 0xfa, 0x7c, 0xbf, 0x93, 0xd4, 0x96, 0xac, 0x15,
+        0xa5, 0x68, 0x34, 0xcb, 0xcf, 0x98, 0xc3, 0x97, 0xb4, 0x02, 0x4a, 0x26, 0x91, 0x23, 0x3b, 0x8d,
+    };
+    uint8_t expect_tag[16] = {
+        0x83, 0xde, 0x35, 0x41, 0xe4, 0xc2, 0xb5, 0x81, 0x77, 0xe0, 0x65, 0xa9, 0xbf, 0x7b, 0x62, 0xec,
+    };
+    uint8_t buf[64], tag[16], back[64];
+    int ok = 1;
+
+    sm4_gcm_encrypt(key, iv, 12, aad, 20, text, 64, buf, tag);
+    ok &= !memcmp(buf, expect, 64) && !memcmp(tag, expect_tag, 16);
+    ok &= sm4_gcm_decrypt(key, iv, 12, aad, 20, buf, 64, tag, back);
+    ok &= !memcmp(back, text, 64);
+    buf[3] ^= 1;
+    ok &= !sm4_gcm_decrypt(key, iv, 12, aad, 20, buf, 64, tag, back);
+
+    // odd lengths, in place, counter carry across bytes
+    uint8_t ctr[16], big[1000], orig[1000];
+    memset(ctr, 0xff, 16);
+    for (int i = 0; i < 1000; i++) {
+        orig[i] = big[i] = i * 7;
+    }
+    sm4_ctr_encrypt(key, ctr, big, 999, big);
+    sm4_ctr_decrypt(key, ctr, big, 999, big);
+    ok &= !memcmp(big, orig, 1000);
+    sm4_gcm_encrypt(key, ctr, 16, NULL, 0, big, 333, big, tag);
+    ok &= sm4_gcm_decrypt(key, ctr, 16, NULL, 0, big, 333, tag, big);
+    ok &= !memcmp(big, orig, 1000);
+
+    // expanded key gives the same results
+    Sm4Key k;
+    uint8_t ecb0[80], ecb1[80];
+    size_t l0 = sizeof(ecb0), l1 = sizeof(ecb1);
+    sm4_key_init(&k, key);
+    sm4_key_gcm_encrypt(&k, iv, 12, aad, 20, text, 64, buf, tag);
+    ok &= !memcmp(buf, expect, 64) && !memcmp(tag, expect_tag, 16);
+    ok &= sm4_key_gcm_decrypt(&k, iv, 12, aad, 20, buf, 64, tag, back) && !memcmp(back, text, 64);
+    sm4_encrypt_into(key, text, 64, ecb0, &l0);
+    sm4_key_encrypt_into(&k, text, 64, ecb1, &l1);
+    ok &= l0 == l1 && !memcmp(ecb0, ecb1, l0);
+    l0 = sizeof(big);
+    ok &= sm4_key_decrypt_into(&k, ecb1, l1, big, &l0) && l0 == 64 && !memcmp(big, text, 64);
+
+    printf(ok ? "sm4 ctr/gcm test success\n" : "sm4 ctr/gcm test failed\n");
+}
+
+// feed in through update in uneven pieces
+static size_t stream_run(Sm4Stream *s, const uint8_t *in, size_t len, uint8_t *out, uint8_t tag[16], int *ok) {
+    size_t off = 0, total = 0, n, out_len;
+    for(int step = 1; off < len; step = step * 3 % 101) {
+        n = len - off < step ? len - off : step;
+        sm4_stream_update(s, in + off, n, out + total, &out_len);
+        off += n;
+        total += out_len;
+    }
+    *ok &= sm4_stream_final(s, out + total, &out_len, tag);
+    return total + out_len;
+}
+
+void sm4StreamTest() {
+    printf("****begin sm4 stream test****\n");
+    uint8_t key[16] = "keys0123456789ab", iv[16] = "0123456789abcdef";
+    uint8_t aad[13] = "header-13-byt";
+    uint8_t text[1000], c0[1100], c1[1100], back[1100], tag0[16], tag1[16];
+    Sm4Stream s;
+    size_t l;
+    int ok = 1;
+    for(int i = 0; i < 1000; i++) {
+        text[i] = i * 31;
+    }
+
+    sm4_ctr_encrypt(key, iv, text, 1000, c0);
+    sm4_stream_init(&s, SM4_CTR, 1, key, iv, 16);
+    l = stream_run(&s, text, 1000, c1, NULL, &ok);
+    ok &= l == 1000 && !memcmp(c0, c1, 1000);
+
+    sm4_gcm_encrypt(key, iv, 12, aad, 13, text, 999, c0, tag0);
+    sm4_stream_init(&s, SM4_GCM, 1, key, iv, 12);
+    sm4_stream_aad(&s, aad, 5);
+    sm4_stream_aad(&s, aad + 5, 8);
+    l = stream_run(&s, text, 999, c1, tag1, &ok);
+    ok &= l == 999 && !memcmp(c0, c1, 999) && !memcmp(tag0, tag1, 16);
+    sm4_stream_init(&s, SM4_GCM, 0, key, iv, 12);
+    sm4_stream_aad(&s, aad, 13);
+    l = stream_run(&s, c1, 999, back, tag1, &ok);
+    ok &= l == 999 && !memcmp(back, text, 999);
+    tag1[0] ^= 1;
+    sm4_stream_init(&s, SM4_GCM, 0, key, iv, 12);
+    sm4_stream_aad(&s, aad, 13);
+    int bad = 1;
+    stream_run(&s, c1, 999, back, tag1, &bad);
+    ok &= !bad;
+
+    for(size_t len = 0; len <= 48; len += 16) {
+        sm4_stream_init(&s, SM4_CBC, 1, key, iv, 16);
+        l = stream_run(&s, text, 1000 - len, c1, NULL, &ok);
+        ok &= l == (1000 - len) / 16 * 16 + 16;
+        sm4_stream_init(&s, SM4_CBC, 0, key, iv, 16);
+        ok &= stream_run(&s, c1, l, back, NULL, &ok) == 1000 - len && !memcmp(back, text, 1000 - len);
+    }
+
+
+    printf(ok ? "sm4 stream test success\n" : "sm4 stream test failed\n");
+}
+
+void sm4ParallelTest() {
+    printf("****begin sm4 parallel test****\n");
+    uint8_t key[16] = "keys0123456789ab", iv[16] = "0123456789abcdef";
+    size_t l;
+    int ok = 1;
+
+    // threaded ecb/ctr give the same bytes
+    size_t big_len = (1 << 20) + 37;
+    uint8_t *big = malloc(big_len), *p0 = malloc(big_len + 16), *p1 = malloc(big_len + 16);
+    for(size_t i = 0; i < big_len; i++) {
+        big[i] = i * 7;
+    }
+    memset(iv + 8, 0xff, 8);
+    sm4_ctr_encrypt(key, iv, big, big_len, p0);
+    sm4_set_parallel(4, 1 << 16, 1);
+    sm4_ctr_encrypt(key, iv, big, big_len, p1);
+    ok &= !memcmp(p0, p1, big_len);
+    sm4_set_parallel(1, 0, 0);
+    l = big_len + 16;
+    sm4_encrypt_into(key, big, big_len, p0, &l);
+    sm4_set_parallel(4, 1 << 16, 1);
+    l = big_len + 16;
+    sm4_encrypt_into(key, big, big_len, p1, &l);
+    ok &= !memcmp(p0, p1, l);
+    ok &= sm4_decrypt_into(key, p1, l, p1, &l) && l == big_len && !memcmp(p1, big, big_len);
+    sm4_set_parallel(1, 0, 0);
+    free(big);
+    free(p0);
+    free(p1);
+
+    // lengths just past threads * chunk still split into at most threads ranges
+    const int threads[] = {3, 7, 64};
+    for(int t = 0; t < 3; t++) {
+        big_len = (size_t) threads[t] * 65536 + 16;
+        big = malloc(big_len);
+        p0 = malloc(big_len + 16);
+        p1 = malloc(big_len + 16);
+        for(size_t i = 0; i < big_len; i++) {
+            big[i] = i * 13;
+        }
+        sm4_ctr_encrypt(key, iv, big, big_len, p0);
+        sm4_set_parallel(threads[t], 1 << 16, 0);
+        sm4_ctr_encrypt(key, iv, big, big_len, p1);
+        ok &= !memcmp(p0, p1, big_len);
+        sm4_set_parallel(1, 0, 0);
+        l = big_len + 16;
+        sm4_encrypt_into(key, big, big_len, p0, &l);
+        sm4_set_parallel(threads[t], 1 << 16, 0);
+        l = big_len + 16;
+        sm4_encrypt_into(key, big, big_len, p1, &l);
+        ok &= !memcmp(p0, p1, l);
+        ok &= sm4_decrypt_into(key, p1, l, p1, &l) && l == big_len && !memcmp(p1, big, big_len);
+        sm4_set_parallel(1, 0, 0);
+        free(big);
+        free(p0);
+        free(p1);
+    }
+
+    printf(ok ? "sm4 parallel test success\n" : "sm4 parallel test failed\n");
+}
+
 void sm2CryptoTest() {
     printf("****begin sm2 crypto test****\n");
     EcPrivateKey sk;
@@ -188,6 +520,753 @@ void paillierTest() {
     printf("mul decrypt m[0] = %d, m[1] = %d, len = %d\n", c_mul_de[0], c_mul_de[1], c_mul_de_len);
 }
 
+void paillierKeyGenTest() {
+    printf("****begin paillier key gen test****\n");
+    PaillierPrivateKey sk;
+    PaillierPublicKey pk;
+    uint8_t msg[32] = "paillier key size test 32 bytes", cipher[2 * PAILLIER_N_MAX], back[PAILLIER_N_MAX];
+    int ok = 1, sizes[3] = {2048, 3072, 4096};
+
+    ok &= !paillier_key_gen_bits(&sk, &pk, 1000) && !paillier_key_gen_bits(&sk, &pk, 8192);
+    for(int i = 0; i < 3; i++) {
+        clock_t t1 = clock();
+        ok &= paillier_key_gen_bits(&sk, &pk, sizes[i]);
+        clock_t t2 = clock();
+        size_t cl = sizeof(cipher), l = sizeof(back), need = 0;
+        ok &= !paillier_encrypt_into(&pk, msg, 32, NULL, &need) && need == sizes[i] / 4;
+        ok &= paillier_encrypt_into(&pk, msg, 32, cipher, &cl);
+        ok &= paillier_decrypt_into(&sk, cipher, cl, back, &l) && l == 32 && !memcmp(back, msg, 32);
+        // a fresh r every time, the same message never gives the same ciphertext
+        uint8_t again[2 * PAILLIER_N_MAX];
+        size_t al = sizeof(again);
+        ok &= paillier_encrypt_into(&pk, msg, 32, again, &al) && al == cl && memcmp(again, cipher, cl);
+        printf("%d bits: key gen %ldms (cpu time, both threads)\n", sizes[i], (long) ((t2 - t1) * 1000 / CLOCKS_PER_SEC));
+    }
+
+    printf(ok ? "paillier key gen test success\n" : "paillier key gen test failed\n");
+}
+
+static uint64_t be_u64(const uint8_t *b, size_t len) {
+    uint64_t v = 0;
+    for(size_t i = 0; i < len; i++) {
+        v = (v << 8) | b[i];
+    }
+    return v;
+}
+
+void paillierSumTest() {
+    printf("****begin paillier sum test****\n");
+    PaillierPrivateKey sk;
+    PaillierPublicKey pk;
+    int ok = 1, distinct = 64, count = 2000;
+    uint8_t *pool = malloc(distinct * 2 * PAILLIER_N_MAX), wb[2000][2], back[PAILLIER_N_MAX], sum[2 * PAILLIER_N_MAX], *acc = NULL, *t = NULL;
+    const uint8_t **ciphers = malloc(count * sizeof(uint8_t *)), **weights = malloc(count * sizeof(uint8_t *));
+    size_t *lens = malloc(count * sizeof(size_t)), wl[2000], pool_lens[64], l, sl, acc_len, t_len;
+    uint64_t expect = 0, wexpect = 0;
+
+    paillier_key_gen(&sk, &pk);
+    for(int i = 0; i < distinct; i++) {
+        uint8_t m[2] = {(uint8_t) ((i * 7 + 1) >> 8), (uint8_t) (i * 7 + 1)};
+        pool_lens[i] = 2 * PAILLIER_N_MAX;
+        paillier_encrypt_into(&pk, m, 2, pool + i * 2 * PAILLIER_N_MAX, &pool_lens[i]);
+    }
+    for(int i = 0; i < count; i++) {
+        ciphers[i] = pool + (i % distinct) * 2 * PAILLIER_N_MAX;
+        lens[i] = pool_lens[i % distinct];
+        wb[i][0] = i >> 8;
+        wb[i][1] = i;
+        weights[i] = wb[i];
+        wl[i] = 2;
+        expect += (i % distinct) * 7 + 1;
+        wexpect += (uint64_t) ((i % distinct) * 7 + 1) * i;
+    }
+
+    // chained paillier_add / paillier_mul as reference
+    clock_t t1 = clock();
+    paillier_add(&pk, ciphers[0], lens[0], ciphers[1], lens[1], &acc, &acc_len);
+    for(int i = 2; i < count; i++) {
+        paillier_add(&pk, acc, acc_len, ciphers[i], lens[i], &t, &t_len);
+        free(acc);
+        acc = t;
+        acc_len = t_len;
+    }
+    clock_t t2 = clock();
+    sl = sizeof(sum);
+    ok &= paillier_sum_into(&pk, ciphers, lens, count, sum, &sl);
+    clock_t t3 = clock();
+    l = sizeof(back);
+    ok &= paillier_decrypt_into(&sk, sum, sl, back, &l) && be_u64(back, l) == expect;
+    l = sizeof(back);
+    ok &= paillier_decrypt_into(&sk, acc, acc_len, back, &l) && be_u64(back, l) == expect;
+    free(acc);
+    printf("sum %d: chained add %ldms, paillier_sum %ldms\n", count, (long) ((t2 - t1) * 1000 / CLOCKS_PER_SEC), (long) ((t3 - t2) * 1000 / CLOCKS_PER_SEC));
+
+    int wcount = 256;
+    t1 = clock();
+    paillier_mul(&pk, ciphers[0], lens[0], weights[0], 2, &acc, &acc_len);
+    for(int i = 1; i < wcount; i++) {
+        uint8_t *m = NULL;
+        size_t m_len;
+        paillier_mul(&pk, ciphers[i], lens[i], weights[i], 2, &m, &m_len);
+        paillier_add(&pk, acc, acc_len, m, m_len, &t, &t_len);
+        free(acc);
+        free(m);
+        acc = t;
+        acc_len = t_len;
+    }
+    t2 = clock();
+    sl = sizeof(sum);
+    ok &= paillier_weighted_sum_into(&pk, ciphers, lens, weights, wl, wcount, sum, &sl);
+    t3 = clock();
+    uint64_t wpart = 0;
+    for(int i = 0; i < wcount; i++) {
+        wpart += (uint64_t) ((i % distinct) * 7 + 1) * i;
+    }
+    l = sizeof(back);
+    ok &= paillier_decrypt_into(&sk, sum, sl, back, &l) && be_u64(back, l) == wpart;
+    l = sizeof(back);
+    ok &= paillier_decrypt_into(&sk, acc, acc_len, back, &l) && be_u64(back, l) == wpart;
+    free(acc);
+    printf("weighted sum %d: mul + add %ldms, paillier_weighted_sum %ldms\n", wcount, (long) ((t2 - t1) * 1000 / CLOCKS_PER_SEC), (long) ((t3 - t2) * 1000 / CLOCKS_PER_SEC));
+
+    // 256 bit weights take the 4 bit window
+    uint8_t big_w[40][32], ref[PAILLIER_N_MAX];
+    const uint8_t *big_wp[40];
+    size_t big_wl[40], ref_len;
+    for(int i = 0; i < 40; i++) {
+        for(int j = 0; j < 32; j++) {
+            big_w[i][j] = i * 31 + j * 17 + 3;
+        }
+        big_wp[i] = big_w[i];
+        big_wl[i] = 32;
+    }
+    paillier_mul(&pk, ciphers[0], lens[0], big_wp[0], 32, &acc, &acc_len);
+    for(int i = 1; i < 40; i++) {
+        uint8_t *m = NULL;
+        size_t m_len;
+        paillier_mul(&pk, ciphers[i], lens[i], big_wp[i], 32, &m, &m_len);
+        paillier_add(&pk, acc, acc_len, m, m_len, &t, &t_len);
+        free(acc);
+        free(m);
+        acc = t;
+        acc_len = t_len;
+    }
+    ref_len = sizeof(ref);
+    ok &= paillier_decrypt_into(&sk, acc, acc_len, ref, &ref_len);
+    free(acc);
+    sl = sizeof(sum);
+    ok &= paillier_weighted_sum_into(&pk, ciphers, lens, big_wp, big_wl, 40, sum, &sl);
+    l = sizeof(back);
+    ok &= paillier_decrypt_into(&sk, sum, sl, back, &l) && l == ref_len && !memcmp(back, ref, l);
+
+    // threaded, and a threshold that leaves empty ranges
+    paillier_set_parallel(7, 16);
+    sl = sizeof(sum);
+    ok &= paillier_sum_into(&pk, ciphers, lens, count, sum, &sl);
+    l = sizeof(back);
+    ok &= paillier_decrypt_into(&sk, sum, sl, back, &l) && be_u64(back, l) == expect;
+    sl = sizeof(sum);
+    ok &= paillier_weighted_sum_into(&pk, ciphers, lens, weights, wl, count, sum, &sl);
+    l = sizeof(back);
+    ok &= paillier_decrypt_into(&sk, sum, sl, back, &l) && be_u64(back, l) == wexpect;
+    sl = sizeof(sum);
+    ok &= paillier_sum_into(&pk, ciphers, lens, 20, sum, &sl);
+    l = sizeof(back);
+    ok &= paillier_decrypt_into(&sk, sum, sl, back, &l) && be_u64(back, l) == 20 * 19 / 2 * 7 + 20;
+    paillier_set_parallel(1, 0);
+
+    free(pool);
+    free(ciphers);
+    free(weights);
+    free(lens);
+    printf(ok ? "paillier sum test success\n" : "paillier sum test failed\n");
+}
+
+void paillierMultiExpTest() {
+    printf("****begin paillier multi exponentiation test****\n");
+    PaillierPrivateKey sk;
+    PaillierPublicKey pk;
+    int ok = 1, sizes[4] = {1, 5, 40, 300}, ebits[3] = {8, 64, 1024};
+    mpz_t mod, out, ref, t, bases[300], exps[300];
+    gmp_randstate_t st;
+    gmp_randinit_default(st);
+    mpz_inits(mod, out, ref, t, NULL);
+    for(int i = 0; i < 300; i++) {
+        mpz_init(bases[i]);
+        mpz_init(exps[i]);
+    }
+
+    // straus and pippenger against mpz_powm
+    mpz_urandomb(mod, st, 512);
+    mpz_setbit(mod, 0);
+    for(int s = 0; s < 4; s++) {
+        for(int b = 0; b < 3; b++) {
+            mpz_set_ui(ref, 1);
+            for(int i = 0; i < sizes[s]; i++) {
+                mpz_urandomm(bases[i], st, mod);
+                mpz_urandomb(exps[i], st, ebits[b]);
+                if(i == 1) {
+                    mpz_set_ui(exps[i], 0);
+                }
+                mpz_powm(t, bases[i], exps[i], mod);
+                mpz_mul(ref, ref, t);
+                mpz_mod(ref, ref, mod);
+            }
+            paillier_multi_powm(out, bases, exps, sizes[s], mod);
+            ok &= !mpz_cmp(out, ref);
+        }
+    }
+
+    // fixed base against paillier_mul
+    paillier_key_gen(&sk, &pk);
+    uint8_t m[2] = {1, 2}, c[2 * PAILLIER_N_MAX], r0[2 * PAILLIER_N_MAX], r1[2 * PAILLIER_N_MAX], k[32];
+    size_t cl = sizeof(c), l0, l1;
+    paillier_encrypt_into(&pk, m, 2, c, &cl);
+    PaillierFixedBase *fb = paillier_fixed_base_new(&pk, c, cl, 128);
+    int count = 200;
+    clock_t t0 = clock(), t1, t2;
+    for(int i = 0; i < count; i++) {
+        for(int j = 0; j < 16; j++) {
+            k[j] = i * 37 + j * 11;
+        }
+        l0 = sizeof(r0);
+        paillier_mul_into(&pk, c, cl, k, 16, r0, &l0);
+    }
+    t1 = clock();
+    for(int i = 0; i < count; i++) {
+        for(int j = 0; j < 16; j++) {
+            k[j] = i * 37 + j * 11;
+        }
+        l1 = sizeof(r1);
+        ok &= paillier_fixed_base_mul_into(fb, k, 16, r1, &l1);
+    }
+    t2 = clock();
+    ok &= l0 == l1 && !memcmp(r0, r1, l0);
+    printf("%d 128 bit scalars: paillier_mul %ldms, fixed base %ldms\n", count, (long) ((t1 - t0) * 1000 / CLOCKS_PER_SEC), (long) ((t2 - t1) * 1000 / CLOCKS_PER_SEC));
+    // longer than max_bits
+    memset(k, 0xa5, 32);
+    l0 = l1 = sizeof(r0);
+    paillier_mul_into(&pk, c, cl, k, 32, r0, &l0);
+    ok &= paillier_fixed_base_mul_into(fb, k, 32, r1, &l1) && l0 == l1 && !memcmp(r0, r1, l0);
+    paillier_fixed_base_free(fb);
+
+    for(int i = 0; i < 300; i++) {
+        mpz_clear(bases[i]);
+        mpz_clear(exps[i]);
+    }
+    mpz_clears(mod, out, ref, t, NULL);
+    gmp_randclear(st);
+    printf(ok ? "paillier multi exponentiation test success\n" : "paillier multi exponentiation test failed\n");
+}
+
+void paillierCrtTest() {
+    printf("****begin paillier crt test****\n");
+    PaillierPrivateKey sk, sk_old;
+    PaillierPublicKey pk;
+    PaillierCrtKey key;
+    uint8_t msg[100], cipher[2 * PAILLIER_N_MAX], m0[PAILLIER_N_MAX], m1[PAILLIER_N_MAX], m2[PAILLIER_N_MAX];
+    size_t cl, l0, l1, l2;
+    int ok = 1, count = 200;
+    for(int i = 0; i < 100; i++) {
+        msg[i] = i * 13 + 1;
+    }
+
+    paillier_key_gen(&sk, &pk);
+    sk_old = sk;
+    memset(sk_old.p, 0, sizeof(sk_old.p));
+    memset(sk_old.q, 0, sizeof(sk_old.q));
+    paillier_crt_key_init(&key, &sk);
+    for(int i = 1; i <= 100; i += 33) {
+        cl = sizeof(cipher);
+        l0 = l1 = l2 = PAILLIER_N_MAX;
+        paillier_encrypt_into(&pk, msg, i, cipher, &cl);
+        ok &= paillier_decrypt_into(&sk, cipher, cl, m0, &l0);
+        ok &= paillier_decrypt_into(&sk_old, cipher, cl, m1, &l1);
+        ok &= paillier_crt_decrypt_into(&key, cipher, cl, m2, &l2);
+        ok &= l0 == i && l1 == i && l2 == i && !memcmp(m0, msg, i) && !memcmp(m1, msg, i) && !memcmp(m2, msg, i);
+    }
+
+    clock_t t1 = clock();
+    for(int i = 0; i < count; i++) {
+        l1 = PAILLIER_N_MAX;
+        paillier_decrypt_into(&sk_old, cipher, cl, m1, &l1);
+    }
+    clock_t t2 = clock();
+    for(int i = 0; i < count; i++) {
+        l2 = PAILLIER_N_MAX;
+        paillier_crt_decrypt_into(&key, cipher, cl, m2, &l2);
+    }
+    clock_t t3 = clock();
+    for(int i = 0; i < count; i++) {
+        l0 = PAILLIER_N_MAX;
+        paillier_decrypt_into(&sk, cipher, cl, m0, &l0);
+    }
+    clock_t t4 = clock();
+    printf("decrypt %d: lambda %ldms, crt %ldms, paillier_decrypt_into %ldms\n", count, (long) ((t2 - t1) * 1000 / CLOCKS_PER_SEC),
+        (long) ((t3 - t2) * 1000 / CLOCKS_PER_SEC), (long) ((t4 - t3) * 1000 / CLOCKS_PER_SEC));
+    paillier_crt_key_clear(&key);
+
+    // paillier_decrypt_into keeps one key per thread, switching keys must not reuse it
+    PaillierPrivateKey sk2;
+    PaillierPublicKey pk2;
+    uint8_t cipher2[2 * PAILLIER_N_MAX];
+    size_t cl2 = sizeof(cipher2);
+    paillier_key_gen(&sk2, &pk2);
+    paillier_encrypt_into(&pk2, msg + 1, 50, cipher2, &cl2);
+    for(int i = 0; i < 3; i++) {
+        l0 = l1 = PAILLIER_N_MAX;
+        ok &= paillier_decrypt_into(&sk, cipher, cl, m0, &l0) && l0 == 100 && !memcmp(m0, msg, 100);
+        ok &= paillier_decrypt_into(&sk2, cipher2, cl2, m1, &l1) && l1 == 50 && !memcmp(m1, msg + 1, 50);
+    }
+    archer_arena_free();
+    l0 = PAILLIER_N_MAX;
+    ok &= paillier_decrypt_into(&sk2, cipher2, cl2, m0, &l0) && l0 == 50 && !memcmp(m0, msg + 1, 50);
+
+    printf(ok ? "paillier crt test success\n" : "paillier crt test failed\n");
+}
+
+void paillierPackTest() {
+    printf("****begin paillier packed slot test****\n");
+    PaillierPrivateKey sk;
+    PaillierPublicKey pk;
+    PaillierPacking pack;
+    int ok = 1;
+    paillier_key_gen(&sk, &pk);
+    ok &= paillier_pack_init(&pack, &pk, 32, 16) && pack.slots == 42;
+    ok &= !paillier_pack_init(&pack, &pk, 60, 8);
+
+    uint64_t a[42], b[42], back[42];
+    uint8_t msg[PAILLIER_N_MAX], ca[2 * PAILLIER_N_MAX], cb[2 * PAILLIER_N_MAX], m[PAILLIER_N_MAX];
+    size_t ml, cal = sizeof(ca), cbl = sizeof(cb), l;
+    paillier_pack_init(&pack, &pk, 32, 16);
+    for(int i = 0; i < 42; i++) {
+        a[i] = 0xffffffffu - i * 977;
+        b[i] = (uint64_t) i * 123457;
+    }
+    ml = sizeof(msg);
+    ok &= paillier_pack(&pack, a, 42, msg, &ml);
+    ok &= paillier_encrypt_into(&pk, msg, ml, ca, &cal);
+    ml = sizeof(msg);
+    ok &= paillier_pack(&pack, b, 42, msg, &ml);
+    ok &= paillier_encrypt_into(&pk, msg, ml, cb, &cbl);
+
+    // slot wise a + b
+    uint8_t *sum = NULL, *prod = NULL;
+    size_t sum_len, prod_len;
+    paillier_add(&pk, ca, cal, cb, cbl, &sum, &sum_len);
+    l = sizeof(m);
+    ok &= paillier_decrypt_into(&sk, sum, sum_len, m, &l) && paillier_unpack(&pack, m, l, back, 42);
+    for(int i = 0; i < 42; i++) {
+        ok &= back[i] == a[i] + b[i];
+    }
+
+    // slot wise (a + b) * 1000
+    uint8_t k[2] = {0x03, 0xe8};
+    paillier_mul(&pk, sum, sum_len, k, 2, &prod, &prod_len);
+    l = sizeof(m);
+    ok &= paillier_decrypt_into(&sk, prod, prod_len, m, &l) && paillier_unpack(&pack, m, l, back, 42);
+    for(int i = 0; i < 42; i++) {
+        ok &= back[i] == (a[i] + b[i]) * 1000;
+    }
+    free(sum);
+    free(prod);
+
+    // a partial pack leaves the upper slots empty, too wide values are refused
+    ml = sizeof(msg);
+    ok &= paillier_pack(&pack, b, 3, msg, &ml) && paillier_unpack(&pack, msg, ml, back, 5);
+    ok &= back[2] == b[2] && back[3] == 0 && back[4] == 0;
+    a[7] = (uint64_t) 1 << 32;
+    ml = sizeof(msg);
+    ok &= !paillier_pack(&pack, a, 42, msg, &ml);
+    ml = 16;
+    ok &= !paillier_pack(&pack, b, 42, msg, &ml) && ml == pack.bytes;
+    ok &= !paillier_pack(&pack, b, 43, msg, &ml);
+    printf(ok ? "paillier packed slot test success\n" : "paillier packed slot test failed\n");
+}
+
+void paillierSignedTest() {
+    printf("****begin paillier signed and fixed point test****\n");
+    PaillierPrivateKey sk;
+    PaillierPublicKey pk;
+    int ok = 1;
+    paillier_key_gen(&sk, &pk);
+
+    int64_t vals[6] = {0, 1, -1, 123456789, -987654321012LL, INT64_MIN}, back;
+    uint8_t msg[PAILLIER_N_MAX], c0[2 * PAILLIER_N_MAX], c1[2 * PAILLIER_N_MAX], c[2 * PAILLIER_N_MAX], m[PAILLIER_N_MAX];
+    size_t ml, c0l, c1l, cl, l;
+    for(int i = 0; i < 6; i++) {
+        ml = sizeof(msg);
+        c0l = sizeof(c0);
+        l = sizeof(m);
+        ok &= paillier_encode_signed(&pk, vals[i], msg, &ml) && paillier_encrypt_into(&pk, msg, ml, c0, &c0l);
+        ok &= paillier_decrypt_into(&sk, c0, c0l, m, &l) && paillier_decode_signed(&pk, m, l, &back) && back == vals[i];
+    }
+
+    // 1000 - 5000, -(1000), and (1000 - 5000) * -3
+    ml = sizeof(msg);
+    c0l = sizeof(c0);
+    paillier_encode_signed(&pk, 1000, msg, &ml);
+    paillier_encrypt_into(&pk, msg, ml, c0, &c0l);
+    ml = sizeof(msg);
+    c1l = sizeof(c1);
+    paillier_encode_signed(&pk, 5000, msg, &ml);
+    paillier_encrypt_into(&pk, msg, ml, c1, &c1l);
+    cl = sizeof(c);
+    l = sizeof(m);
+    ok &= paillier_sub_into(&pk, c0, c0l, c1, c1l, c, &cl);
+    ok &= paillier_decrypt_into(&sk, c, cl, m, &l) && paillier_decode_signed(&pk, m, l, &back) && back == -4000;
+    ml = sizeof(msg);
+    paillier_encode_signed(&pk, -3, msg, &ml);
+    uint8_t *prod = NULL, *neg = NULL;
+    size_t prod_len, neg_len;
+    paillier_mul(&pk, c, cl, msg, ml, &prod, &prod_len);
+    l = sizeof(m);
+    ok &= paillier_decrypt_into(&sk, prod, prod_len, m, &l) && paillier_decode_signed(&pk, m, l, &back) && back == 12000;
+    paillier_neg(&pk, c0, c0l, &neg, &neg_len);
+    l = sizeof(m);
+    ok &= paillier_decrypt_into(&sk, neg, neg_len, m, &l) && paillier_decode_signed(&pk, m, l, &back) && back == -1000;
+    free(prod);
+    free(neg);
+
+    // fixed point: 3.25 - 10.5 = -7.25, times -0.5 at scale^2
+    double scale = 1 << 20, d;
+    ml = sizeof(msg);
+    c0l = sizeof(c0);
+    ok &= paillier_encode_fixed(&pk, 3.25, scale, msg, &ml) && paillier_encrypt_into(&pk, msg, ml, c0, &c0l);
+    ml = sizeof(msg);
+    c1l = sizeof(c1);
+    ok &= paillier_encode_fixed(&pk, 10.5, scale, msg, &ml) && paillier_encrypt_into(&pk, msg, ml, c1, &c1l);
+    cl = sizeof(c);
+    l = sizeof(m);
+    ok &= paillier_sub_into(&pk, c0, c0l, c1, c1l, c, &cl);
+    ok &= paillier_decrypt_into(&sk, c, cl, m, &l) && paillier_decode_fixed(&pk, m, l, scale, &d) && d == -7.25;
+    ml = sizeof(msg);
+    ok &= paillier_encode_fixed(&pk, -0.5, scale, msg, &ml);
+    c0l = sizeof(c0);
+    l = sizeof(m);
+    ok &= paillier_mul_into(&pk, c, cl, msg, ml, c0, &c0l);
+    ok &= paillier_decrypt_into(&sk, c0, c0l, m, &l) && paillier_decode_fixed(&pk, m, l, scale * scale, &d) && d == 3.625;
+    ok &= !paillier_encode_fixed(&pk, 1.0 / 0.0, scale, msg, &ml);
+    ok &= !paillier_encode_fixed(&pk, 1.0, 0, msg, &ml);
+    ml = 4;
+    ok &= !paillier_encode_signed(&pk, 1, msg, &ml) && ml == 256;
+    printf(ok ? "paillier signed and fixed point test success\n" : "paillier signed and fixed point test failed\n");
+}
+
+void paillierRecordTest() {
+    printf("****begin paillier fixed width record test****\n");
+    PaillierPrivateKey sk;
+    PaillierPublicKey pk;
+    int ok = 1;
+    paillier_key_gen(&sk, &pk);
+    size_t width = paillier_cipher_width(&pk);
+    ok &= width == 512;
+
+    // every result is exactly 2 * |n| bytes
+    uint8_t m[8] = {0, 0, 0, 0, 0, 0, 1, 0}, c[2 * PAILLIER_N_MAX], back[PAILLIER_N_MAX];
+    size_t cl = sizeof(c), l;
+    uint8_t *t = NULL;
+    size_t t_len;
+    ok &= paillier_encrypt_into(&pk, m, 8, c, &cl) && cl == width;
+    paillier_add(&pk, c, cl, c, cl, &t, &t_len);
+    ok &= t_len == width;
+    free(t);
+    paillier_mul(&pk, c, cl, m + 6, 2, &t, &t_len);
+    ok &= t_len == width;
+    free(t);
+
+    // 100 records in one block, addressed by offset
+    int count = 100;
+    uint8_t *be = malloc(count * width), *limb = malloc(count * width);
+    const uint8_t **ptrs = malloc(count * sizeof(uint8_t *));
+    size_t *lens = malloc(count * sizeof(size_t));
+    for(int i = 0; i < count; i++) {
+        m[7] = (uint8_t) i;
+        cl = sizeof(c);
+        ok &= paillier_encrypt_into(&pk, m + 6, 2, c, &cl);
+        ok &= paillier_cipher_store(&pk, c, cl, PAILLIER_BE, be + i * width);
+        ok &= paillier_cipher_store(&pk, c, cl, PAILLIER_LIMB64, limb + i * width);
+        ptrs[i] = be + i * width;
+        lens[i] = width;
+    }
+    // big endian records are used in place
+    uint8_t sum[2 * PAILLIER_N_MAX];
+    size_t sl = sizeof(sum);
+    ok &= paillier_sum_into(&pk, ptrs, lens, count, sum, &sl);
+    l = sizeof(back);
+    ok &= paillier_decrypt_into(&sk, sum, sl, back, &l) && be_u64(back, l) == 256 * count + count * (count - 1) / 2;
+    for(int i = 0; i < count; i++) {
+        cl = sizeof(c);
+        l = sizeof(back);
+        ok &= paillier_cipher_load(&pk, limb + i * width, PAILLIER_LIMB64, c, &cl) && cl == width && !memcmp(c, be + i * width, width);
+        ok &= paillier_decrypt_into(&sk, c, cl, back, &l) && be_u64(back, l) == (uint64_t) 256 + i;
+    }
+    cl = 16;
+    ok &= !paillier_cipher_load(&pk, be, PAILLIER_BE, c, &cl) && cl == width;
+    ok &= !paillier_cipher_store(&pk, c, width, 7, be);
+    free(be);
+    free(limb);
+    free(ptrs);
+    free(lens);
+    printf(ok ? "paillier fixed width record test success\n" : "paillier fixed width record test failed\n");
+}
+
+void paillierBatchTest() {
+    printf("****begin paillier batch test****\n");
+    PaillierPrivateKey sk, legacy;
+    PaillierPublicKey pk;
+    int ok = 1, count = 37, simd = paillier_set_simd(1);
+    printf("ifma kernel %s\n", simd ? "in use" : "not available, gmp only");
+    paillier_key_gen(&sk, &pk);
+    size_t nb = paillier_cipher_width(&pk) / 2, cl, ml;
+    uint8_t *msgs = calloc(count, nb), *ciphers = malloc(count * 2 * nb), *back = malloc(count * nb);
+    for(int i = 0; i < count; i++) {
+        for(size_t j = 0; j < 24; j++) {
+            msgs[i * nb + nb - 1 - j] = (uint8_t) (i * 31 + j * 7 + 1);
+        }
+    }
+    // all messages are |n| bytes, the last one n - 1
+    memcpy(msgs + (count - 1) * nb, pk.n + PAILLIER_N_MAX - nb, nb);
+    msgs[count * nb - 1] -= 1;
+
+    cl = 16;
+    ok &= !paillier_encrypt_batch_into(&pk, msgs, count, ciphers, &cl) && cl == count * 2 * nb;
+    clock_t t0 = clock();
+    ok &= paillier_encrypt_batch_into(&pk, msgs, count, ciphers, &cl);
+    clock_t t1 = clock();
+    ml = count * nb;
+    ok &= paillier_decrypt_batch_into(&sk, ciphers, count, back, &ml) && ml == count * nb && !memcmp(back, msgs, ml);
+    clock_t t2 = clock();
+    for(int i = 0; i < count; i++) {
+        uint8_t m[PAILLIER_N_MAX];
+        size_t l = sizeof(m);
+        ok &= paillier_decrypt_into(&sk, ciphers + i * 2 * nb, 2 * nb, m, &l) && l <= nb && !memcmp(m, msgs + i * nb + nb - l, l);
+    }
+    clock_t t3 = clock();
+    printf("%d ciphers: batch encrypt %ldms, batch decrypt %ldms, decrypt one by one %ldms\n", count,
+        (long) ((t1 - t0) * 1000 / CLOCKS_PER_SEC), (long) ((t2 - t1) * 1000 / CLOCKS_PER_SEC), (long) ((t3 - t2) * 1000 / CLOCKS_PER_SEC));
+
+    // the same buffer again right away draws new r for every message
+    uint8_t *again = malloc(count * 2 * nb);
+    cl = count * 2 * nb;
+    ok &= paillier_encrypt_batch_into(&pk, msgs, count, again, &cl);
+    for(int i = 0; i < count; i++) {
+        ok &= memcmp(again + i * 2 * nb, ciphers + i * 2 * nb, 2 * nb) != 0;
+    }
+    free(again);
+
+    // keys without p and q take c^l mod n^2
+    legacy = sk;
+    memset(legacy.p, 0, sizeof(legacy.p));
+    memset(legacy.q, 0, sizeof(legacy.q));
+    memset(back, 0, count * nb);
+    ml = count * nb;
+    ok &= paillier_decrypt_batch_into(&legacy, ciphers, count, back, &ml) && !memcmp(back, msgs, ml);
+
+    // the gmp path gives the same messages
+    paillier_set_simd(0);
+    memset(back, 0, count * nb);
+    ml = count * nb;
+    t0 = clock();
+    ok &= paillier_decrypt_batch_into(&sk, ciphers, count, back, &ml) && !memcmp(back, msgs, ml);
+    t1 = clock();
+    ok &= paillier_encrypt_batch_into(&pk, msgs, 5, ciphers, &cl);
+    ml = 5 * nb;
+    ok &= paillier_decrypt_batch_into(&sk, ciphers, 5, back, &ml) && !memcmp(back, msgs, ml);
+    printf("batch decrypt without the kernel %ldms\n", (long) ((t1 - t0) * 1000 / CLOCKS_PER_SEC));
+    paillier_set_simd(1);
+
+    // a 1024 bit key, 2 lanes in use falls back to gmp
+    ok &= paillier_key_gen_bits(&sk, &pk, 1024);
+    nb = paillier_cipher_width(&pk) / 2;
+    for(int c = 2; c <= 11; c += 9) {
+        cl = count * 2 * nb;
+        ml = count * nb;
+        ok &= paillier_encrypt_batch_into(&pk, msgs, c, ciphers, &cl) && paillier_decrypt_batch_into(&sk, ciphers, c, back, &ml);
+        ok &= !memcmp(back, msgs, c * nb);
+    }
+    free(msgs);
+    free(ciphers);
+    free(back);
+    printf(ok ? "paillier batch test success\n" : "paillier batch test failed\n");
+}
+
+void paillierPoolTest() {
+    printf("****begin paillier pool test****\n");
+    PaillierPrivateKey sk;
+    PaillierPublicKey pk;
+    uint8_t msg[8] = "12345678", cipher[2 * PAILLIER_N_MAX], back[PAILLIER_N_MAX], ciphers[64 * 2 * PAILLIER_N_MAX];
+    size_t cl, l, lens[64];
+    int ok = 1, count = 64;
+
+    paillier_key_gen(&sk, &pk);
+    PaillierEncCtx *bg = paillier_enc_ctx_new(&pk, count, 2), *fg = paillier_enc_ctx_new(&pk, count, 0);
+    ok &= paillier_enc_ctx_fill(fg, count + 10) == count && paillier_enc_ctx_available(fg) == count;
+    while(paillier_enc_ctx_available(bg) < count) {
+        paillier_enc_ctx_fill(bg, 1);
+    }
+
+    clock_t t1 = clock();
+    for(int i = 0; i < count; i++) {
+        cl = sizeof(cipher);
+        paillier_encrypt_into(&pk, msg, 8, cipher, &cl);
+    }
+    clock_t t2 = clock();
+    for(int i = 0; i < count; i++) {
+        cl = sizeof(cipher);
+        msg[0] = i + 1;
+        ok &= paillier_enc_ctx_encrypt_into(i & 1 ? bg : fg, msg, 8, ciphers + i * 2 * PAILLIER_N_MAX, &cl);
+        lens[i] = cl;
+    }
+    clock_t t3 = clock();
+    for(int i = 0; i < count; i++) {
+        l = PAILLIER_N_MAX;
+        msg[0] = i + 1;
+        ok &= paillier_decrypt_into(&sk, ciphers + i * 2 * PAILLIER_N_MAX, lens[i], back, &l) && l == 8 && !memcmp(back, msg, 8);
+    }
+    ok &= paillier_enc_ctx_available(fg) == count / 2;
+    // empty pool computes inline
+    for(int i = 0; i < count; i++) {
+        cl = sizeof(cipher);
+        ok &= paillier_enc_ctx_encrypt_into(fg, msg, 8, cipher, &cl);
+    }
+    l = PAILLIER_N_MAX;
+    ok &= paillier_decrypt_into(&sk, cipher, cl, back, &l) && l == 8 && !memcmp(back, msg, 8);
+    printf("encrypt %d (cpu time, workers included): plain %ldms, pooled %ldms\n", count, (long) ((t2 - t1) * 1000 / CLOCKS_PER_SEC), (long) ((t3 - t2) * 1000 / CLOCKS_PER_SEC));
+    paillier_enc_ctx_free(bg);
+    paillier_enc_ctx_free(fg);
+
+    printf(ok ? "paillier pool test success\n" : "paillier pool test failed\n");
+}
+
+static size_t gmp_alloc_count = 0;
+
+static void *count_alloc(size_t n) {
+    gmp_alloc_count++;
+    return malloc(n);
+}
+
+static void *count_realloc(void *p, size_t old_size, size_t new_size) {
+    gmp_alloc_count++;
+    return realloc(p, new_size);
+}
+
+static void count_free(void *p, size_t size) {
+    free(p);
+}
+
+void allocTest() {
+    printf("****begin allocation test****\n");
+    uint8_t d[32] = {29, -3, 74, 47, 123, 64, 41, 123, 67, -9, 89, 16, 84, 115, 18, -8, -41, -97, -57, 36, 103, 60, 115, -123, -5, -38, -97, 127, 32, -21, -25, 2};
+    EcPrivateKey sk;
+    EcPublicKey sec_pk, sm2_pk, rec_pk;
+    EcSignature sig;
+    Hash32 h;
+    int recv_id = 0, ok = 1;
+
+    mp_set_memory_functions(count_alloc, count_realloc, count_free);
+    memcpy(sk.d, d, 32);
+    secp256k1_privateKey_to_publicKey(&sk, &sec_pk);
+    sm2p256v1_privateKey_to_publicKey(&sk, &sm2_pk);
+
+    // warm up: curve constants and this thread's scratch arena
+    for(int i = 0; i < 2; i++) {
+        secp256k1_sign(&sk, d, 32, &sig, &recv_id);
+        secp256k1_verify(&sec_pk, d, 32, &sig);
+        secp256k1_recover_publicKey(&sig, d, 32, recv_id, &rec_pk);
+        sm2p256v1_sign(&sk, d, 32, &sig);
+        sm2p256v1_verify(&sm2_pk, d, 32, &sig);
+    }
+
+    gmp_alloc_count = 0;
+    for(int i = 0; i < 100; i++) {
+        d[0] = i;
+        secp256k1_sign(&sk, d, 32, &sig, &recv_id);
+        ok &= secp256k1_verify(&sec_pk, d, 32, &sig);
+        secp256k1_recover_publicKey(&sig, d, 32, recv_id, &rec_pk);
+        sm2p256v1_sign(&sk, d, 32, &sig);
+        ok &= sm2p256v1_verify(&sm2_pk, d, 32, &sig);
+        sha256(d, 32, &h);
+        keccak256(d, 32, &h);
+        sm3(d, 32, &h);
+    }
+    printf("verify = %d, gmp allocations = %lu\n", ok, gmp_alloc_count);
+    printf(gmp_alloc_count ? "allocation test failed\n" : "allocation test success\n");
+
+    archer_arena_free();
+    mp_set_memory_functions(NULL, NULL, NULL);
+}
+
+static size_t out_alloc_count = 0;
+
+static void *count_out_alloc(size_t n) {
+    out_alloc_count++;
+    return malloc(n);
+}
+
+void intoTest() {
+    printf("****begin caller buffer test****\n");
+    uint8_t key[16] = "keys0123456789ab";
+    const uint8_t *msg = (const uint8_t *) "nihao,shijie,nihao,shijie";
+    size_t msg_len = strlen((const char *) msg);
+    EcPrivateKey sk;
+    EcPublicKey pk;
+    sm2p256v1_key_gen(&sk, &pk);
+
+    uint8_t buf[256], text[256];
+    size_t buf_len = 0, text_len = sizeof(text);
+    int ok = 1;
+
+    sm4_encrypt_into(key, msg, msg_len, NULL, &buf_len);
+    ok &= buf_len == 32;
+    ok &= sm4_encrypt_into(key, msg, msg_len, buf, &buf_len);
+    ok &= sm4_decrypt_into(key, buf, buf_len, text, &text_len);
+    ok &= text_len == msg_len && !memcmp(text, msg, msg_len);
+
+    // in place, then a corrupted pad byte
+    buf_len = sizeof(buf);
+    sm4_encrypt_into(key, msg, msg_len, buf, &buf_len);
+    size_t in_len = buf_len;
+    ok &= sm4_decrypt_into(key, buf, in_len, buf, &buf_len);
+    ok &= buf_len == msg_len && !memcmp(buf, msg, msg_len);
+    uint8_t block[16] = "0123456789abcde";
+    block[15] = 3;
+    block[14] = 3;
+    block[13] = 4;
+    buf_len = sizeof(buf);
+    sm4_encrypt_into(key, block, 16, buf, &buf_len);
+    text_len = sizeof(text);
+    ok &= !sm4_decrypt_into(key, buf, 16, text, &text_len);
+
+    buf_len = 10;
+    ok &= !sm2p256v1_encrypt_into(&pk, msg, msg_len, SM2_C1C3C2, buf, &buf_len);
+    ok &= buf_len == 97 + msg_len;
+    ok &= sm2p256v1_encrypt_into(&pk, msg, msg_len, SM2_C1C3C2, buf, &buf_len);
+    text_len = sizeof(text);
+    ok &= sm2p256v1_decrypt_into(&sk, buf, buf_len, SM2_C1C3C2, text, &text_len);
+    ok &= text_len == msg_len && !memcmp(text, msg, msg_len);
+
+    // a failed C3 check hands back no plaintext
+    uint8_t zero[256] = {0}, *dec = NULL;
+    size_t dec_len;
+    buf[65] ^= 1;
+    text_len = sizeof(text);
+    ok &= !sm2p256v1_decrypt_into(&sk, buf, buf_len, SM2_C1C3C2, text, &text_len);
+    ok &= text_len == 0 && !memcmp(text, zero, msg_len);
+    ok &= !sm2p256v1_decrypt(&sk, buf, buf_len, SM2_C1C3C2, &dec, &dec_len);
+    ok &= dec == NULL && dec_len == 0;
+
+    uint8_t *cipher = NULL;
+    size_t cipher_len = 0;
+    archer_set_allocator(count_out_alloc, free);
+    sm4_encrypt(key, msg, msg_len, &cipher, &cipher_len);
+    archer_free(cipher);
+    archer_set_allocator(NULL, NULL);
+    ok &= out_alloc_count == 1;
+
+    printf(ok ? "caller buffer test success\n" : "caller buffer test failed\n");
+}
+
 // gcc test.c -L. -lalg -O3 -o test.exe
 // gcc *.c -lgmp -O3 -o test.exe
 int main() {
@@ -195,14 +1274,42 @@ int main() {
     // sm2Test();
     // secTest();
     // sm4Test();
-
-    sm2CostTest();
+    // sm4ModeTest();
+    // sm4CostTest();
+    // sm4StreamTest();
+    // sm4ParallelTest();
 
     // sm2CryptoTest();
 
+    // sm2ExchangeTest();
+
+    // sm2StreamTest();
+
     // testBits();
 
     // paillierTest();
 
+    // paillierKeyGenTest();
+
+    // paillierCrtTest();
+
+    // paillierSumTest();
+
+    // paillierMultiExpTest();
+
+    // paillierPoolTest();
+
+    // paillierPackTest();
+
+    // paillierSignedTest();
+
+    // paillierRecordTest();
+
+    // paillierBatchTest();
+
+    // allocTest();
+
+    // intoTest();
+
     return 0;
 }
@@ -0,0 +1,706 @@
+#include <jni.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../algorithm/archer.h"
+
+#ifndef _Included_com_archer_math_Archer
+#define _Included_com_archer_math_Archer
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* Bindings of archer.h, one native call per operation.
+* Fixed-size keys and signatures are copied with GetByteArrayRegion.
+* Hash and SM4 inputs are pinned with GetPrimitiveArrayCritical so bulk
+* data is never copied on the way in. EC and Paillier inputs are copied
+* as well: a scalar multiplication or a 4096 bit exponentiation inside a
+* critical region would hold off the GC for milliseconds.
+* No JNI function is called while a critical region is held.
+*/
+
+// EC and Paillier inputs up to this size are copied to the stack
+#define ARCHER_COPY_BUF 1024
+
+static int archer_copy_fixed(JNIEnv *env, jbyteArray jarr, uint8_t *out, jsize len) {
+    if(NULL == jarr || (*env)->GetArrayLength(env, jarr) != len) {
+        return 0;
+    }
+    (*env)->GetByteArrayRegion(env, jarr, 0, len, (jbyte *)out);
+    return 1;
+}
+
+// paillier n of any size up to PAILLIER_N_MAX bytes (e.g. 128 byte keys from before), right aligned
+static int archer_copy_paillier_pk(JNIEnv *env, jbyteArray jarr, PaillierPublicKey *pk) {
+    jsize len = NULL == jarr ? 0 : (*env)->GetArrayLength(env, jarr);
+    if(len <= 0 || len > PAILLIER_N_MAX) {
+        return 0;
+    }
+    memset(pk, 0, sizeof(PaillierPublicKey));
+    (*env)->GetByteArrayRegion(env, jarr, 0, len, (jbyte *)pk->n + (PAILLIER_N_MAX - len));
+    return 1;
+}
+
+// the full struct, or the 1024 bit layouts n(128) || l(128) [|| p(64) || q(64)]
+static int archer_copy_paillier_sk(JNIEnv *env, jbyteArray jarr, PaillierPrivateKey *sk) {
+    jsize len = NULL == jarr ? 0 : (*env)->GetArrayLength(env, jarr);
+    uint8_t old[384];
+    if(len == sizeof(PaillierPrivateKey)) {
+        (*env)->GetByteArrayRegion(env, jarr, 0, len, (jbyte *)sk);
+        return 1;
+    }
+    if(len != 256 && len != 384) {
+        return 0;
+    }
+    (*env)->GetByteArrayRegion(env, jarr, 0, len, (jbyte *)old);
+    memset(sk, 0, sizeof(PaillierPrivateKey));
+    memcpy(sk->n + (PAILLIER_N_MAX - 128), old, 128);
+    memcpy(sk->l + (PAILLIER_N_MAX - 128), old + 128, 128);
+    if(len == 384) {
+        memcpy(sk->p + (PAILLIER_P_MAX - 64), old + 256, 64);
+        memcpy(sk->q + (PAILLIER_P_MAX - 64), old + 320, 64);
+    }
+    return 1;
+}
+
+// copy of jarr in buf, or a malloc'd block when it is larger, NULL when out of memory
+static uint8_t *archer_copy_bytes(JNIEnv *env, jbyteArray jarr, uint8_t *buf, jsize len) {
+    uint8_t *out = len <= ARCHER_COPY_BUF ? buf : (uint8_t *)malloc(len);
+    if(NULL != out) {
+        (*env)->GetByteArrayRegion(env, jarr, 0, len, (jbyte *)out);
+    }
+    return out;
+}
+
+static void archer_release_copy(uint8_t *p, uint8_t *buf) {
+    if(p != buf) {
+        free(p);
+    }
+}
+
+static jbyteArray archer_new_bytes(JNIEnv *env, const uint8_t *in, size_t len) {
+    jbyteArray ret = (*env)->NewByteArray(env, len);
+    if(NULL != ret) {
+        (*env)->SetByteArrayRegion(env, ret, 0, len, (const jbyte *)in);
+    }
+    return ret;
+}
+
+typedef void (*archer_hash_fn)(const uint8_t *, const size_t, Hash32 *);
+
+static jbyteArray archer_hash(JNIEnv *env, jbyteArray jin, archer_hash_fn fn) {
+    if(NULL == jin) {
+        return NULL;
+    }
+    Hash32 h;
+    jsize in_len = (*env)->GetArrayLength(env, jin);
+    uint8_t *in = (*env)->GetPrimitiveArrayCritical(env, jin, NULL);
+    if(NULL == in) {
+        return NULL;
+    }
+    fn(in, in_len, &h);
+    (*env)->ReleasePrimitiveArrayCritical(env, jin, in, JNI_ABORT);
+    return archer_new_bytes(env, h.h, 32);
+}
+
+static jbyteArray archer_hash_direct(JNIEnv *env, jobject jbuf, jint off, jint len, archer_hash_fn fn) {
+    if(NULL == jbuf || off < 0 || len < 0) {
+        return NULL;
+    }
+    uint8_t *in = (*env)->GetDirectBufferAddress(env, jbuf);
+    jlong cap = (*env)->GetDirectBufferCapacity(env, jbuf);
+    if(NULL == in || (jlong)off + len > cap) {
+        return NULL;
+    }
+    Hash32 h;
+    fn(in + off, len, &h);
+    return archer_new_bytes(env, h.h, 32);
+}
+
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    secp256k1KeyGen
+ * Signature: ()[B
+ * @return d(32) || x(32) || y(32)
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_secp256k1KeyGen
+  (JNIEnv *env, jclass clazz) {
+    EcPrivateKey sk;
+    EcPublicKey pk;
+    uint8_t kc[96];
+    secp256k1_key_gen(&sk, &pk);
+    memcpy(kc, sk.d, 32);
+    memcpy(kc + 32, pk.x, 32);
+    memcpy(kc + 64, pk.y, 32);
+    return archer_new_bytes(env, kc, 96);
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    secp256k1PublicKey
+ * Signature: ([B)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_secp256k1PublicKey
+  (JNIEnv *env, jclass clazz, jbyteArray jsk) {
+    EcPrivateKey sk;
+    EcPublicKey pk;
+    if(!archer_copy_fixed(env, jsk, sk.d, 32)) {
+        return NULL;
+    }
+    secp256k1_privateKey_to_publicKey(&sk, &pk);
+    return archer_new_bytes(env, (uint8_t *)&pk, 64);
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    secp256k1Sign
+ * Signature: ([B[B)[B
+ * @return r(32) || s(32) || recv_id(1)
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_secp256k1Sign
+  (JNIEnv *env, jclass clazz, jbyteArray jsk, jbyteArray jmsg) {
+    EcPrivateKey sk;
+    EcSignature sig;
+    int recv_id = 0;
+    if(NULL == jmsg || !archer_copy_fixed(env, jsk, sk.d, 32)) {
+        return NULL;
+    }
+    jsize msg_len = (*env)->GetArrayLength(env, jmsg);
+    uint8_t msg_buf[ARCHER_COPY_BUF];
+    uint8_t *msg = archer_copy_bytes(env, jmsg, msg_buf, msg_len);
+    if(NULL == msg) {
+        return NULL;
+    }
+    secp256k1_sign(&sk, msg, msg_len, &sig, &recv_id);
+    archer_release_copy(msg, msg_buf);
+
+    uint8_t sc[65];
+    memcpy(sc, &sig, 64);
+    sc[64] = (uint8_t)recv_id;
+    return archer_new_bytes(env, sc, 65);
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    secp256k1Verify
+ * Signature: ([B[B[B)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_archer_math_Archer_secp256k1Verify
+  (JNIEnv *env, jclass clazz, jbyteArray jpk, jbyteArray jmsg, jbyteArray jsig) {
+    EcPublicKey pk;
+    EcSignature sig;
+    if(NULL == jmsg || !archer_copy_fixed(env, jpk, (uint8_t *)&pk, 64)
+            || !archer_copy_fixed(env, jsig, (uint8_t *)&sig, 64)) {
+        return JNI_FALSE;
+    }
+    jsize msg_len = (*env)->GetArrayLength(env, jmsg);
+    uint8_t msg_buf[ARCHER_COPY_BUF];
+    uint8_t *msg = archer_copy_bytes(env, jmsg, msg_buf, msg_len);
+    if(NULL == msg) {
+        return JNI_FALSE;
+    }
+    int ret = secp256k1_verify(&pk, msg, msg_len, &sig);
+    archer_release_copy(msg, msg_buf);
+    return ret ? JNI_TRUE : JNI_FALSE;
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    secp256k1RecoverPublicKey
+ * Signature: ([B[BI)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_secp256k1RecoverPublicKey
+  (JNIEnv *env, jclass clazz, jbyteArray jsig, jbyteArray jmsg, jint recv_id) {
+    EcPublicKey pk;
+    EcSignature sig;
+    if(NULL == jmsg || !archer_copy_fixed(env, jsig, (uint8_t *)&sig, 64)) {
+        return NULL;
+    }
+    jsize msg_len = (*env)->GetArrayLength(env, jmsg);
+    uint8_t msg_buf[ARCHER_COPY_BUF];
+    uint8_t *msg = archer_copy_bytes(env, jmsg, msg_buf, msg_len);
+    if(NULL == msg) {
+        return NULL;
+    }
+    secp256k1_recover_publicKey(&sig, msg, msg_len, recv_id, &pk);
+    archer_release_copy(msg, msg_buf);
+    return archer_new_bytes(env, (uint8_t *)&pk, 64);
+}
+
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    sm2KeyGen
+ * Signature: ()[B
+ * @return d(32) || x(32) || y(32)
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_sm2KeyGen
+  (JNIEnv *env, jclass clazz) {
+    EcPrivateKey sk;
+    EcPublicKey pk;
+    uint8_t kc[96];
+    sm2p256v1_key_gen(&sk, &pk);
+    memcpy(kc, sk.d, 32);
+    memcpy(kc + 32, pk.x, 32);
+    memcpy(kc + 64, pk.y, 32);
+    return archer_new_bytes(env, kc, 96);
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    sm2PublicKey
+ * Signature: ([B)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_sm2PublicKey
+  (JNIEnv *env, jclass clazz, jbyteArray jsk) {
+    EcPrivateKey sk;
+    EcPublicKey pk;
+    if(!archer_copy_fixed(env, jsk, sk.d, 32)) {
+        return NULL;
+    }
+    sm2p256v1_privateKey_to_publicKey(&sk, &pk);
+    return archer_new_bytes(env, (uint8_t *)&pk, 64);
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    sm2Sign
+ * Signature: ([B[B)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_sm2Sign
+  (JNIEnv *env, jclass clazz, jbyteArray jsk, jbyteArray jmsg) {
+    EcPrivateKey sk;
+    EcSignature sig;
+    if(NULL == jmsg || !archer_copy_fixed(env, jsk, sk.d, 32)) {
+        return NULL;
+    }
+    jsize msg_len = (*env)->GetArrayLength(env, jmsg);
+    uint8_t msg_buf[ARCHER_COPY_BUF];
+    uint8_t *msg = archer_copy_bytes(env, jmsg, msg_buf, msg_len);
+    if(NULL == msg) {
+        return NULL;
+    }
+    sm2p256v1_sign(&sk, msg, msg_len, &sig);
+    archer_release_copy(msg, msg_buf);
+    return archer_new_bytes(env, (uint8_t *)&sig, 64);
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    sm2Verify
+ * Signature: ([B[B[B)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_archer_math_Archer_sm2Verify
+  (JNIEnv *env, jclass clazz, jbyteArray jpk, jbyteArray jmsg, jbyteArray jsig) {
+    EcPublicKey pk;
+    EcSignature sig;
+    if(NULL == jmsg || !archer_copy_fixed(env, jpk, (uint8_t *)&pk, 64)
+            || !archer_copy_fixed(env, jsig, (uint8_t *)&sig, 64)) {
+        return JNI_FALSE;
+    }
+    jsize msg_len = (*env)->GetArrayLength(env, jmsg);
+    uint8_t msg_buf[ARCHER_COPY_BUF];
+    uint8_t *msg = archer_copy_bytes(env, jmsg, msg_buf, msg_len);
+    if(NULL == msg) {
+        return JNI_FALSE;
+    }
+    int ret = sm2p256v1_verify(&pk, msg, msg_len, &sig);
+    archer_release_copy(msg, msg_buf);
+    return ret ? JNI_TRUE : JNI_FALSE;
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    sm2Encrypt
+ * Signature: ([B[BI)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_sm2Encrypt
+  (JNIEnv *env, jclass clazz, jbyteArray jpk, jbyteArray jmsg, jint mode) {
+    EcPublicKey pk;
+    if(NULL == jmsg || (SM2_C1C2C3 != mode && SM2_C1C3C2 != mode)
+            || !archer_copy_fixed(env, jpk, (uint8_t *)&pk, 64)) {
+        return NULL;
+    }
+    uint8_t *out = NULL;
+    size_t out_len = 0;
+    jsize msg_len = (*env)->GetArrayLength(env, jmsg);
+    uint8_t msg_buf[ARCHER_COPY_BUF];
+    uint8_t *msg = archer_copy_bytes(env, jmsg, msg_buf, msg_len);
+    if(NULL == msg) {
+        return NULL;
+    }
+    sm2p256v1_encrypt(&pk, msg, msg_len, mode, &out, &out_len);
+    archer_release_copy(msg, msg_buf);
+
+    jbyteArray ret = archer_new_bytes(env, out, out_len);
+    archer_free(out);
+    return ret;
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    sm2Decrypt
+ * Signature: ([B[BI)[B
+ * @return null if decrypt failed
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_sm2Decrypt
+  (JNIEnv *env, jclass clazz, jbyteArray jsk, jbyteArray jcipher, jint mode) {
+    EcPrivateKey sk;
+    if(NULL == jcipher || (SM2_C1C2C3 != mode && SM2_C1C3C2 != mode)
+            || !archer_copy_fixed(env, jsk, sk.d, 32)) {
+        return NULL;
+    }
+    uint8_t *out = NULL;
+    size_t out_len = 0;
+    jsize cipher_len = (*env)->GetArrayLength(env, jcipher);
+    uint8_t cipher_buf[ARCHER_COPY_BUF];
+    uint8_t *cipher = archer_copy_bytes(env, jcipher, cipher_buf, cipher_len);
+    if(NULL == cipher) {
+        return NULL;
+    }
+    int ok = sm2p256v1_decrypt(&sk, cipher, cipher_len, mode, &out, &out_len);
+    archer_release_copy(cipher, cipher_buf);
+
+    jbyteArray ret = ok ? archer_new_bytes(env, out, out_len) : NULL;
+    archer_free(out);
+    return ret;
+}
+
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    sha256
+ * Signature: ([B)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_sha256
+  (JNIEnv *env, jclass clazz, jbyteArray jin) {
+    return archer_hash(env, jin, sha256);
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    sm3
+ * Signature: ([B)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_sm3
+  (JNIEnv *env, jclass clazz, jbyteArray jin) {
+    return archer_hash(env, jin, sm3);
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    keccak256
+ * Signature: ([B)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_keccak256
+  (JNIEnv *env, jclass clazz, jbyteArray jin) {
+    return archer_hash(env, jin, keccak256);
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    sha256Direct
+ * Signature: (Ljava/nio/ByteBuffer;II)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_sha256Direct
+  (JNIEnv *env, jclass clazz, jobject jbuf, jint off, jint len) {
+    return archer_hash_direct(env, jbuf, off, len, sha256);
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    sm3Direct
+ * Signature: (Ljava/nio/ByteBuffer;II)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_sm3Direct
+  (JNIEnv *env, jclass clazz, jobject jbuf, jint off, jint len) {
+    return archer_hash_direct(env, jbuf, off, len, sm3);
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    keccak256Direct
+ * Signature: (Ljava/nio/ByteBuffer;II)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_keccak256Direct
+  (JNIEnv *env, jclass clazz, jobject jbuf, jint off, jint len) {
+    return archer_hash_direct(env, jbuf, off, len, keccak256);
+}
+
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    sm4Encrypt
+ * Signature: ([B[B)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_sm4Encrypt
+  (JNIEnv *env, jclass clazz, jbyteArray jkey, jbyteArray jin) {
+    uint8_t key[16];
+    if(NULL == jin || !archer_copy_fixed(env, jkey, key, 16)) {
+        return NULL;
+    }
+    uint8_t *out = NULL;
+    size_t out_len = 0;
+    jsize in_len = (*env)->GetArrayLength(env, jin);
+    uint8_t *in = (*env)->GetPrimitiveArrayCritical(env, jin, NULL);
+    if(NULL == in) {
+        return NULL;
+    }
+    sm4_encrypt(key, in, in_len, &out, &out_len);
+    (*env)->ReleasePrimitiveArrayCritical(env, jin, in, JNI_ABORT);
+
+    jbyteArray ret = archer_new_bytes(env, out, out_len);
+    archer_free(out);
+    return ret;
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    sm4Decrypt
+ * Signature: ([B[B)[B
+ * @return null if decrypt failed
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_sm4Decrypt
+  (JNIEnv *env, jclass clazz, jbyteArray jkey, jbyteArray jin) {
+    uint8_t key[16];
+    if(NULL == jin || !archer_copy_fixed(env, jkey, key, 16)) {
+        return NULL;
+    }
+    uint8_t *out = NULL;
+    size_t out_len = 0;
+    jsize in_len = (*env)->GetArrayLength(env, jin);
+    uint8_t *in = (*env)->GetPrimitiveArrayCritical(env, jin, NULL);
+    if(NULL == in) {
+        return NULL;
+    }
+    int ok = sm4_decrypt(key, in, in_len, &out, &out_len);
+    (*env)->ReleasePrimitiveArrayCritical(env, jin, in, JNI_ABORT);
+
+    jbyteArray ret = ok ? archer_new_bytes(env, out, out_len) : NULL;
+    archer_free(out);
+    return ret;
+}
+
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    paillierKeyGenBits
+ * Signature: (I)[B
+ * @param bits, 1024 to 4096, a multiple of 64
+ * @return same layout as paillierKeyGen, NULL for an unsupported size
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_paillierKeyGenBits
+  (JNIEnv *env, jclass clazz, jint bits) {
+    PaillierPrivateKey sk;
+    PaillierPublicKey pk;
+    uint8_t kc[sizeof(sk) + sizeof(pk)];
+    if(!paillier_key_gen_bits(&sk, &pk, bits)) {
+        return NULL;
+    }
+    memcpy(kc, &sk, sizeof(sk));
+    memcpy(kc + sizeof(sk), &pk, sizeof(pk));
+    return archer_new_bytes(env, kc, sizeof(kc));
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    paillierKeyGen
+ * Signature: ()[B
+ * @return sk.n(512) || sk.l(512) || sk.p(256) || sk.q(256) || pk.n(512), right aligned
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_paillierKeyGen
+  (JNIEnv *env, jclass clazz) {
+    return Java_com_archer_math_Archer_paillierKeyGenBits(env, clazz, PAILLIER_DEFAULT_BITS);
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    paillierEncrypt
+ * Signature: ([B[B)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_paillierEncrypt
+  (JNIEnv *env, jclass clazz, jbyteArray jpk, jbyteArray jmsg) {
+    PaillierPublicKey pk;
+    if(NULL == jmsg || !archer_copy_paillier_pk(env, jpk, &pk)) {
+        return NULL;
+    }
+    uint8_t *out = NULL;
+    size_t out_len = 0;
+    jsize msg_len = (*env)->GetArrayLength(env, jmsg);
+    uint8_t msg_buf[ARCHER_COPY_BUF];
+    uint8_t *msg = archer_copy_bytes(env, jmsg, msg_buf, msg_len);
+    if(NULL == msg) {
+        return NULL;
+    }
+    paillier_encrypt(&pk, msg, msg_len, &out, &out_len);
+    archer_release_copy(msg, msg_buf);
+
+    jbyteArray ret = archer_new_bytes(env, out, out_len);
+    archer_free(out);
+    return ret;
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    paillierDecrypt
+ * Signature: ([B[B)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_paillierDecrypt
+  (JNIEnv *env, jclass clazz, jbyteArray jsk, jbyteArray jcipher) {
+    PaillierPrivateKey sk;
+    // keys generated before p and q were kept are n || l, they decrypt without crt
+    if(NULL == jcipher || !archer_copy_paillier_sk(env, jsk, &sk)) {
+        return NULL;
+    }
+    uint8_t *out = NULL;
+    size_t out_len = 0;
+    jsize cipher_len = (*env)->GetArrayLength(env, jcipher);
+    uint8_t cipher_buf[ARCHER_COPY_BUF];
+    uint8_t *cipher = archer_copy_bytes(env, jcipher, cipher_buf, cipher_len);
+    if(NULL == cipher) {
+        return NULL;
+    }
+    paillier_decrypt(&sk, cipher, cipher_len, &out, &out_len);
+    archer_release_copy(cipher, cipher_buf);
+
+    jbyteArray ret = archer_new_bytes(env, out, out_len);
+    archer_free(out);
+    return ret;
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    paillierAdd
+ * Signature: ([B[B[B)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_paillierAdd
+  (JNIEnv *env, jclass clazz, jbyteArray jpk, jbyteArray jc0, jbyteArray jc1) {
+    PaillierPublicKey pk;
+    if(NULL == jc0 || NULL == jc1 || !archer_copy_paillier_pk(env, jpk, &pk)) {
+        return NULL;
+    }
+    uint8_t *out = NULL;
+    size_t out_len = 0;
+    jsize c0_len = (*env)->GetArrayLength(env, jc0);
+    jsize c1_len = (*env)->GetArrayLength(env, jc1);
+    uint8_t c0_buf[ARCHER_COPY_BUF];
+    uint8_t *c0 = archer_copy_bytes(env, jc0, c0_buf, c0_len);
+    if(NULL == c0) {
+        return NULL;
+    }
+    uint8_t c1_buf[ARCHER_COPY_BUF];
+    uint8_t *c1 = archer_copy_bytes(env, jc1, c1_buf, c1_len);
+    if(NULL == c1) {
+        archer_release_copy(c0, c0_buf);
+        return NULL;
+    }
+    paillier_add(&pk, c0, c0_len, c1, c1_len, &out, &out_len);
+    archer_release_copy(c1, c1_buf);
+    archer_release_copy(c0, c0_buf);
+
+    jbyteArray ret = archer_new_bytes(env, out, out_len);
+    archer_free(out);
+    return ret;
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    paillierMul
+ * Signature: ([B[B[B)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_paillierMul
+  (JNIEnv *env, jclass clazz, jbyteArray jpk, jbyteArray jcipher, jbyteArray jmsg) {
+    PaillierPublicKey pk;
+    if(NULL == jcipher || NULL == jmsg || !archer_copy_paillier_pk(env, jpk, &pk)) {
+        return NULL;
+    }
+    uint8_t *out = NULL;
+    size_t out_len = 0;
+    jsize cipher_len = (*env)->GetArrayLength(env, jcipher);
+    jsize msg_len = (*env)->GetArrayLength(env, jmsg);
+    uint8_t cipher_buf[ARCHER_COPY_BUF];
+    uint8_t *cipher = archer_copy_bytes(env, jcipher, cipher_buf, cipher_len);
+    if(NULL == cipher) {
+        return NULL;
+    }
+    uint8_t msg_buf[ARCHER_COPY_BUF];
+    uint8_t *msg = archer_copy_bytes(env, jmsg, msg_buf, msg_len);
+    if(NULL == msg) {
+        archer_release_copy(cipher, cipher_buf);
+        return NULL;
+    }
+    paillier_mul(&pk, cipher, cipher_len, msg, msg_len, &out, &out_len);
+    archer_release_copy(msg, msg_buf);
+    archer_release_copy(cipher, cipher_buf);
+
+    jbyteArray ret = archer_new_bytes(env, out, out_len);
+    archer_free(out);
+    return ret;
+}
+
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    paillierSub
+ * Signature: ([B[B[B)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_paillierSub
+  (JNIEnv *env, jclass clazz, jbyteArray jpk, jbyteArray jc0, jbyteArray jc1) {
+    PaillierPublicKey pk;
+    if(NULL == jc0 || NULL == jc1 || !archer_copy_paillier_pk(env, jpk, &pk)) {
+        return NULL;
+    }
+    uint8_t out[2 * PAILLIER_N_MAX];
+    size_t out_len = sizeof(out);
+    jsize c0_len = (*env)->GetArrayLength(env, jc0);
+    jsize c1_len = (*env)->GetArrayLength(env, jc1);
+    uint8_t c0_buf[ARCHER_COPY_BUF];
+    uint8_t *c0 = archer_copy_bytes(env, jc0, c0_buf, c0_len);
+    if(NULL == c0) {
+        return NULL;
+    }
+    uint8_t c1_buf[ARCHER_COPY_BUF];
+    uint8_t *c1 = archer_copy_bytes(env, jc1, c1_buf, c1_len);
+    if(NULL == c1) {
+        archer_release_copy(c0, c0_buf);
+        return NULL;
+    }
+    int ok = paillier_sub_into(&pk, c0, c0_len, c1, c1_len, out, &out_len);
+    archer_release_copy(c1, c1_buf);
+    archer_release_copy(c0, c0_buf);
+
+    return ok ? archer_new_bytes(env, out, out_len) : NULL;
+}
+
+/*
+ * Class:     com_archer_math_Archer
+ * Method:    paillierNeg
+ * Signature: ([B[B)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_Archer_paillierNeg
+  (JNIEnv *env, jclass clazz, jbyteArray jpk, jbyteArray jcipher) {
+    PaillierPublicKey pk;
+    if(NULL == jcipher || !archer_copy_paillier_pk(env, jpk, &pk)) {
+        return NULL;
+    }
+    uint8_t out[2 * PAILLIER_N_MAX];
+    size_t out_len = sizeof(out);
+    jsize cipher_len = (*env)->GetArrayLength(env, jcipher);
+    uint8_t cipher_buf[ARCHER_COPY_BUF];
+    uint8_t *cipher = archer_copy_bytes(env, jcipher, cipher_buf, cipher_len);
+    if(NULL == cipher) {
+        return NULL;
+    }
+    int ok = paillier_neg_into(&pk, cipher, cipher_len, out, &out_len);
+    archer_release_copy(cipher, cipher_buf);
+
+    return ok ? archer_new_bytes(env, out, out_len) : NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -2,6 +2,8 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <gmp.h>
+#include <stdlib.h>
+#include <string.h>
 
 #ifndef _Included_com_archer_math_MathLib
 #define _Included_com_archer_math_MathLib
@@ -574,6 +576,316 @@ JNIEXPORT jbyteArray JNICALL Java_com_archer_math_MathLib_mulInvm
     return ret;
 }
 
+
+/*
+* Montgomery contexts: the modulus is imported once by montInit and the
+* returned handle is passed to the mont* functions, whose operands stay in
+* Montgomery form (a * R mod p, R = 2^(64 * limbs)) as fixed-width big-endian
+* byte arrays of the modulus length. Use montTo/montFrom to convert.
+*/
+typedef struct math_mont_ctx {
+    mp_size_t n;
+    size_t bytes;
+    mp_limb_t pinv;
+    mp_limb_t *p;
+    mp_limb_t *r2;
+    mp_limb_t *one;
+} math_mont_ctx;
+
+#define MONT_WINDOW 4
+
+static void math_mont_redc(mp_limb_t *r, mp_limb_t *t, const math_mont_ctx *ctx) {
+    mp_size_t n = ctx->n;
+    mp_limb_t *u = t, cy;
+    for(mp_size_t i = 0; i < n; i++) {
+        u[0] = mpn_addmul_1(u, ctx->p, n, u[0] * ctx->pinv);
+        u++;
+    }
+    cy = mpn_add_n(r, u, t, n);
+    if(cy || mpn_cmp(r, ctx->p, n) >= 0) {
+        mpn_sub_n(r, r, ctx->p, n);
+    }
+}
+
+static void math_mont_mul(mp_limb_t *r, const mp_limb_t *a, const mp_limb_t *b, const math_mont_ctx *ctx) {
+    mp_limb_t t[2 * ctx->n];
+    if(a == b) {
+        mpn_sqr(t, a, ctx->n);
+    } else {
+        mpn_mul_n(t, a, b, ctx->n);
+    }
+    math_mont_redc(r, t, ctx);
+}
+
+static void math_mont_import(mp_limb_t *r, const uint8_t *in, size_t in_len, const math_mont_ctx *ctx) {
+    mp_size_t n = ctx->n, tn = (in_len + sizeof(mp_limb_t) - 1) / sizeof(mp_limb_t);
+    mp_limb_t t[tn > n ? tn : n];
+    memset(t, 0, sizeof(t));
+    for(size_t i = 0; i < in_len; i++) {
+        t[i / sizeof(mp_limb_t)] |= (mp_limb_t)in[in_len - 1 - i] << (8 * (i % sizeof(mp_limb_t)));
+    }
+    while(tn > 0 && !t[tn - 1]) {
+        tn--;
+    }
+    if(tn < n || (tn == n && mpn_cmp(t, ctx->p, n) < 0)) {
+        memcpy(r, t, n * sizeof(mp_limb_t));
+    } else {
+        mp_limb_t q[tn - n + 1];
+        mpn_tdiv_qr(q, r, 0, t, tn, ctx->p, n);
+    }
+}
+
+static jbyteArray math_mont_export(JNIEnv *env, const mp_limb_t *a, const math_mont_ctx *ctx) {
+    uint8_t rc[ctx->bytes];
+    for(size_t i = 0; i < ctx->bytes; i++) {
+        rc[ctx->bytes - 1 - i] = (a[i / sizeof(mp_limb_t)] >> (8 * (i % sizeof(mp_limb_t)))) & 0xff;
+    }
+    jbyteArray ret = (*env)->NewByteArray(env, ctx->bytes);
+    if(NULL != ret) {
+        (*env)->SetByteArrayRegion(env, ret, 0, ctx->bytes, (jbyte *)rc);
+    }
+    return ret;
+}
+
+static int math_mont_load(JNIEnv *env, jbyteArray ja, mp_limb_t *r, const math_mont_ctx *ctx) {
+    if(NULL == ja) {
+        return 0;
+    }
+    uint32_t a_len = (*env)->GetArrayLength(env, ja);
+    uint8_t ac[a_len];
+    (*env)->GetByteArrayRegion(env, ja, 0, a_len, (jbyte *)ac);
+    math_mont_import(r, ac, a_len, ctx);
+    return 1;
+}
+
+/*
+ * Class:     com_archer_math_MathLib
+ * Method:    montInit
+ * Signature: ([B)J
+ * @return context handle, 0 if p is not an odd number > 1 or out of memory
+ */
+JNIEXPORT jlong JNICALL Java_com_archer_math_MathLib_montInit
+  (JNIEnv *env, jclass clazz, jbyteArray jp) {
+    if(NULL == jp) {
+        return 0;
+    }
+
+    uint32_t p_len = (*env)->GetArrayLength(env, jp);
+    uint8_t pc[p_len];
+    (*env)->GetByteArrayRegion(env, jp, 0, p_len, (jbyte *)pc);
+
+    mpz_t p, r;
+    mpz_init(p);
+    mpz_init(r);
+    mpz_import(p, p_len, 1, 1, 0, 0, pc);
+    if(!mpz_odd_p(p) || mpz_cmp_ui(p, 1) <= 0) {
+        mpz_clear(p);
+        mpz_clear(r);
+        return 0;
+    }
+
+    mp_size_t n = mpz_size(p);
+    math_mont_ctx *ctx = (math_mont_ctx *)malloc(sizeof(math_mont_ctx));
+    mp_limb_t *limbs = (mp_limb_t *)malloc(3 * n * sizeof(mp_limb_t));
+    if(NULL == ctx || NULL == limbs) {
+        free(ctx);
+        free(limbs);
+        mpz_clear(p);
+        mpz_clear(r);
+        return 0;
+    }
+    ctx->n = n;
+    ctx->bytes = (mpz_sizeinbase(p, 2) + 7) / 8;
+    ctx->p = limbs;
+    ctx->r2 = ctx->p + n;
+    ctx->one = ctx->p + 2 * n;
+
+    // pinv = -p^(-1) mod 2^64, newton iteration doubles the correct bits
+    mp_limb_t p0 = mpz_getlimbn(p, 0), inv = p0;
+    for(int i = 0; i < 6; i++) {
+        inv *= 2 - p0 * inv;
+    }
+    ctx->pinv = -inv;
+
+    mpz_set_ui(r, 0);
+    mpz_setbit(r, 2 * n * GMP_NUMB_BITS);
+    mpz_mod(r, r, p);
+    for(mp_size_t i = 0; i < n; i++) {
+        ctx->p[i] = mpz_getlimbn(p, i);
+        ctx->r2[i] = mpz_getlimbn(r, i);
+    }
+    mpz_set_ui(r, 0);
+    mpz_setbit(r, n * GMP_NUMB_BITS);
+    mpz_mod(r, r, p);
+    for(mp_size_t i = 0; i < n; i++) {
+        ctx->one[i] = mpz_getlimbn(r, i);
+    }
+
+    mpz_clear(p);
+    mpz_clear(r);
+    return (jlong)(intptr_t)ctx;
+}
+
+/*
+ * Class:     com_archer_math_MathLib
+ * Method:    montFree
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_com_archer_math_MathLib_montFree
+  (JNIEnv *env, jclass clazz, jlong jctx) {
+    math_mont_ctx *ctx = (math_mont_ctx *)(intptr_t)jctx;
+    if(NULL == ctx) {
+        return ;
+    }
+    free(ctx->p);
+    free(ctx);
+}
+
+/*
+ * Class:     com_archer_math_MathLib
+ * Method:    montTo
+ * Signature: (J[B)[B
+ * @return a * R mod p
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_MathLib_montTo
+  (JNIEnv *env, jclass clazz, jlong jctx, jbyteArray ja) {
+    math_mont_ctx *ctx = (math_mont_ctx *)(intptr_t)jctx;
+    if(NULL == ctx) {
+        return NULL;
+    }
+    mp_limb_t a[ctx->n];
+    if(!math_mont_load(env, ja, a, ctx)) {
+        return NULL;
+    }
+    math_mont_mul(a, a, ctx->r2, ctx);
+    return math_mont_export(env, a, ctx);
+}
+
+/*
+ * Class:     com_archer_math_MathLib
+ * Method:    montFrom
+ * Signature: (J[B)[B
+ * @return a * R^(-1) mod p
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_MathLib_montFrom
+  (JNIEnv *env, jclass clazz, jlong jctx, jbyteArray ja) {
+    math_mont_ctx *ctx = (math_mont_ctx *)(intptr_t)jctx;
+    if(NULL == ctx) {
+        return NULL;
+    }
+    mp_limb_t a[ctx->n], t[2 * ctx->n];
+    if(!math_mont_load(env, ja, a, ctx)) {
+        return NULL;
+    }
+    memcpy(t, a, ctx->n * sizeof(mp_limb_t));
+    memset(t + ctx->n, 0, ctx->n * sizeof(mp_limb_t));
+    math_mont_redc(a, t, ctx);
+    return math_mont_export(env, a, ctx);
+}
+
+/*
+ * Class:     com_archer_math_MathLib
+ * Method:    montMulm
+ * Signature: (J[B[B)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_MathLib_montMulm
+  (JNIEnv *env, jclass clazz, jlong jctx, jbyteArray ja, jbyteArray jb) {
+    math_mont_ctx *ctx = (math_mont_ctx *)(intptr_t)jctx;
+    if(NULL == ctx) {
+        return NULL;
+    }
+    mp_limb_t a[ctx->n], b[ctx->n];
+    if(!math_mont_load(env, ja, a, ctx) || !math_mont_load(env, jb, b, ctx)) {
+        return NULL;
+    }
+    math_mont_mul(a, a, b, ctx);
+    return math_mont_export(env, a, ctx);
+}
+
+/*
+ * Class:     com_archer_math_MathLib
+ * Method:    montAddm
+ * Signature: (J[B[B)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_MathLib_montAddm
+  (JNIEnv *env, jclass clazz, jlong jctx, jbyteArray ja, jbyteArray jb) {
+    math_mont_ctx *ctx = (math_mont_ctx *)(intptr_t)jctx;
+    if(NULL == ctx) {
+        return NULL;
+    }
+    mp_limb_t a[ctx->n], b[ctx->n];
+    if(!math_mont_load(env, ja, a, ctx) || !math_mont_load(env, jb, b, ctx)) {
+        return NULL;
+    }
+    if(mpn_add_n(a, a, b, ctx->n) || mpn_cmp(a, ctx->p, ctx->n) >= 0) {
+        mpn_sub_n(a, a, ctx->p, ctx->n);
+    }
+    return math_mont_export(env, a, ctx);
+}
+
+/*
+ * Class:     com_archer_math_MathLib
+ * Method:    montSubm
+ * Signature: (J[B[B)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_MathLib_montSubm
+  (JNIEnv *env, jclass clazz, jlong jctx, jbyteArray ja, jbyteArray jb) {
+    math_mont_ctx *ctx = (math_mont_ctx *)(intptr_t)jctx;
+    if(NULL == ctx) {
+        return NULL;
+    }
+    mp_limb_t a[ctx->n], b[ctx->n];
+    if(!math_mont_load(env, ja, a, ctx) || !math_mont_load(env, jb, b, ctx)) {
+        return NULL;
+    }
+    if(mpn_sub_n(a, a, b, ctx->n)) {
+        mpn_add_n(a, a, ctx->p, ctx->n);
+    }
+    return math_mont_export(env, a, ctx);
+}
+
+/*
+ * Class:     com_archer_math_MathLib
+ * Method:    montPowm
+ * Signature: (J[B[B)[B
+ * @param ja, base in montgomery form
+ * @param je, plain exponent
+ * @return a^e in montgomery form
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_archer_math_MathLib_montPowm
+  (JNIEnv *env, jclass clazz, jlong jctx, jbyteArray ja, jbyteArray je) {
+    math_mont_ctx *ctx = (math_mont_ctx *)(intptr_t)jctx;
+    if(NULL == ctx || NULL == je) {
+        return NULL;
+    }
+    mp_size_t n = ctx->n;
+    mp_limb_t a[n], r[n], tbl[1 << MONT_WINDOW][n];
+    if(!math_mont_load(env, ja, a, ctx)) {
+        return NULL;
+    }
+    uint32_t e_len = (*env)->GetArrayLength(env, je);
+    uint8_t ec[e_len];
+    (*env)->GetByteArrayRegion(env, je, 0, e_len, (jbyte *)ec);
+
+    // fixed 4-bit window, one nibble of the exponent per step
+    memcpy(tbl[0], ctx->one, n * sizeof(mp_limb_t));
+    memcpy(tbl[1], a, n * sizeof(mp_limb_t));
+    for(int i = 2; i < (1 << MONT_WINDOW); i++) {
+        math_mont_mul(tbl[i], tbl[i - 1], a, ctx);
+    }
+    memcpy(r, ctx->one, n * sizeof(mp_limb_t));
+    for(uint32_t i = 0; i < 2 * e_len; i++) {
+        int w = (i & 1) ? (ec[i >> 1] & 0xf) : (ec[i >> 1] >> 4);
+        for(int j = 0; j < MONT_WINDOW; j++) {
+            math_mont_mul(r, r, r, ctx);
+        }
+        if(w) {
+            math_mont_mul(r, r, tbl[w], ctx);
+        }
+    }
+    return math_mont_export(env, r, ctx);
+}
+
 #ifdef __cplusplus
 }
 #endif